@@ -129,6 +129,65 @@ asmlinkage void __div0(void)
 
 extern int do_decompress(u8 *input, int len, u8 *output, void (*error)(char *x));
 
+#ifdef CONFIG_DEBUG_DECOMPRESS_TIME
+static void putnum(unsigned long n)
+{
+	char buf[11], *p = buf + sizeof(buf) - 1;
+
+	*p = '\0';
+	do {
+		*--p = '0' + n % 10;
+		n /= 10;
+	} while (n);
+	putstr(p);
+}
+
+/*
+ * The performance monitor cycle counter, counting every 64th cycle so
+ * that it cannot wrap while a kernel is decompressed.  The kernel resets
+ * the PMU itself when perf starts up.
+ */
+static int pmu_present(void)
+{
+	unsigned long dfr0;
+
+	asm volatile("mrc p15, 0, %0, c0, c1, 2" : "=r" (dfr0));
+	dfr0 = (dfr0 >> 24) & 0xf;
+	return dfr0 != 0 && dfr0 != 0xf;
+}
+
+static void cycles_start(void)
+{
+	/* PMCR: enable, reset cycle counter, divide by 64 */
+	asm volatile("mcr p15, 0, %0, c9, c12, 0" : : "r" (0xd));
+	asm volatile("mcr p15, 0, %0, c9, c12, 1" : : "r" (1UL << 31));
+}
+
+static unsigned long cycles_read(void)
+{
+	unsigned long count;
+
+	asm volatile("mrc p15, 0, %0, c9, c13, 0" : "=r" (count));
+	asm volatile("mcr p15, 0, %0, c9, c12, 2" : : "r" (1UL << 31));
+	return count;
+}
+
+static void report_decompress(unsigned long count)
+{
+	unsigned char *size = (unsigned char *)input_data_end - 4;
+
+	/* the build appends the uncompressed size, little endian */
+	putstr(" done, ");
+	putnum(input_data_end - input_data);
+	putstr(" -> ");
+	putnum(size[0] | size[1] << 8 | size[2] << 16 |
+	       (unsigned long)size[3] << 24);
+	putstr(" bytes in ");
+	putnum(count / 1000 * 64 + count % 1000 * 64 / 1000);
+	putstr(" kcycles, booting the kernel.\n");
+}
+#endif
+
 
 void
 decompress_kernel(unsigned long output_start, unsigned long free_mem_ptr_p,
@@ -145,10 +204,18 @@ decompress_kernel(unsigned long output_start, unsigned long free_mem_ptr_p,
 	arch_decomp_setup();
 
 	putstr("Uncompressing Linux...");
+#ifdef CONFIG_DEBUG_DECOMPRESS_TIME
+	if (pmu_present())
+		cycles_start();
+#endif
 	ret = do_decompress(input_data, input_data_end - input_data,
 			    output_data, error);
 	if (ret)
 		error("decompressor returned an error");
+#ifdef CONFIG_DEBUG_DECOMPRESS_TIME
+	else if (pmu_present())
+		report_decompress(cycles_read());
+#endif
 	else
 		putstr(" done, booting the kernel.\n");
 }
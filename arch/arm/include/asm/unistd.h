@@ -405,6 +405,19 @@
 #define __NR_process_vm_readv		(__NR_SYSCALL_BASE+376)
 #define __NR_process_vm_writev		(__NR_SYSCALL_BASE+377)
 					/* 378 for kcmp */
+					/* 379 for finit_module */
+					/* 380 for sched_setattr */
+					/* 381 for sched_getattr */
+					/* 382 for renameat2 */
+					/* 383 for seccomp */
+					/* 384 for getrandom */
+					/* 385 for memfd_create */
+					/* 386 for bpf */
+					/* 387 for execveat */
+					/* 388 for userfaultfd */
+					/* 389 for membarrier */
+					/* 390 for mlock2 */
+#define __NR_copy_file_range		(__NR_SYSCALL_BASE+391)
 
 /*
  * The following SWIs are ARM private.
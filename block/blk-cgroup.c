@@ -21,6 +21,7 @@
 #include <linux/atomic.h>
 #include "blk-cgroup.h"
 #include "blk.h"
+#include "blk-lat-hist.h"
 
 #define MAX_KEY_LEN 100
 
@@ -472,6 +473,39 @@ u64 __blkg_prfill_rwstat(struct seq_file *sf, struct blkg_policy_data *pd,
 	return v;
 }
 
+#ifdef CONFIG_BLK_LATENCY_HIST
+/**
+ * __blkg_prfill_lat_hist - prfill helper for a latency histogram
+ * @sf: seq_file to print to
+ * @pd: policy private data of interest
+ * @hist: histogram to print
+ *
+ * Print one line per bucket of @hist for the device associated with @pd:
+ * the lower bound of the bucket in usecs, then the number of reads and
+ * writes.  Returns the number of requests in the histogram.
+ */
+u64 __blkg_prfill_lat_hist(struct seq_file *sf, struct blkg_policy_data *pd,
+			   const struct blk_lat_hist *hist)
+{
+	const char *dname = blkg_dev_name(pd->blkg);
+	u64 v = 0;
+	int i;
+
+	if (!dname)
+		return 0;
+
+	for (i = 0; i < BLK_LAT_HIST_BUCKETS; i++) {
+		seq_printf(sf, "%s %u %llu %llu\n", dname, blk_lat_hist_usec(i),
+			   (unsigned long long)hist->count[READ][i],
+			   (unsigned long long)hist->count[WRITE][i]);
+		v += hist->count[READ][i] + hist->count[WRITE][i];
+	}
+
+	return v;
+}
+EXPORT_SYMBOL_GPL(__blkg_prfill_lat_hist);
+#endif
+
 /**
  * blkg_prfill_stat - prfill callback for blkg_stat
  * @sf: seq_file to print to
@@ -146,6 +146,11 @@ void blkcg_print_blkgs(struct seq_file *sf, struct blkcg *blkcg,
 u64 __blkg_prfill_u64(struct seq_file *sf, struct blkg_policy_data *pd, u64 v);
 u64 __blkg_prfill_rwstat(struct seq_file *sf, struct blkg_policy_data *pd,
 			 const struct blkg_rwstat *rwstat);
+#ifdef CONFIG_BLK_LATENCY_HIST
+struct blk_lat_hist;
+u64 __blkg_prfill_lat_hist(struct seq_file *sf, struct blkg_policy_data *pd,
+			   const struct blk_lat_hist *hist);
+#endif
 u64 blkg_prfill_stat(struct seq_file *sf, struct blkg_policy_data *pd, int off);
 u64 blkg_prfill_rwstat(struct seq_file *sf, struct blkg_policy_data *pd,
 		       int off);
@@ -30,12 +30,17 @@
 #include <linux/list_sort.h>
 #include <linux/delay.h>
 #include <linux/ratelimit.h>
+#include <linux/hrtimer.h>
+#include <linux/blk-mq.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/block.h>
 
 #include "blk.h"
+#include "blk-lat-hist.h"
 #include "blk-cgroup.h"
+#include "blk-mq.h"
+#include "blk-wbt.h"
 
 EXPORT_TRACEPOINT_SYMBOL_GPL(block_bio_remap);
 EXPORT_TRACEPOINT_SYMBOL_GPL(block_rq_remap);
@@ -58,7 +63,7 @@ struct kmem_cache *blk_requestq_cachep;
  */
 static struct workqueue_struct *kblockd_workqueue;
 
-static void drive_stat_acct(struct request *rq, int new_io)
+void drive_stat_acct(struct request *rq, int new_io)
 {
 	struct hd_struct *part;
 	int rw = rq_data_dir(rq);
@@ -89,6 +94,7 @@ static void drive_stat_acct(struct request *rq, int new_io)
 		part_round_stats(cpu, part);
 		part_inc_in_flight(part, rw);
 		rq->part = part;
+		blk_lat_hist_start(rq);
 	}
 
 	part_stat_unlock();
@@ -506,7 +512,10 @@ void blk_cleanup_queue(struct request_queue *q)
 	mutex_unlock(&q->sysfs_lock);
 
 	/* drain all requests queued before DEAD marking */
-	blk_drain_queue(q, true);
+	if (q->mq_ops)
+		blk_mq_drain_queue(q);
+	else
+		blk_drain_queue(q, true);
 
 	/* @q won't process any more request, flush async actions */
 	del_timer_sync(&q->backing_dev_info.laptop_mode_wb_timer);
@@ -1090,6 +1099,9 @@ struct request *blk_get_request(struct request_queue *q, int rw, gfp_t gfp_mask)
 
 	BUG_ON(rw != READ && rw != WRITE);
 
+	if (q->mq_ops)
+		return blk_mq_alloc_request(q, rw, gfp_mask);
+
 	/* create ioc upfront */
 	create_io_context(gfp_mask, q->node);
 
@@ -1179,6 +1191,7 @@ void blk_requeue_request(struct request_queue *q, struct request *rq)
 
 	BUG_ON(blk_queued_rq(rq));
 
+	wbt_requeue(q->rq_wb, rq);
 	elv_requeue_request(q, rq);
 }
 EXPORT_SYMBOL(blk_requeue_request);
@@ -1240,6 +1253,14 @@ void __blk_put_request(struct request_queue *q, struct request *req)
 	if (unlikely(--req->ref_count))
 		return;
 
+	if (q->mq_ops) {
+		blk_mq_free_request(req);
+		return;
+	}
+
+	/* also covers requests merged away before they were started */
+	wbt_done(q->rq_wb, req);
+
 	elv_completed_request(q, req);
 
 	/* this is a bio leak */
@@ -1268,6 +1289,12 @@ void blk_put_request(struct request *req)
 	unsigned long flags;
 	struct request_queue *q = req->q;
 
+	/* multi-queue requests are returned to their tag map, no lock */
+	if (q->mq_ops) {
+		__blk_put_request(q, req);
+		return;
+	}
+
 	spin_lock_irqsave(q->queue_lock, flags);
 	__blk_put_request(q, req);
 	spin_unlock_irqrestore(q->queue_lock, flags);
@@ -1432,6 +1459,7 @@ void blk_queue_bio(struct request_queue *q, struct bio *bio)
 	int el_ret, rw_flags, where = ELEVATOR_INSERT_SORT;
 	struct request *req;
 	unsigned int request_count = 0;
+	bool wb_acct;
 
 	/*
 	 * low level driver can indicate that it wants pages above a
@@ -1482,15 +1510,20 @@ get_rq:
 	if (sync)
 		rw_flags |= REQ_SYNC;
 
+	/* may sleep with the queue unlocked if writeback is being throttled */
+	wb_acct = wbt_wait(q->rq_wb, bio, q->queue_lock);
+
 	/*
 	 * Grab a free request. This is might sleep but can not fail.
 	 * Returns with the queue unlocked.
 	 */
 	req = get_request(q, rw_flags, bio, GFP_NOIO);
 	if (unlikely(!req)) {
+		wbt_track(q->rq_wb, NULL, wb_acct);
 		bio_endio(bio, -ENODEV);	/* @q is dead */
 		goto out_unlock;
 	}
+	wbt_track(q->rq_wb, req, wb_acct);
 
 	/*
 	 * After dropping the lock and possibly sleeping here, our request
@@ -1990,7 +2023,7 @@ static void blk_account_io_completion(struct request *req, unsigned int bytes)
 	}
 }
 
-static void blk_account_io_done(struct request *req)
+void blk_account_io_done(struct request *req)
 {
 	/*
 	 * Account IO completion.  flush_rq isn't accounted as a
@@ -2013,6 +2046,8 @@ static void blk_account_io_done(struct request *req)
 
 		hd_struct_put(part);
 		part_stat_unlock();
+
+		blk_lat_hist_done(req);
 	}
 }
 
@@ -2162,6 +2197,7 @@ void blk_start_request(struct request *req)
 	if (unlikely(blk_bidi_rq(req)))
 		req->next_rq->resid_len = blk_rq_bytes(req->next_rq);
 
+	wbt_issue(req->q->rq_wb, req);
 	blk_add_timer(req);
 }
 EXPORT_SYMBOL(blk_start_request);
@@ -2425,6 +2461,7 @@ static void blk_finish_request(struct request *req, int error)
 
 
 	blk_account_io_done(req);
+	wbt_done(req->q->rq_wb, req);
 
 	if (req->end_io)
 		req->end_io(req, error);
@@ -2716,6 +2753,85 @@ int blk_lld_busy(struct request_queue *q)
 }
 EXPORT_SYMBOL_GPL(blk_lld_busy);
 
+/*
+ * Fold a polled completion latency into the running average used to size
+ * the hybrid sleep.  Racy updates from concurrent pollers only lose samples.
+ */
+static void blk_poll_account(struct request_queue *q, ktime_t start)
+{
+	u64 sample = ktime_to_ns(ktime_sub(ktime_get(), start));
+	u64 avg = q->poll_nsec;
+
+	q->poll_nsec = avg ? avg - (avg >> 3) + (sample >> 3) : sample;
+}
+
+/*
+ * Before spinning, sleep for part of the expected completion time so that
+ * the CPU is not burnt for the whole device latency.  Returns true if we
+ * slept, in which case the caller must recheck for completion.
+ */
+static bool blk_poll_sleep(struct request_queue *q, ktime_t start)
+{
+	s64 elapsed, target;
+	ktime_t kt;
+
+	if (q->poll_delay < 0)
+		return false;
+	if (q->poll_delay > 0)
+		target = (s64)q->poll_delay * NSEC_PER_USEC;
+	else
+		target = q->poll_nsec >> 1;
+	if (!target)
+		return false;
+
+	elapsed = ktime_to_ns(ktime_sub(ktime_get(), start));
+	if (elapsed >= target)
+		return false;
+
+	kt = ns_to_ktime(target - elapsed);
+	schedule_hrtimeout(&kt, HRTIMER_MODE_REL);
+	__set_current_state(TASK_RUNNING);
+	return true;
+}
+
+/**
+ * blk_poll - spin for completion of I/O issued to a polling queue
+ * @q:     the queue the I/O was issued to
+ * @start: when the I/O being waited for was submitted
+ *
+ * Description:
+ *    Called by a task that has set itself TASK_UNINTERRUPTIBLE and is about
+ *    to sleep waiting for a bio submitted at @start.  If @q supports polling
+ *    and io_poll is enabled, reap completions from the hardware until the
+ *    waiter is woken or the CPU is needed elsewhere.
+ *
+ * Return:
+ *    true  - progress was made, the caller must recheck its wait condition
+ *    false - nothing was found, the caller should go to sleep as usual
+ */
+bool blk_poll(struct request_queue *q, ktime_t start)
+{
+	if (!q->poll_fn || !blk_queue_io_poll(q))
+		return false;
+
+	if (blk_poll_sleep(q, start))
+		return true;
+
+	while (!need_resched()) {
+		bool found = q->poll_fn(q);
+
+		if (found || current->state == TASK_RUNNING) {
+			blk_poll_account(q, start);
+			__set_current_state(TASK_RUNNING);
+			return true;
+		}
+		cpu_relax();
+	}
+
+	return false;
+}
+EXPORT_SYMBOL_GPL(blk_poll);
+
 /**
  * blk_rq_unprep_clone - Helper function to free all bios in a cloned request
  * @rq: the clone request to be cleaned up
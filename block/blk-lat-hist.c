@@ -0,0 +1,107 @@
+/*
+ * Request completion latency histograms
+ *
+ * Cumulative counters in /proc/diskstats give the average service time of
+ * a device but say nothing about its tail.  Every queue keeps a per-cpu
+ * histogram of completion latencies, split by direction, with log2 sized
+ * buckets so that recording a request costs one clock read and one
+ * per-cpu increment.  Requests are only timed while the queue's iostats
+ * accounting is on.
+ *
+ * Requests slower than the queue's outlier threshold are also reported
+ * through the block_rq_lat_outlier tracepoint.
+ */
+#include <linux/kernel.h>
+#include <linux/blkdev.h>
+#include <linux/percpu.h>
+
+#include <trace/events/block.h>
+
+#include "blk.h"
+#include "blk-lat-hist.h"
+
+int blk_lat_hist_init(struct request_queue *q)
+{
+	if (q->lat_hist)
+		return 0;
+
+	q->lat_hist = alloc_percpu(struct blk_lat_hist);
+	if (!q->lat_hist)
+		return -ENOMEM;
+
+	return 0;
+}
+
+void blk_lat_hist_exit(struct request_queue *q)
+{
+	free_percpu(q->lat_hist);
+	q->lat_hist = NULL;
+}
+
+void blk_lat_hist_done(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+	u64 now, lat;
+
+	if (!q->lat_hist || !rq->lat_start_ns)
+		return;
+
+	now = ktime_to_ns(ktime_get());
+	lat = now > rq->lat_start_ns ? now - rq->lat_start_ns : 0;
+
+	this_cpu_inc(q->lat_hist->count[rq_data_dir(rq)][blk_lat_hist_bucket(lat)]);
+
+	if (q->lat_outlier_usec &&
+	    lat > (u64)q->lat_outlier_usec * NSEC_PER_USEC)
+		trace_block_rq_lat_outlier(q, rq, lat);
+}
+
+static void blk_lat_hist_sum(struct request_queue *q, struct blk_lat_hist *sum)
+{
+	int cpu, rw, i;
+
+	memset(sum, 0, sizeof(*sum));
+	for_each_possible_cpu(cpu) {
+		struct blk_lat_hist *hist = per_cpu_ptr(q->lat_hist, cpu);
+
+		for (rw = 0; rw < 2; rw++)
+			for (i = 0; i < BLK_LAT_HIST_BUCKETS; i++)
+				sum->count[rw][i] += hist->count[rw][i];
+	}
+}
+
+/*
+ * One line per bucket: the lower bound in usecs, then the number of reads
+ * and writes that completed within it.
+ */
+ssize_t blk_lat_hist_show(struct request_queue *q, char *page)
+{
+	struct blk_lat_hist sum;
+	ssize_t len = 0;
+	int i;
+
+	if (!q->lat_hist)
+		return -EINVAL;
+
+	blk_lat_hist_sum(q, &sum);
+
+	for (i = 0; i < BLK_LAT_HIST_BUCKETS; i++)
+		len += sprintf(page + len, "%u %llu %llu\n",
+			       blk_lat_hist_usec(i),
+			       (unsigned long long)sum.count[READ][i],
+			       (unsigned long long)sum.count[WRITE][i]);
+
+	return len;
+}
+
+void blk_lat_hist_reset(struct request_queue *q)
+{
+	int cpu;
+
+	if (!q->lat_hist)
+		return;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(q->lat_hist, cpu), 0,
+		       sizeof(struct blk_lat_hist));
+}
@@ -0,0 +1,77 @@
+#ifndef BLK_LAT_HIST_H
+#define BLK_LAT_HIST_H
+
+#include <linux/ktime.h>
+#include <linux/log2.h>
+
+/*
+ * Completion latency histogram, from the time a request is accounted as
+ * started until it completes.  Bucket i counts requests that took
+ * [2^i, 2^(i+1)) usecs, the first one also counts anything faster and
+ * the last one anything slower.
+ */
+#define BLK_LAT_HIST_BUCKETS	24
+
+struct blk_lat_hist {
+	u64			count[2][BLK_LAT_HIST_BUCKETS];	/* [READ/WRITE] */
+};
+
+static inline unsigned int blk_lat_hist_bucket(u64 nsec)
+{
+	u64 usec = div_u64(nsec, NSEC_PER_USEC);
+
+	if (!usec)
+		return 0;
+	return min_t(unsigned int, ilog2(usec), BLK_LAT_HIST_BUCKETS - 1);
+}
+
+/* lower bound of a bucket in usecs */
+static inline unsigned int blk_lat_hist_usec(unsigned int bucket)
+{
+	return bucket ? 1U << bucket : 0;
+}
+
+#ifdef CONFIG_BLK_LATENCY_HIST
+
+int blk_lat_hist_init(struct request_queue *q);
+void blk_lat_hist_exit(struct request_queue *q);
+void blk_lat_hist_done(struct request *rq);
+ssize_t blk_lat_hist_show(struct request_queue *q, char *page);
+void blk_lat_hist_reset(struct request_queue *q);
+
+static inline void blk_lat_hist_start(struct request *rq)
+{
+	rq->lat_start_ns = ktime_to_ns(ktime_get());
+}
+
+/* a merged request started when the older of the two did */
+static inline void blk_lat_hist_merge(struct request *rq,
+				      struct request *next)
+{
+	if (next->lat_start_ns < rq->lat_start_ns)
+		rq->lat_start_ns = next->lat_start_ns;
+}
+
+#else
+
+static inline int blk_lat_hist_init(struct request_queue *q)
+{
+	return 0;
+}
+static inline void blk_lat_hist_exit(struct request_queue *q)
+{
+}
+static inline void blk_lat_hist_done(struct request *rq)
+{
+}
+static inline void blk_lat_hist_start(struct request *rq)
+{
+}
+static inline void blk_lat_hist_merge(struct request *rq,
+				      struct request *next)
+{
+}
+
+#endif /* CONFIG_BLK_LATENCY_HIST */
+
+#endif
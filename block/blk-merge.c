@@ -8,6 +8,7 @@
 #include <linux/scatterlist.h>
 
 #include "blk.h"
+#include "blk-lat-hist.h"
 
 static unsigned int __blk_recalc_rq_segments(struct request_queue *q,
 					     struct bio *bio)
@@ -470,6 +471,7 @@ static int attempt_merge(struct request_queue *q, struct request *req,
 	 */
 	if (time_after(req->start_time, next->start_time))
 		req->start_time = next->start_time;
+	blk_lat_hist_merge(req, next);
 
 	req->biotail->bi_next = next->bio;
 	req->biotail = next->biotail;
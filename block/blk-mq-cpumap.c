@@ -0,0 +1,39 @@
+/*
+ * CPU to hardware queue mapping for the multi-queue block layer
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/cpumask.h>
+#include <linux/blk-mq.h>
+
+#include "blk.h"
+#include "blk-mq.h"
+
+/*
+ * Spread the possible CPUs evenly over @nr_queues hardware queues, keeping
+ * CPUs with adjacent ids on the same queue.
+ */
+static void blk_mq_update_queue_map(unsigned int *map, unsigned int nr_queues)
+{
+	unsigned int nr_cpus = num_possible_cpus();
+	unsigned int cpu, i = 0;
+
+	for_each_possible_cpu(cpu) {
+		map[cpu] = (i * nr_queues) / nr_cpus;
+		i++;
+	}
+}
+
+unsigned int *blk_mq_make_queue_map(struct blk_mq_reg *reg)
+{
+	unsigned int *map;
+
+	map = kzalloc_node(sizeof(*map) * nr_cpu_ids, GFP_KERNEL,
+			   reg->numa_node);
+	if (!map)
+		return NULL;
+
+	blk_mq_update_queue_map(map, reg->nr_hw_queues);
+	return map;
+}
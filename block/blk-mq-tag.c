@@ -0,0 +1,133 @@
+/*
+ * Tag allocation for the multi-queue block layer.  Every hardware queue
+ * owns a fixed set of preallocated requests and a bitmap of which of them
+ * are in use; the bit number doubles as the request tag handed to the
+ * driver.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/blk-mq.h>
+
+#include "blk.h"
+#include "blk-mq.h"
+
+struct blk_mq_tags {
+	unsigned int		nr_tags;
+	unsigned int __percpu	*hint;		/* next bit to try, per CPU */
+	wait_queue_head_t	wait;
+	unsigned long		map[0];
+};
+
+struct blk_mq_tags *blk_mq_init_tags(unsigned int nr_tags, int node)
+{
+	struct blk_mq_tags *tags;
+	unsigned int cpu;
+
+	tags = kzalloc_node(sizeof(*tags) +
+			    BITS_TO_LONGS(nr_tags) * sizeof(unsigned long),
+			    GFP_KERNEL, node);
+	if (!tags)
+		return NULL;
+
+	tags->hint = alloc_percpu(unsigned int);
+	if (!tags->hint) {
+		kfree(tags);
+		return NULL;
+	}
+
+	/*
+	 * Start every CPU at a different spot in the map so that CPUs
+	 * sharing a hardware queue do not all fight over the first word.
+	 */
+	for_each_possible_cpu(cpu)
+		*per_cpu_ptr(tags->hint, cpu) =
+			(cpu * BITS_PER_LONG) % nr_tags;
+
+	tags->nr_tags = nr_tags;
+	init_waitqueue_head(&tags->wait);
+	return tags;
+}
+
+void blk_mq_free_tags(struct blk_mq_tags *tags)
+{
+	free_percpu(tags->hint);
+	kfree(tags);
+}
+
+static int __blk_mq_get_tag(struct blk_mq_tags *tags)
+{
+	unsigned int *hint, start, bit;
+	int tag = -1;
+
+	hint = get_cpu_ptr(tags->hint);
+	start = *hint;
+	if (start >= tags->nr_tags)
+		start = 0;
+
+	bit = start;
+	for (;;) {
+		bit = find_next_zero_bit(tags->map, tags->nr_tags, bit);
+		if (bit >= tags->nr_tags) {
+			/* wrap once and scan the part before the hint */
+			if (!start)
+				break;
+			bit = start = 0;
+			continue;
+		}
+		if (!test_and_set_bit(bit, tags->map)) {
+			tag = bit;
+			*hint = bit + 1;
+			break;
+		}
+		bit++;
+	}
+
+	put_cpu_ptr(tags->hint);
+	return tag;
+}
+
+/*
+ * Returns a free tag, or -1 if none is available and @gfp does not allow
+ * waiting for one.
+ */
+int blk_mq_get_tag(struct blk_mq_tags *tags, gfp_t gfp)
+{
+	DEFINE_WAIT(wait);
+	int tag;
+
+	tag = __blk_mq_get_tag(tags);
+	if (tag >= 0 || !(gfp & __GFP_WAIT))
+		return tag;
+
+	do {
+		prepare_to_wait(&tags->wait, &wait, TASK_UNINTERRUPTIBLE);
+		tag = __blk_mq_get_tag(tags);
+		if (tag >= 0)
+			break;
+		io_schedule();
+	} while (1);
+
+	finish_wait(&tags->wait, &wait);
+	return tag;
+}
+
+void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag)
+{
+	BUG_ON(tag >= tags->nr_tags);
+
+	smp_mb__before_clear_bit();
+	clear_bit(tag, tags->map);
+	smp_mb__after_clear_bit();
+
+	if (waitqueue_active(&tags->wait))
+		wake_up(&tags->wait);
+}
+
+bool blk_mq_tags_busy(struct blk_mq_tags *tags)
+{
+	return find_first_bit(tags->map, tags->nr_tags) < tags->nr_tags;
+}
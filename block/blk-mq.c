@@ -0,0 +1,939 @@
+/*
+ * Multi-queue block layer core
+ *
+ * Bios are turned into requests from a per hardware queue pool of
+ * preallocated, tagged requests, staged on a per-CPU software queue and
+ * handed straight to the driver through ->queue_rq().  Nothing in the
+ * submission path takes q->queue_lock, and completions are bounced back to
+ * the submitting CPU if QUEUE_FLAG_SAME_COMP is set.
+ *
+ * There is no elevator, merging or plugging: this is aimed at devices
+ * where the per-request cost of those outweighs what they save.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <linux/smp.h>
+#include <linux/cpu.h>
+#include <linux/delay.h>
+#include <linux/blk-mq.h>
+
+#include <trace/events/block.h>
+
+#include "blk.h"
+#include "blk-mq.h"
+
+static DEFINE_MUTEX(all_q_mutex);
+static LIST_HEAD(all_q_list);
+
+static struct blk_mq_ctx *__blk_mq_get_ctx(struct request_queue *q,
+					   unsigned int cpu)
+{
+	return per_cpu_ptr(q->queue_ctx, cpu);
+}
+
+/*
+ * This assumes per-cpu software queueing queues. They could be per-node
+ * as well, for instance. For now this is hardcoded as-is. Note that we don't
+ * care about preemption, since we know the ctx's are persistent. This does
+ * mean that we can't rely on ctx always matching the currently running CPU.
+ */
+static struct blk_mq_ctx *blk_mq_get_ctx(struct request_queue *q)
+{
+	return __blk_mq_get_ctx(q, get_cpu());
+}
+
+static void blk_mq_put_ctx(struct blk_mq_ctx *ctx)
+{
+	put_cpu();
+}
+
+static bool blk_mq_hctx_has_pending(struct blk_mq_hw_ctx *hctx)
+{
+	return !list_empty_careful(&hctx->dispatch) ||
+		find_first_bit(hctx->ctx_map, hctx->nr_ctx) < hctx->nr_ctx;
+}
+
+static void blk_mq_hctx_mark_pending(struct blk_mq_hw_ctx *hctx,
+				     struct blk_mq_ctx *ctx)
+{
+	if (!test_bit(ctx->index_hw, hctx->ctx_map))
+		set_bit(ctx->index_hw, hctx->ctx_map);
+}
+
+struct blk_mq_hw_ctx *blk_mq_map_queue(struct request_queue *q, const int cpu)
+{
+	return q->queue_hw_ctx[q->mq_map[cpu]];
+}
+EXPORT_SYMBOL(blk_mq_map_queue);
+
+static struct request *__blk_mq_alloc_request(struct blk_mq_hw_ctx *hctx,
+					      gfp_t gfp)
+{
+	struct request *rq;
+	int tag;
+
+	tag = blk_mq_get_tag(hctx->tags, gfp);
+	if (tag < 0)
+		return NULL;
+
+	rq = hctx->rqs[tag];
+	blk_rq_init(hctx->queue, rq);
+	rq->tag = tag;
+	return rq;
+}
+
+static void blk_mq_rq_ctx_init(struct request_queue *q, struct blk_mq_ctx *ctx,
+			       struct request *rq, unsigned int rw_flags)
+{
+	rq->mq_ctx = ctx;
+	rq->cpu = ctx->cpu;
+	rq->cmd_flags = rw_flags;
+	if (blk_queue_io_stat(q))
+		rq->cmd_flags |= REQ_IO_STAT;
+}
+
+/**
+ * blk_mq_alloc_request - allocate a request from a multi-queue device
+ * @q:		the queue
+ * @rw:		REQ_* direction and flags for the request
+ * @gfp:	allocation mask; if it allows waiting, sleep for a free tag
+ *
+ * Returns %NULL if @q is dead or no tag is free and @gfp does not allow
+ * waiting.  The request is released with blk_mq_free_request() (or
+ * blk_put_request()).
+ */
+struct request *blk_mq_alloc_request(struct request_queue *q, int rw, gfp_t gfp)
+{
+	struct blk_mq_ctx *ctx;
+	struct blk_mq_hw_ctx *hctx;
+	struct request *rq;
+
+	if (unlikely(blk_queue_dead(q)))
+		return NULL;
+
+	ctx = blk_mq_get_ctx(q);
+	hctx = q->mq_ops->map_queue(q, ctx->cpu);
+	blk_mq_put_ctx(ctx);
+
+	rq = __blk_mq_alloc_request(hctx, gfp);
+	if (rq)
+		blk_mq_rq_ctx_init(q, ctx, rq, rw);
+	return rq;
+}
+EXPORT_SYMBOL(blk_mq_alloc_request);
+
+void blk_mq_free_request(struct request *rq)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+	struct request_queue *q = rq->q;
+	struct blk_mq_hw_ctx *hctx = q->mq_ops->map_queue(q, ctx->cpu);
+	const int tag = rq->tag;
+
+	/* this is a bio leak */
+	WARN_ON(rq->bio != NULL);
+
+	rq->cmd_flags = 0;
+	blk_mq_put_tag(hctx->tags, tag);
+}
+EXPORT_SYMBOL(blk_mq_free_request);
+
+void __blk_mq_end_io(struct request *rq, int error)
+{
+	if (rq->bio)
+		blk_update_request(rq, error, blk_rq_bytes(rq));
+
+	blk_account_io_done(rq);
+
+	if (rq->end_io)
+		rq->end_io(rq, error);
+	else
+		__blk_put_request(rq->q, rq);
+}
+
+#if defined(CONFIG_SMP) && defined(CONFIG_USE_GENERIC_SMP_HELPERS)
+static void blk_mq_end_io_remote(void *data)
+{
+	struct request *rq = data;
+
+	__blk_mq_end_io(rq, (long) rq->completion_data);
+}
+#endif
+
+/**
+ * blk_mq_end_io - end I/O on a multi-queue request
+ * @rq:		the request being completed
+ * @error:	%0 for success, < %0 for error
+ *
+ * Completes all bytes of @rq.  If the queue asks for same-CPU completion
+ * and we are not on the CPU that submitted @rq, the completion is punted
+ * to that CPU with an IPI so that the bio end_io handlers run cache hot.
+ */
+void blk_mq_end_io(struct request *rq, int error)
+{
+#if defined(CONFIG_SMP) && defined(CONFIG_USE_GENERIC_SMP_HELPERS)
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+	int cpu;
+
+	if (!test_bit(QUEUE_FLAG_SAME_COMP, &rq->q->queue_flags)) {
+		__blk_mq_end_io(rq, error);
+		return;
+	}
+
+	cpu = get_cpu();
+	if (cpu != ctx->cpu && cpu_online(ctx->cpu)) {
+		/* no elevator, so the rb_node half of the union is free */
+		rq->completion_data = (void *) (long) error;
+		rq->csd.func = blk_mq_end_io_remote;
+		rq->csd.info = rq;
+		rq->csd.flags = 0;
+		__smp_call_function_single(ctx->cpu, &rq->csd, 0);
+	} else
+		__blk_mq_end_io(rq, error);
+	put_cpu();
+#else
+	__blk_mq_end_io(rq, error);
+#endif
+}
+EXPORT_SYMBOL(blk_mq_end_io);
+
+static void __blk_mq_insert_request(struct blk_mq_hw_ctx *hctx,
+				    struct request *rq, bool at_head)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+
+	trace_block_rq_insert(hctx->queue, rq);
+
+	if (at_head)
+		list_add(&rq->queuelist, &ctx->rq_list);
+	else
+		list_add_tail(&rq->queuelist, &ctx->rq_list);
+	blk_mq_hctx_mark_pending(hctx, ctx);
+}
+
+/**
+ * blk_mq_insert_request - queue a prepared request on its software queue
+ * @q:		the queue
+ * @rq:		request from blk_mq_alloc_request()
+ * @at_head:	insert at the head rather than the tail
+ * @run_queue:	run the hardware queue right away
+ *
+ * Must be called from process context.
+ */
+void blk_mq_insert_request(struct request_queue *q, struct request *rq,
+			   bool at_head, bool run_queue)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+	struct blk_mq_hw_ctx *hctx = q->mq_ops->map_queue(q, ctx->cpu);
+
+	spin_lock(&ctx->lock);
+	__blk_mq_insert_request(hctx, rq, at_head);
+	spin_unlock(&ctx->lock);
+
+	if (run_queue)
+		blk_mq_run_hw_queue(hctx, false);
+}
+EXPORT_SYMBOL(blk_mq_insert_request);
+
+/*
+ * Pull everything off the software queues mapped to @hctx and feed it to
+ * the driver.  Requests the driver could not take go onto hctx->dispatch
+ * and are retried first on the next run.
+ */
+static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	struct request_queue *q = hctx->queue;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	LIST_HEAD(rq_list);
+	int bit;
+
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	/*
+	 * Touch any software queue that has pending entries.  The bit is
+	 * cleared before the list is spliced, so a racing insert either
+	 * lands on our list or sets the bit again for the next run.
+	 */
+	for_each_set_bit(bit, hctx->ctx_map, hctx->nr_ctx) {
+		clear_bit(bit, hctx->ctx_map);
+		ctx = hctx->ctxs[bit];
+
+		spin_lock(&ctx->lock);
+		list_splice_tail_init(&ctx->rq_list, &rq_list);
+		spin_unlock(&ctx->lock);
+	}
+
+	/*
+	 * If we have previous entries on our dispatch list, grab them
+	 * and stuff them at the front for more fair dispatch.
+	 */
+	if (!list_empty_careful(&hctx->dispatch)) {
+		spin_lock(&hctx->lock);
+		if (!list_empty(&hctx->dispatch))
+			list_splice_init(&hctx->dispatch, &rq_list);
+		spin_unlock(&hctx->lock);
+	}
+
+	while (!list_empty(&rq_list)) {
+		int ret;
+
+		rq = list_first_entry(&rq_list, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+
+		trace_block_rq_issue(q, rq);
+		rq->cmd_flags |= REQ_STARTED;
+
+		ret = q->mq_ops->queue_rq(hctx, rq);
+		if (ret == BLK_MQ_RQ_QUEUE_OK)
+			continue;
+		if (ret == BLK_MQ_RQ_QUEUE_BUSY) {
+			list_add(&rq->queuelist, &rq_list);
+			break;
+		}
+
+		if (ret != BLK_MQ_RQ_QUEUE_ERROR)
+			pr_err("blk-mq: bad return on queue: %d\n", ret);
+		blk_mq_end_io(rq, -EIO);
+	}
+
+	/*
+	 * Any items that need requeuing?  Stuff them into hctx->dispatch,
+	 * that is where we will continue on next queue run.  A driver that
+	 * returned BUSY normally stops the queue and restarts it from its
+	 * completion path; if it did not (or already has), poll again
+	 * shortly so the requests are not stranded.
+	 */
+	if (!list_empty(&rq_list)) {
+		spin_lock(&hctx->lock);
+		list_splice(&rq_list, &hctx->dispatch);
+		spin_unlock(&hctx->lock);
+
+		if (!test_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			kblockd_schedule_delayed_work(q, &hctx->delayed_work,
+						      msecs_to_jiffies(3));
+	}
+}
+
+/**
+ * blk_mq_run_hw_queue - dispatch pending requests on a hardware queue
+ * @hctx:	the hardware queue
+ * @async:	punt the run to kblockd instead of running it here
+ *
+ * The synchronous variant must be called from process context; use
+ * @async from interrupt handlers.
+ */
+void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async)
+{
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	if (!async)
+		__blk_mq_run_hw_queue(hctx);
+	else
+		kblockd_schedule_delayed_work(hctx->queue, &hctx->delayed_work,
+					      0);
+}
+EXPORT_SYMBOL(blk_mq_run_hw_queue);
+
+void blk_mq_run_queues(struct request_queue *q, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!blk_mq_hctx_has_pending(hctx) ||
+		    test_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			continue;
+
+		blk_mq_run_hw_queue(hctx, async);
+	}
+}
+EXPORT_SYMBOL(blk_mq_run_queues);
+
+void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	cancel_delayed_work(&hctx->delayed_work);
+	set_bit(BLK_MQ_S_STOPPED, &hctx->state);
+}
+EXPORT_SYMBOL(blk_mq_stop_hw_queue);
+
+/*
+ * Stop all hardware queues and wait for any delayed run still in flight.
+ */
+void blk_mq_stop_hw_queues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		set_bit(BLK_MQ_S_STOPPED, &hctx->state);
+		cancel_delayed_work_sync(&hctx->delayed_work);
+	}
+}
+EXPORT_SYMBOL(blk_mq_stop_hw_queues);
+
+void blk_mq_start_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+	__blk_mq_run_hw_queue(hctx);
+}
+EXPORT_SYMBOL(blk_mq_start_hw_queue);
+
+/**
+ * blk_mq_start_stopped_hw_queues - restart hardware queues stopped on BUSY
+ * @q:		the queue
+ * @async:	run the restarted queues from kblockd
+ *
+ * Typically called from the driver's completion handler once room has
+ * been freed up, in which case @async must be set.
+ */
+void blk_mq_start_stopped_hw_queues(struct request_queue *q, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!test_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			continue;
+
+		clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+		blk_mq_run_hw_queue(hctx, async);
+	}
+}
+EXPORT_SYMBOL(blk_mq_start_stopped_hw_queues);
+
+static void blk_mq_work_fn(struct work_struct *work)
+{
+	struct blk_mq_hw_ctx *hctx;
+
+	hctx = container_of(work, struct blk_mq_hw_ctx, delayed_work.work);
+	__blk_mq_run_hw_queue(hctx);
+}
+
+/*
+ * Flush and FUA handling.  Without an elevator there is nowhere to park
+ * the individual steps of a flush sequence, so data bios that need a
+ * preflush or an emulated FUA are queued to q->mq_flush_work, which
+ * issues preflush, data and postflush one after the other and waits for
+ * each step.  Empty flushes and natively supported FUA writes go down
+ * the normal path.
+ */
+static void blk_mq_flush_end_io(struct request *rq, int error)
+{
+	struct completion *waiting = rq->end_io_data;
+
+	rq->errors = error;
+	complete(waiting);
+}
+
+static int blk_mq_exec_sync(struct request *rq)
+{
+	DECLARE_COMPLETION_ONSTACK(wait);
+	int err;
+
+	rq->end_io = blk_mq_flush_end_io;
+	rq->end_io_data = &wait;
+	blk_mq_insert_request(rq->q, rq, false, true);
+	wait_for_completion(&wait);
+
+	err = rq->errors;
+	blk_mq_free_request(rq);
+	return err;
+}
+
+static int blk_mq_flush_step(struct request_queue *q, struct bio *bio,
+			     bool data)
+{
+	struct request *rq;
+
+	rq = blk_mq_alloc_request(q, data ? bio_data_dir(bio) : WRITE_FLUSH,
+				  GFP_NOIO);
+	if (!rq)
+		return -ENODEV;
+
+	/*
+	 * REQ_FLUSH_SEQ keeps the bio alive after the data step and skips
+	 * completion accounting, so the steps are not accounted at all.
+	 */
+	rq->cmd_flags &= ~REQ_IO_STAT;
+	rq->cmd_flags |= REQ_FLUSH_SEQ;
+
+	if (data) {
+		init_request_from_bio(rq, bio);
+		rq->cmd_flags &= ~REQ_FLUSH;
+		if (!(q->flush_flags & REQ_FUA))
+			rq->cmd_flags &= ~REQ_FUA;
+	} else {
+		rq->cmd_type = REQ_TYPE_FS;
+		rq->rq_disk = bio->bi_bdev->bd_disk;
+	}
+
+	return blk_mq_exec_sync(rq);
+}
+
+static void blk_mq_flush_work(struct work_struct *work)
+{
+	struct request_queue *q =
+		container_of(work, struct request_queue, mq_flush_work);
+	struct bio *bio;
+
+	while (1) {
+		bool postflush;
+		int err = 0;
+
+		spin_lock_irq(q->queue_lock);
+		bio = bio_list_pop(&q->mq_flush_list);
+		spin_unlock_irq(q->queue_lock);
+		if (!bio)
+			break;
+
+		postflush = (bio->bi_rw & REQ_FUA) &&
+			    !(q->flush_flags & REQ_FUA);
+
+		if (bio->bi_rw & REQ_FLUSH)
+			err = blk_mq_flush_step(q, bio, false);
+		if (!err)
+			err = blk_mq_flush_step(q, bio, true);
+		if (!err && postflush)
+			err = blk_mq_flush_step(q, bio, false);
+
+		bio_endio(bio, err);
+	}
+}
+
+/*
+ * Returns true if @bio was consumed by the flush machinery.
+ */
+static bool blk_mq_handle_flush(struct request_queue *q, struct bio *bio)
+{
+	if (!(q->flush_flags & REQ_FLUSH)) {
+		/* no volatile write cache, nothing to flush */
+		bio->bi_rw &= ~(REQ_FLUSH | REQ_FUA);
+		if (!bio->bi_size) {
+			bio_endio(bio, 0);
+			return true;
+		}
+		return false;
+	}
+
+	if (!bio->bi_size) {
+		bio->bi_rw &= ~REQ_FUA;
+		bio->bi_rw |= REQ_FLUSH;
+		return false;
+	}
+
+	if (!(bio->bi_rw & REQ_FLUSH) && (q->flush_flags & REQ_FUA))
+		return false;
+
+	spin_lock_irq(q->queue_lock);
+	bio_list_add(&q->mq_flush_list, bio);
+	spin_unlock_irq(q->queue_lock);
+	kblockd_schedule_work(q, &q->mq_flush_work);
+	return true;
+}
+
+static void blk_mq_make_request(struct request_queue *q, struct bio *bio)
+{
+	const int is_sync = rw_is_sync(bio->bi_rw);
+	unsigned int rw_flags = bio_data_dir(bio);
+	struct blk_mq_ctx *ctx;
+	struct blk_mq_hw_ctx *hctx;
+	struct request *rq;
+
+	blk_queue_bounce(q, &bio);
+
+	if (unlikely(blk_queue_dead(q))) {
+		bio_endio(bio, -ENODEV);
+		return;
+	}
+
+	if ((bio->bi_rw & (REQ_FLUSH | REQ_FUA)) &&
+	    blk_mq_handle_flush(q, bio))
+		return;
+
+	if (is_sync)
+		rw_flags |= REQ_SYNC;
+
+	ctx = blk_mq_get_ctx(q);
+	hctx = q->mq_ops->map_queue(q, ctx->cpu);
+	blk_mq_put_ctx(ctx);
+
+	trace_block_getrq(q, bio, bio_data_dir(bio));
+
+	/* may sleep waiting for a tag, ctx stays valid if we migrate */
+	rq = __blk_mq_alloc_request(hctx, GFP_NOIO);
+	blk_mq_rq_ctx_init(q, ctx, rq, rw_flags);
+
+	init_request_from_bio(rq, bio);
+	drive_stat_acct(rq, 1);
+
+	spin_lock(&ctx->lock);
+	__blk_mq_insert_request(hctx, rq, false);
+	spin_unlock(&ctx->lock);
+
+	blk_mq_run_hw_queue(hctx, false);
+}
+
+/**
+ * blk_mq_drain_queue - wait for all requests on a multi-queue device
+ * @q:	queue to drain
+ *
+ * Counterpart of blk_drain_queue(): keeps running the hardware queues
+ * until every tag has been released.
+ */
+void blk_mq_drain_queue(struct request_queue *q)
+{
+	while (true) {
+		struct blk_mq_hw_ctx *hctx;
+		bool drain = false;
+		int i;
+
+		flush_work(&q->mq_flush_work);
+
+		queue_for_each_hw_ctx(q, hctx, i) {
+			blk_mq_run_hw_queue(hctx, false);
+			drain |= blk_mq_tags_busy(hctx->tags);
+		}
+
+		if (!drain)
+			break;
+		msleep(10);
+	}
+}
+
+struct blk_mq_hw_ctx *blk_mq_alloc_single_hw_queue(struct blk_mq_reg *reg,
+						   unsigned int hctx_index)
+{
+	return kzalloc_node(sizeof(struct blk_mq_hw_ctx), GFP_KERNEL,
+			    reg->numa_node);
+}
+EXPORT_SYMBOL(blk_mq_alloc_single_hw_queue);
+
+void blk_mq_free_single_hw_queue(struct blk_mq_hw_ctx *hctx,
+				 unsigned int hctx_index)
+{
+	kfree(hctx);
+}
+EXPORT_SYMBOL(blk_mq_free_single_hw_queue);
+
+static void blk_mq_free_rq_map(struct blk_mq_hw_ctx *hctx)
+{
+	unsigned int i;
+
+	if (hctx->tags)
+		blk_mq_free_tags(hctx->tags);
+	if (hctx->rqs) {
+		for (i = 0; i < hctx->queue_depth; i++)
+			kfree(hctx->rqs[i]);
+		kfree(hctx->rqs);
+	}
+}
+
+/*
+ * Preallocate one request per tag.  Each is a separate allocation rather
+ * than a slice of one big array so that the driver data behind it (see
+ * blk_mq_rq_to_pdu()) is suitable for DMA.
+ */
+static int blk_mq_init_rq_map(struct blk_mq_hw_ctx *hctx,
+			      unsigned int cmd_size)
+{
+	unsigned int i;
+
+	hctx->rqs = kzalloc_node(hctx->queue_depth * sizeof(struct request *),
+				 GFP_KERNEL, hctx->numa_node);
+	if (!hctx->rqs)
+		return -ENOMEM;
+
+	for (i = 0; i < hctx->queue_depth; i++) {
+		hctx->rqs[i] = kzalloc_node(sizeof(struct request) + cmd_size,
+					    GFP_KERNEL, hctx->numa_node);
+		if (!hctx->rqs[i])
+			return -ENOMEM;
+	}
+
+	hctx->tags = blk_mq_init_tags(hctx->queue_depth, hctx->numa_node);
+	if (!hctx->tags)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static void blk_mq_exit_hw_queue(struct request_queue *q,
+				 struct blk_mq_hw_ctx *hctx, unsigned int i)
+{
+	blk_mq_free_rq_map(hctx);
+	kfree(hctx->ctxs);
+	kfree(hctx->ctx_map);
+}
+
+static int blk_mq_init_hw_queues(struct request_queue *q,
+				 struct blk_mq_reg *reg, void *driver_data)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i, j;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		int node = hctx->numa_node;
+
+		INIT_DELAYED_WORK(&hctx->delayed_work, blk_mq_work_fn);
+		spin_lock_init(&hctx->lock);
+		INIT_LIST_HEAD(&hctx->dispatch);
+		hctx->queue = q;
+		hctx->queue_num = i;
+		hctx->queue_depth = reg->queue_depth;
+
+		if (blk_mq_init_rq_map(hctx, reg->cmd_size))
+			break;
+
+		hctx->ctxs = kmalloc_node(nr_cpu_ids * sizeof(void *),
+					  GFP_KERNEL, node);
+		hctx->ctx_map = kzalloc_node(BITS_TO_LONGS(nr_cpu_ids) *
+					     sizeof(unsigned long),
+					     GFP_KERNEL, node);
+		if (!hctx->ctxs || !hctx->ctx_map)
+			break;
+		hctx->nr_ctx = 0;
+
+		if (reg->ops->init_hctx &&
+		    reg->ops->init_hctx(hctx, driver_data, i))
+			break;
+	}
+
+	if (i == q->nr_hw_queues)
+		return 0;
+
+	/*
+	 * Init failed at queue @i: undo the driver side of the queues
+	 * before it and our side of all queues up to and including it.
+	 */
+	queue_for_each_hw_ctx(q, hctx, j) {
+		if (j > i)
+			break;
+		if (j < i && reg->ops->exit_hctx)
+			reg->ops->exit_hctx(hctx, j);
+		blk_mq_exit_hw_queue(q, hctx, j);
+	}
+
+	return -ENOMEM;
+}
+
+static void blk_mq_init_cpu_queues(struct request_queue *q)
+{
+	unsigned int i;
+
+	for_each_possible_cpu(i) {
+		struct blk_mq_ctx *__ctx = per_cpu_ptr(q->queue_ctx, i);
+		struct blk_mq_hw_ctx *hctx;
+
+		memset(__ctx, 0, sizeof(*__ctx));
+		__ctx->cpu = i;
+		spin_lock_init(&__ctx->lock);
+		INIT_LIST_HEAD(&__ctx->rq_list);
+		__ctx->queue = q;
+
+		hctx = q->queue_hw_ctx[q->mq_map[i]];
+		if (hctx->numa_node == NUMA_NO_NODE)
+			hctx->numa_node = cpu_to_node(i);
+
+		__ctx->index_hw = hctx->nr_ctx;
+		hctx->ctxs[hctx->nr_ctx++] = __ctx;
+	}
+}
+
+/**
+ * blk_mq_init_queue - create a multi-queue request queue
+ * @reg:	driver description: ops, number and depth of hardware queues
+ *		and the size of the per-request driver data
+ * @driver_data: passed to ->init_hctx()
+ *
+ * Returns the new queue or %NULL on failure.  The queue is torn down with
+ * blk_cleanup_queue() like any other.
+ */
+struct request_queue *blk_mq_init_queue(struct blk_mq_reg *reg,
+					void *driver_data)
+{
+	struct blk_mq_hw_ctx **hctxs;
+	struct blk_mq_ctx __percpu *ctx;
+	struct request_queue *q;
+	unsigned int *map;
+	int i;
+
+	if (!reg->nr_hw_queues ||
+	    !reg->ops->queue_rq || !reg->ops->map_queue ||
+	    !reg->ops->alloc_hctx || !reg->ops->free_hctx)
+		return NULL;
+
+	if (!reg->queue_depth)
+		reg->queue_depth = BLK_MQ_MAX_DEPTH;
+	else if (reg->queue_depth > BLK_MQ_MAX_DEPTH) {
+		pr_err("blk-mq: queuedepth too large (%u)\n", reg->queue_depth);
+		reg->queue_depth = BLK_MQ_MAX_DEPTH;
+	}
+
+	if (reg->nr_hw_queues > nr_cpu_ids)
+		reg->nr_hw_queues = nr_cpu_ids;
+
+	ctx = alloc_percpu(struct blk_mq_ctx);
+	if (!ctx)
+		return NULL;
+
+	hctxs = kzalloc_node(reg->nr_hw_queues * sizeof(*hctxs), GFP_KERNEL,
+			     reg->numa_node);
+	if (!hctxs)
+		goto err_percpu;
+
+	for (i = 0; i < reg->nr_hw_queues; i++) {
+		hctxs[i] = reg->ops->alloc_hctx(reg, i);
+		if (!hctxs[i])
+			goto err_hctxs;
+
+		hctxs[i]->numa_node = NUMA_NO_NODE;
+	}
+
+	map = blk_mq_make_queue_map(reg);
+	if (!map)
+		goto err_hctxs;
+
+	q = blk_alloc_queue_node(GFP_KERNEL, reg->numa_node);
+	if (!q)
+		goto err_map;
+
+	q->mq_map = map;
+	q->queue_ctx = ctx;
+	q->nr_queues = nr_cpu_ids;
+	q->queue_hw_ctx = hctxs;
+	q->nr_hw_queues = reg->nr_hw_queues;
+	q->queue_flags = QUEUE_FLAG_DEFAULT;
+
+	INIT_WORK(&q->mq_flush_work, blk_mq_flush_work);
+	bio_list_init(&q->mq_flush_list);
+
+	blk_queue_make_request(q, blk_mq_make_request);
+	q->sg_reserved_size = INT_MAX;
+
+	if (blk_mq_init_hw_queues(q, reg, driver_data))
+		goto err_queue;
+
+	blk_mq_init_cpu_queues(q);
+
+	/* mq_ops set last: an unfinished queue is torn down as a legacy one */
+	q->mq_ops = reg->ops;
+
+	mutex_lock(&all_q_mutex);
+	list_add_tail(&q->all_q_node_mq, &all_q_list);
+	mutex_unlock(&all_q_mutex);
+
+	/* all done, end the initial bypass */
+	blk_queue_bypass_end(q);
+	return q;
+
+err_queue:
+	q->queue_hw_ctx = NULL;
+	q->nr_hw_queues = 0;
+	blk_cleanup_queue(q);
+err_map:
+	kfree(map);
+err_hctxs:
+	for (i = 0; i < reg->nr_hw_queues; i++) {
+		if (!hctxs[i])
+			break;
+		reg->ops->free_hctx(hctxs[i], i);
+	}
+	kfree(hctxs);
+err_percpu:
+	free_percpu(ctx);
+	return NULL;
+}
+EXPORT_SYMBOL(blk_mq_init_queue);
+
+/*
+ * Called from blk_release_queue() once the last reference is gone.
+ */
+void blk_mq_free_queue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	mutex_lock(&all_q_mutex);
+	list_del_init(&q->all_q_node_mq);
+	mutex_unlock(&all_q_mutex);
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		cancel_delayed_work_sync(&hctx->delayed_work);
+		if (q->mq_ops->exit_hctx)
+			q->mq_ops->exit_hctx(hctx, i);
+		blk_mq_exit_hw_queue(q, hctx, i);
+		q->mq_ops->free_hctx(hctx, i);
+	}
+
+	kfree(q->queue_hw_ctx);
+	kfree(q->mq_map);
+	free_percpu(q->queue_ctx);
+
+	q->queue_hw_ctx = NULL;
+	q->mq_map = NULL;
+	q->queue_ctx = NULL;
+}
+
+/*
+ * A CPU went away: move whatever is still sitting on its software queues
+ * to the dispatch list of the matching hardware queue.  The requests keep
+ * their ctx, so their tags are still returned to the right map and their
+ * completion simply runs locally.
+ */
+static void blk_mq_hctx_cpu_dead(struct request_queue *q, unsigned int cpu)
+{
+	struct blk_mq_ctx *ctx = __blk_mq_get_ctx(q, cpu);
+	struct blk_mq_hw_ctx *hctx = q->mq_ops->map_queue(q, cpu);
+	LIST_HEAD(tmp);
+
+	spin_lock(&ctx->lock);
+	if (!list_empty(&ctx->rq_list)) {
+		list_splice_init(&ctx->rq_list, &tmp);
+		clear_bit(ctx->index_hw, hctx->ctx_map);
+	}
+	spin_unlock(&ctx->lock);
+
+	if (list_empty(&tmp))
+		return;
+
+	spin_lock(&hctx->lock);
+	list_splice_tail(&tmp, &hctx->dispatch);
+	spin_unlock(&hctx->lock);
+
+	blk_mq_run_hw_queue(hctx, true);
+}
+
+static int __cpuinit blk_mq_cpu_notify(struct notifier_block *self,
+				       unsigned long action, void *hcpu)
+{
+	struct request_queue *q;
+
+	if (action == CPU_DEAD || action == CPU_DEAD_FROZEN) {
+		unsigned int cpu = (unsigned long) hcpu;
+
+		mutex_lock(&all_q_mutex);
+		list_for_each_entry(q, &all_q_list, all_q_node_mq)
+			blk_mq_hctx_cpu_dead(q, cpu);
+		mutex_unlock(&all_q_mutex);
+	}
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block __cpuinitdata blk_mq_cpu_notifier = {
+	.notifier_call	= blk_mq_cpu_notify,
+};
+
+static int __init blk_mq_init(void)
+{
+	register_hotcpu_notifier(&blk_mq_cpu_notifier);
+	return 0;
+}
+subsys_initcall(blk_mq_init);
@@ -0,0 +1,40 @@
+#ifndef INT_BLK_MQ_H
+#define INT_BLK_MQ_H
+
+struct blk_mq_reg;
+
+/*
+ * Per-CPU software submission queue.  Requests are staged here by the
+ * submitting CPU and pulled onto the mapped hardware queue at dispatch.
+ */
+struct blk_mq_ctx {
+	struct {
+		spinlock_t		lock;
+		struct list_head	rq_list;
+	}  ____cacheline_aligned_in_smp;
+
+	unsigned int		cpu;
+	unsigned int		index_hw;	/* bit in hctx->ctx_map */
+
+	struct request_queue	*queue;
+};
+
+void __blk_mq_end_io(struct request *rq, int error);
+void blk_mq_drain_queue(struct request_queue *q);
+void blk_mq_free_queue(struct request_queue *q);
+
+/*
+ * Tag allocation
+ */
+struct blk_mq_tags *blk_mq_init_tags(unsigned int nr_tags, int node);
+void blk_mq_free_tags(struct blk_mq_tags *tags);
+int blk_mq_get_tag(struct blk_mq_tags *tags, gfp_t gfp);
+void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag);
+bool blk_mq_tags_busy(struct blk_mq_tags *tags);
+
+/*
+ * CPU -> hardware queue mapping
+ */
+unsigned int *blk_mq_make_queue_map(struct blk_mq_reg *reg);
+
+#endif
@@ -99,6 +99,21 @@ void blk_queue_lld_busy(struct request_queue *q, lld_busy_fn *fn)
 }
 EXPORT_SYMBOL_GPL(blk_queue_lld_busy);
 
+/**
+ * blk_queue_poll - set the completion polling function of a queue
+ * @q:  queue
+ * @fn: reaps completions directly from the hardware, returns true if any
+ *
+ * Drivers that set this allow waiters to spin on the hardware completion
+ * queue instead of sleeping for an interrupt, once polling has been
+ * enabled through the io_poll queue attribute.
+ */
+void blk_queue_poll(struct request_queue *q, poll_q_fn *fn)
+{
+	q->poll_fn = fn;
+}
+EXPORT_SYMBOL_GPL(blk_queue_poll);
+
 /**
  * blk_set_default_limits - reset limits to default values
  * @lim:  the queue_limits structure to reset
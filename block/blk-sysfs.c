@@ -9,7 +9,10 @@
 #include <linux/blktrace_api.h>
 
 #include "blk.h"
+#include "blk-mq.h"
 #include "blk-cgroup.h"
+#include "blk-wbt.h"
+#include "blk-lat-hist.h"
 
 struct queue_sysfs_entry {
 	struct attribute attr;
@@ -280,6 +283,127 @@ queue_rq_affinity_store(struct request_queue *q, const char *page, size_t count)
 	return ret;
 }
 
+#ifdef CONFIG_BLK_WBT
+static ssize_t queue_wb_lat_show(struct request_queue *q, char *page)
+{
+	if (!q->rq_wb)
+		return -EINVAL;
+
+	return sprintf(page, "%llu\n",
+		       (unsigned long long)div_u64(q->rq_wb->min_lat_nsec,
+						   NSEC_PER_USEC));
+}
+
+static ssize_t queue_wb_lat_store(struct request_queue *q, const char *page,
+				  size_t count)
+{
+	unsigned long long val;
+
+	if (!q->rq_wb)
+		return -EINVAL;
+	if (kstrtoull(page, 10, &val))
+		return -EINVAL;
+
+	spin_lock_irq(q->queue_lock);
+	wbt_set_lat(q->rq_wb, val * NSEC_PER_USEC);
+	spin_unlock_irq(q->queue_lock);
+
+	return count;
+}
+#endif
+
+#ifdef CONFIG_BLK_LATENCY_HIST
+static ssize_t queue_lat_hist_show(struct request_queue *q, char *page)
+{
+	return blk_lat_hist_show(q, page);
+}
+
+static ssize_t queue_lat_hist_store(struct request_queue *q, const char *page,
+				    size_t count)
+{
+	unsigned long val;
+	ssize_t ret = queue_var_store(&val, page, count);
+
+	if (ret < 0)
+		return ret;
+	if (val)
+		return -EINVAL;
+
+	blk_lat_hist_reset(q);
+	return ret;
+}
+
+static ssize_t queue_lat_outlier_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(q->lat_outlier_usec, page);
+}
+
+static ssize_t queue_lat_outlier_store(struct request_queue *q,
+				       const char *page, size_t count)
+{
+	unsigned long val;
+	ssize_t ret = queue_var_store(&val, page, count);
+
+	if (ret < 0)
+		return ret;
+	if (val > UINT_MAX)
+		return -EINVAL;
+
+	q->lat_outlier_usec = val;
+	return ret;
+}
+#endif
+
+static ssize_t queue_poll_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(blk_queue_io_poll(q), page);
+}
+
+static ssize_t queue_poll_store(struct request_queue *q, const char *page,
+				size_t count)
+{
+	unsigned long poll_on;
+	ssize_t ret;
+
+	if (!q->poll_fn)
+		return -EINVAL;
+
+	ret = queue_var_store(&poll_on, page, count);
+
+	spin_lock_irq(q->queue_lock);
+	if (poll_on)
+		queue_flag_set(QUEUE_FLAG_POLL, q);
+	else
+		queue_flag_clear(QUEUE_FLAG_POLL, q);
+	spin_unlock_irq(q->queue_lock);
+
+	return ret;
+}
+
+static ssize_t queue_poll_delay_show(struct request_queue *q, char *page)
+{
+	return sprintf(page, "%d\n", q->poll_delay);
+}
+
+static ssize_t queue_poll_delay_store(struct request_queue *q,
+				      const char *page, size_t count)
+{
+	int val;
+
+	if (!q->poll_fn)
+		return -EINVAL;
+	if (kstrtoint(page, 10, &val) || val < -1)
+		return -EINVAL;
+
+	q->poll_delay = val;
+	return count;
+}
+
+static ssize_t queue_poll_nsec_show(struct request_queue *q, char *page)
+{
+	return sprintf(page, "%llu\n", (unsigned long long)q->poll_nsec);
+}
+
 static struct queue_sysfs_entry queue_requests_entry = {
 	.attr = {.name = "nr_requests", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_requests_show,
@@ -394,6 +518,45 @@ static struct queue_sysfs_entry queue_random_entry = {
 	.store = queue_store_random,
 };
 
+static struct queue_sysfs_entry queue_poll_entry = {
+	.attr = {.name = "io_poll", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_poll_show,
+	.store = queue_poll_store,
+};
+
+static struct queue_sysfs_entry queue_poll_delay_entry = {
+	.attr = {.name = "io_poll_delay", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_poll_delay_show,
+	.store = queue_poll_delay_store,
+};
+
+static struct queue_sysfs_entry queue_poll_nsec_entry = {
+	.attr = {.name = "io_poll_nsec", .mode = S_IRUGO },
+	.show = queue_poll_nsec_show,
+};
+
+#ifdef CONFIG_BLK_LATENCY_HIST
+static struct queue_sysfs_entry queue_lat_hist_entry = {
+	.attr = {.name = "io_lat_hist", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_lat_hist_show,
+	.store = queue_lat_hist_store,
+};
+
+static struct queue_sysfs_entry queue_lat_outlier_entry = {
+	.attr = {.name = "io_lat_outlier_usec", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_lat_outlier_show,
+	.store = queue_lat_outlier_store,
+};
+#endif
+
+#ifdef CONFIG_BLK_WBT
+static struct queue_sysfs_entry queue_wb_lat_entry = {
+	.attr = {.name = "wbt_lat_usec", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_wb_lat_show,
+	.store = queue_wb_lat_store,
+};
+#endif
+
 static struct attribute *default_attrs[] = {
 	&queue_requests_entry.attr,
 	&queue_ra_entry.attr,
@@ -416,6 +579,13 @@ static struct attribute *default_attrs[] = {
 	&queue_rq_affinity_entry.attr,
 	&queue_iostats_entry.attr,
 	&queue_random_entry.attr,
+	&queue_poll_entry.attr,
+	&queue_poll_delay_entry.attr,
+	&queue_poll_nsec_entry.attr,
+#ifdef CONFIG_BLK_LATENCY_HIST
+	&queue_lat_hist_entry.attr,
+	&queue_lat_outlier_entry.attr,
+#endif
 	NULL,
 };
 
@@ -496,6 +666,12 @@ static void blk_release_queue(struct kobject *kobj)
 
 	blk_exit_rl(&q->root_rl);
 
+	wbt_exit(q);
+	blk_lat_hist_exit(q);
+
+	if (q->mq_ops)
+		blk_mq_free_queue(q);
+
 	if (q->queue_tags)
 		__blk_queue_free_tags(q);
 
@@ -518,6 +694,23 @@ struct kobj_type blk_queue_ktype = {
 	.release	= blk_release_queue,
 };
 
+/*
+ * Only blk_queue_bio() throttles writeback, so queues whose bios bypass
+ * it get neither a throttle nor its sysfs knob.
+ */
+static void blk_register_wbt(struct request_queue *q)
+{
+#ifdef CONFIG_BLK_WBT
+	if (q->make_request_fn != blk_queue_bio)
+		return;
+
+	if (sysfs_create_file(&q->kobj, &queue_wb_lat_entry.attr))
+		return;
+	if (wbt_init(q))
+		sysfs_remove_file(&q->kobj, &queue_wb_lat_entry.attr);
+#endif
+}
+
 int blk_register_queue(struct gendisk *disk)
 {
 	int ret;
@@ -539,6 +732,9 @@ int blk_register_queue(struct gendisk *disk)
 
 	kobject_uevent(&q->kobj, KOBJ_ADD);
 
+	if (q->request_fn || q->mq_ops)
+		blk_lat_hist_init(q);
+
 	if (!q->request_fn)
 		return 0;
 
@@ -551,6 +747,7 @@ int blk_register_queue(struct gendisk *disk)
 		return ret;
 	}
 
+	blk_register_wbt(q);
 	return 0;
 }
 
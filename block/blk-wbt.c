@@ -0,0 +1,322 @@
+/*
+ * Writeback throttling
+ *
+ * Buffered writeback can fill a device queue with writes, and any read
+ * issued behind them has to wait for all of them.  On slow devices this
+ * turns into read latencies of seconds.
+ *
+ * The throttle limits how many background writes a queue may have in flight.
+ * It watches read completion latency over a monitoring window.  If even the
+ * fastest read in a window missed the target, the allowed write depth is
+ * halved.  Once reads meet the target, or stop coming, the depth is raised
+ * again step by step.
+ *
+ * Only writes that nobody is waiting for synchronously are throttled:
+ * background and periodic writeback and balance_dirty_pages().  O_DIRECT,
+ * fsync-driven writeback, flushes and discards pass straight through.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/blkdev.h>
+#include <linux/slab.h>
+#include <linux/swap.h>
+#include <linux/ktime.h>
+
+#include "blk.h"
+#include "blk-wbt.h"
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/wbt.h>
+
+enum {
+	/* depth allowed at scale step 0 */
+	RWB_DEF_DEPTH		= 16,
+
+	/* read latency targets in usecs */
+	RWB_DEF_LAT_NONROT	= 2000,
+	RWB_DEF_LAT_ROT		= 75000,
+
+	/* monitoring window in msecs */
+	RWB_WINDOW_MSECS	= 100,
+};
+
+/*
+ * Other I/O completed within this many jiffies counts as "active", and
+ * background writeback then only gets the smaller wb_background depth.
+ */
+#define RWB_RECENT_IO		(HZ / 10)
+
+static inline bool rwb_enabled(struct rq_wb *rwb)
+{
+	return rwb && rwb->min_lat_nsec;
+}
+
+static void calc_wb_limits(struct rq_wb *rwb)
+{
+	unsigned int depth = RWB_DEF_DEPTH;
+
+	if (rwb->scale_step > 0)
+		depth = 1 + ((depth - 1) >> min(31, rwb->scale_step));
+	else if (rwb->scale_step < 0)
+		depth <<= min(16, -rwb->scale_step);
+
+	rwb->wb_max = depth;
+	rwb->wb_normal = (depth + 1) / 2;
+	rwb->wb_background = (depth + 3) / 4;
+}
+
+/* never let writeback take more than 3/4 of the request pool */
+static unsigned int rwb_max_depth(struct rq_wb *rwb)
+{
+	return max(1UL, rwb->q->nr_requests * 3 / 4);
+}
+
+static void rwb_trace_step(struct rq_wb *rwb, const char *msg)
+{
+	trace_wbt_step(&rwb->q->backing_dev_info, msg, rwb->scale_step,
+		       rwb->wb_max, rwb->wb_normal, rwb->wb_background,
+		       rwb->inflight);
+}
+
+static void scale_up(struct rq_wb *rwb)
+{
+	if (rwb->wb_max * 2 > rwb_max_depth(rwb))
+		return;
+
+	rwb->scale_step--;
+	calc_wb_limits(rwb);
+	rwb_trace_step(rwb, "step up");
+	wake_up_all(&rwb->wait);
+}
+
+static void scale_down(struct rq_wb *rwb)
+{
+	if (rwb->wb_max == 1)
+		return;
+
+	rwb->scale_step++;
+	calc_wb_limits(rwb);
+	rwb_trace_step(rwb, "step down");
+}
+
+static void rwb_arm_timer(struct rq_wb *rwb)
+{
+	if (!timer_pending(&rwb->window_timer))
+		mod_timer(&rwb->window_timer,
+			  jiffies + nsecs_to_jiffies(rwb->win_nsec));
+}
+
+static void wb_timer_fn(unsigned long data)
+{
+	struct rq_wb *rwb = (struct rq_wb *)data;
+	struct request_queue *q = rwb->q;
+	unsigned long flags;
+
+	spin_lock_irqsave(q->queue_lock, flags);
+
+	if (!rwb_enabled(rwb) || blk_queue_dead(q))
+		goto out;
+
+	trace_wbt_lat(&q->backing_dev_info, rwb->lat_min, rwb->nr_reads,
+		      rwb->min_lat_nsec);
+
+	if (rwb->nr_reads) {
+		if (rwb->lat_min > rwb->min_lat_nsec)
+			scale_down(rwb);
+		else if (waitqueue_active(&rwb->wait))
+			scale_up(rwb);
+	} else if (rwb->scale_step > 0) {
+		/* nothing to protect, drift back to the default depth */
+		scale_up(rwb);
+	} else if (rwb->scale_step < 0 && !rwb->inflight) {
+		scale_down(rwb);
+	}
+
+	rwb->nr_reads = 0;
+	rwb->lat_min = 0;
+
+	if (rwb->inflight || rwb->scale_step)
+		rwb_arm_timer(rwb);
+out:
+	spin_unlock_irqrestore(q->queue_lock, flags);
+}
+
+static bool wbt_should_throttle(struct bio *bio)
+{
+	if (bio_data_dir(bio) != WRITE)
+		return false;
+	return !(bio->bi_rw & (REQ_SYNC | REQ_FLUSH | REQ_FUA | REQ_DISCARD));
+}
+
+static unsigned int get_limit(struct rq_wb *rwb)
+{
+	/* reclaim must make progress to free memory */
+	if (current_is_kswapd())
+		return rwb->wb_max;
+
+	if (time_before(jiffies, rwb->last_comp + RWB_RECENT_IO))
+		return rwb->wb_background;
+
+	return rwb->wb_normal;
+}
+
+/**
+ * wbt_wait - throttle a write before it gets a request
+ * @rwb:	throttling state of the queue, may be %NULL
+ * @bio:	bio about to be turned into a request
+ * @lock:	queue lock, held on entry and exit but dropped while sleeping
+ *
+ * Returns true if the write was counted against the depth limit, in which
+ * case the caller must pass that on to wbt_track() for the new request.
+ */
+bool wbt_wait(struct rq_wb *rwb, struct bio *bio, spinlock_t *lock)
+{
+	DEFINE_WAIT(wait);
+
+	if (!rwb_enabled(rwb) || !wbt_should_throttle(bio))
+		return false;
+
+	while (rwb->inflight >= get_limit(rwb)) {
+		prepare_to_wait_exclusive(&rwb->wait, &wait,
+					  TASK_UNINTERRUPTIBLE);
+		if (rwb->inflight < get_limit(rwb))
+			break;
+		spin_unlock_irq(lock);
+		io_schedule();
+		spin_lock_irq(lock);
+	}
+	finish_wait(&rwb->wait, &wait);
+
+	rwb->inflight++;
+	rwb_arm_timer(rwb);
+	return true;
+}
+
+/*
+ * Undo wbt_wait() if no request was allocated, otherwise mark the request
+ * so that its completion returns the slot.
+ */
+void wbt_track(struct rq_wb *rwb, struct request *rq, bool tracked)
+{
+	if (!tracked)
+		return;
+
+	if (rq)
+		rq->wbt_flags |= WBT_TRACKED;
+	else
+		wbt_done(rwb, NULL);
+}
+
+void wbt_issue(struct rq_wb *rwb, struct request *rq)
+{
+	if (!rwb_enabled(rwb) || rq->cmd_type != REQ_TYPE_FS ||
+	    rq_data_dir(rq) != READ)
+		return;
+
+	rq->wbt_flags |= WBT_READ;
+	rq->wbt_issue_ns = ktime_to_ns(ktime_get());
+}
+
+void wbt_requeue(struct rq_wb *rwb, struct request *rq)
+{
+	/* time spent before the requeue says nothing about the device */
+	rq->wbt_flags &= ~WBT_READ;
+}
+
+/**
+ * wbt_done - account a completed or freed request
+ * @rwb:	throttling state of the queue, may be %NULL
+ * @rq:		the request, or %NULL to return a slot taken by wbt_wait()
+ *
+ * Safe to call more than once for a request, only the first call counts.
+ */
+void wbt_done(struct rq_wb *rwb, struct request *rq)
+{
+	unsigned int flags = rq ? rq->wbt_flags : WBT_TRACKED;
+
+	if (!rwb)
+		return;
+
+	if (flags & WBT_TRACKED) {
+		rwb->inflight--;
+		if (waitqueue_active(&rwb->wait) &&
+		    (!rwb->inflight ||
+		     rwb->inflight + rwb->wb_background / 2 <= rwb->wb_normal))
+			wake_up_all(&rwb->wait);
+	} else if (rq && rq->cmd_type == REQ_TYPE_FS) {
+		rwb->last_comp = jiffies;
+	}
+
+	if (flags & WBT_READ) {
+		u64 lat = ktime_to_ns(ktime_get()) - rq->wbt_issue_ns;
+
+		if (!rwb->nr_reads || lat < rwb->lat_min)
+			rwb->lat_min = lat;
+		rwb->nr_reads++;
+	}
+
+	if (rq)
+		rq->wbt_flags = 0;
+}
+
+/**
+ * wbt_set_lat - change the read latency target of a queue
+ * @rwb:	throttling state of the queue
+ * @lat_nsec:	new target in nsecs, 0 disables throttling
+ *
+ * Called with the queue lock held.
+ */
+void wbt_set_lat(struct rq_wb *rwb, u64 lat_nsec)
+{
+	rwb->min_lat_nsec = lat_nsec;
+	rwb->scale_step = 0;
+	calc_wb_limits(rwb);
+	rwb_trace_step(rwb, "reset");
+	wake_up_all(&rwb->wait);
+}
+
+/**
+ * wbt_init - enable writeback throttling on a request based queue
+ * @q:		the queue
+ *
+ * The default latency target depends on whether the device is rotational,
+ * so this is called once the driver has set up the queue flags.
+ */
+int wbt_init(struct request_queue *q)
+{
+	struct rq_wb *rwb;
+	unsigned int lat_usec;
+
+	if (q->rq_wb)
+		return 0;
+
+	rwb = kzalloc_node(sizeof(*rwb), GFP_KERNEL, q->node);
+	if (!rwb)
+		return -ENOMEM;
+
+	rwb->q = q;
+	rwb->win_nsec = RWB_WINDOW_MSECS * NSEC_PER_MSEC;
+	init_waitqueue_head(&rwb->wait);
+	setup_timer(&rwb->window_timer, wb_timer_fn, (unsigned long)rwb);
+
+	lat_usec = blk_queue_nonrot(q) ? RWB_DEF_LAT_NONROT : RWB_DEF_LAT_ROT;
+	rwb->min_lat_nsec = (u64)lat_usec * NSEC_PER_USEC;
+	calc_wb_limits(rwb);
+
+	spin_lock_irq(q->queue_lock);
+	q->rq_wb = rwb;
+	spin_unlock_irq(q->queue_lock);
+	return 0;
+}
+
+void wbt_exit(struct request_queue *q)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (!rwb)
+		return;
+
+	del_timer_sync(&rwb->window_timer);
+	q->rq_wb = NULL;
+	kfree(rwb);
+}
@@ -0,0 +1,87 @@
+#ifndef BLK_WBT_H
+#define BLK_WBT_H
+
+#include <linux/wait.h>
+#include <linux/timer.h>
+
+/* rq->wbt_flags */
+enum {
+	WBT_TRACKED	= 1,	/* counted in rq_wb->inflight */
+	WBT_READ	= 2,	/* read whose latency is being sampled */
+};
+
+/*
+ * Writeback throttling state of a request queue.  Everything is protected
+ * by the queue lock.
+ */
+struct rq_wb {
+	/*
+	 * Allowed writeback depth at the current scale step, for
+	 * background writeback while other I/O is active, for
+	 * regular writeback, and for reclaim.
+	 */
+	unsigned int		wb_background;
+	unsigned int		wb_normal;
+	unsigned int		wb_max;
+
+	int			scale_step;	/* > 0 throttles harder */
+	unsigned int		inflight;	/* tracked writes in flight */
+
+	u64			min_lat_nsec;	/* read latency target, 0=off */
+	u64			win_nsec;	/* monitoring window */
+	unsigned long		last_comp;	/* last unthrottled completion */
+
+	/* read latency seen in the current window */
+	unsigned int		nr_reads;
+	u64			lat_min;
+
+	struct timer_list	window_timer;
+	wait_queue_head_t	wait;
+	struct request_queue	*q;
+};
+
+#ifdef CONFIG_BLK_WBT
+
+int wbt_init(struct request_queue *q);
+void wbt_exit(struct request_queue *q);
+bool wbt_wait(struct rq_wb *rwb, struct bio *bio, spinlock_t *lock);
+void wbt_track(struct rq_wb *rwb, struct request *rq, bool tracked);
+void wbt_issue(struct rq_wb *rwb, struct request *rq);
+void wbt_requeue(struct rq_wb *rwb, struct request *rq);
+void wbt_done(struct rq_wb *rwb, struct request *rq);
+void wbt_set_lat(struct rq_wb *rwb, u64 lat_nsec);
+
+#else
+
+static inline int wbt_init(struct request_queue *q)
+{
+	return -EINVAL;
+}
+static inline void wbt_exit(struct request_queue *q)
+{
+}
+static inline bool wbt_wait(struct rq_wb *rwb, struct bio *bio,
+			    spinlock_t *lock)
+{
+	return false;
+}
+static inline void wbt_track(struct rq_wb *rwb, struct request *rq,
+			     bool tracked)
+{
+}
+static inline void wbt_issue(struct rq_wb *rwb, struct request *rq)
+{
+}
+static inline void wbt_requeue(struct rq_wb *rwb, struct request *rq)
+{
+}
+static inline void wbt_done(struct rq_wb *rwb, struct request *rq)
+{
+}
+static inline void wbt_set_lat(struct rq_wb *rwb, u64 lat_nsec)
+{
+}
+
+#endif /* CONFIG_BLK_WBT */
+
+#endif
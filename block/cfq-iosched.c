@@ -16,6 +16,7 @@
 #include <linux/blktrace_api.h>
 #include "blk.h"
 #include "blk-cgroup.h"
+#include "blk-lat-hist.h"
 
 /*
  * tunables
@@ -189,6 +190,10 @@ struct cfqg_stats {
 	struct blkg_stat		sectors;
 	/* total disk time and nr sectors dispatched by this group */
 	struct blkg_stat		time;
+#ifdef CONFIG_BLK_LATENCY_HIST
+	/* completion latencies, updated under the queue lock */
+	struct blk_lat_hist		lat_hist;
+#endif
 #ifdef CONFIG_DEBUG_BLK_CGROUP
 	/* time not charged to this cgroup */
 	struct blkg_stat		unaccounted_time;
@@ -644,6 +649,11 @@ static inline void cfqg_stats_update_completion(struct cfq_group *cfqg,
 	if (time_after64(io_start_time, start_time))
 		blkg_rwstat_add(&stats->wait_time, rw,
 				io_start_time - start_time);
+#ifdef CONFIG_BLK_LATENCY_HIST
+	if (time_after64(now, start_time))
+		stats->lat_hist.count[rw & REQ_WRITE ? WRITE : READ]
+			[blk_lat_hist_bucket(now - start_time)]++;
+#endif
 }
 
 static void cfq_pd_reset_stats(struct blkcg_gq *blkg)
@@ -658,6 +668,9 @@ static void cfq_pd_reset_stats(struct blkcg_gq *blkg)
 	blkg_rwstat_reset(&stats->service_time);
 	blkg_rwstat_reset(&stats->wait_time);
 	blkg_stat_reset(&stats->time);
+#ifdef CONFIG_BLK_LATENCY_HIST
+	memset(&stats->lat_hist, 0, sizeof(stats->lat_hist));
+#endif
 #ifdef CONFIG_DEBUG_BLK_CGROUP
 	blkg_stat_reset(&stats->unaccounted_time);
 	blkg_stat_reset(&stats->avg_queue_size_sum);
@@ -1474,6 +1487,24 @@ static int cfqg_print_rwstat(struct cgroup *cgrp, struct cftype *cft,
 	return 0;
 }
 
+#ifdef CONFIG_BLK_LATENCY_HIST
+static u64 cfqg_prfill_lat_hist(struct seq_file *sf,
+				struct blkg_policy_data *pd, int off)
+{
+	return __blkg_prfill_lat_hist(sf, pd, (void *)pd + off);
+}
+
+static int cfqg_print_lat_hist(struct cgroup *cgrp, struct cftype *cft,
+			       struct seq_file *sf)
+{
+	struct blkcg *blkcg = cgroup_to_blkcg(cgrp);
+
+	blkcg_print_blkgs(sf, blkcg, cfqg_prfill_lat_hist, &blkcg_policy_cfq,
+			  cft->private, false);
+	return 0;
+}
+#endif	/* CONFIG_BLK_LATENCY_HIST */
+
 #ifdef CONFIG_DEBUG_BLK_CGROUP
 static u64 cfqg_prfill_avg_queue_size(struct seq_file *sf,
 				      struct blkg_policy_data *pd, int off)
@@ -1554,6 +1585,13 @@ static struct cftype cfq_blkcg_files[] = {
 		.private = offsetof(struct cfq_group, stats.queued),
 		.read_seq_string = cfqg_print_rwstat,
 	},
+#ifdef CONFIG_BLK_LATENCY_HIST
+	{
+		.name = "io_latency_hist",
+		.private = offsetof(struct cfq_group, stats.lat_hist),
+		.read_seq_string = cfqg_print_lat_hist,
+	},
+#endif
 #ifdef CONFIG_DEBUG_BLK_CGROUP
 	{
 		.name = "avg_queue_size",
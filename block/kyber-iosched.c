@@ -0,0 +1,519 @@
+/*
+ * Kyber i/o scheduler, a latency target driven scheduler for fast devices.
+ *
+ * Requests are split into three domains, reads, synchronous writes and
+ * everything else, each kept in a plain fifo.  There is no sorting, no
+ * idling and no per-process state, so every scheduler operation is O(1)
+ * and the time spent under the queue lock stays short however many CPUs
+ * submit i/o.
+ *
+ * Each domain may only have a limited number of requests dispatched to the
+ * device at once (its tokens).  The completion latency of reads and sync
+ * writes is sampled over short windows; when too many of them miss their
+ * target the token depth of the less important domains is cut, and it is
+ * given back gradually once the targets are met again.
+ *
+ * See Documentation/block/kyber-iosched.txt
+ */
+#include <linux/kernel.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/ktime.h>
+#include <linux/timer.h>
+#include <linux/workqueue.h>
+
+enum {
+	KYBER_READ,
+	KYBER_SYNC_WRITE,
+	KYBER_OTHER,		/* async writes, discards */
+	KYBER_NUM_DOMAINS,
+};
+
+static const char *kyber_domain_names[KYBER_NUM_DOMAINS] = {
+	[KYBER_READ]		= "read",
+	[KYBER_SYNC_WRITE]	= "sync_write",
+	[KYBER_OTHER]		= "other",
+};
+
+/* default latency targets, in usecs */
+static const int read_lat_usec = 2000;
+static const int sync_write_lat_usec = 10000;
+
+/* maximum number of dispatched requests per domain */
+static const int kyber_depth[KYBER_NUM_DOMAINS] = {
+	[KYBER_READ]		= 64,
+	[KYBER_SYNC_WRITE]	= 32,
+	[KYBER_OTHER]		= 16,
+};
+
+/* requests dispatched from a domain before moving on to the next one */
+static const int kyber_batch[KYBER_NUM_DOMAINS] = {
+	[KYBER_READ]		= 16,
+	[KYBER_SYNC_WRITE]	= 8,
+	[KYBER_OTHER]		= 8,
+};
+
+/*
+ * Latencies are sampled into buckets of a quarter of the domain's target
+ * each, so the first KYBER_GOOD_BUCKETS hold the requests that met it.
+ */
+#define KYBER_LAT_BUCKETS	8
+#define KYBER_GOOD_BUCKETS	4
+
+/* length of a sampling window and the minimum sample needed to act on it */
+#define KYBER_WINDOW		(HZ / 10)
+#define KYBER_MIN_SAMPLES	8
+
+struct kyber_data {
+	struct request_queue *queue;
+
+	struct list_head fifo_list[KYBER_NUM_DOMAINS];
+
+	/* dispatched and not yet completed, and the current limit on that */
+	unsigned int inflight[KYBER_NUM_DOMAINS];
+	unsigned int cur_depth[KYBER_NUM_DOMAINS];
+
+	unsigned int cur_domain;
+	unsigned int batching;
+
+	/* a domain ran out of tokens with requests queued */
+	bool throttled;
+
+	unsigned int latency[KYBER_NUM_DOMAINS][KYBER_LAT_BUCKETS];
+
+	struct timer_list window_timer;
+	struct work_struct unplug_work;
+
+	/*
+	 * settings that change how the i/o scheduler behaves
+	 */
+	int lat_target[KYBER_NUM_DOMAINS];	/* usecs, 0 if none */
+	int depth[KYBER_NUM_DOMAINS];
+};
+
+/*
+ * rq->elv.priv[0] holds the domain + 1 of a dispatched request that owns a
+ * token, priv[1] the time in usecs the driver started it.
+ */
+#define RQ_DOMAIN(rq)		((unsigned long)(rq)->elv.priv[0])
+#define RQ_START(rq)		((unsigned long)(rq)->elv.priv[1])
+
+static unsigned int kyber_rq_domain(struct request *rq)
+{
+	if (rq_data_dir(rq) == READ)
+		return KYBER_READ;
+	if (rq_is_sync(rq))
+		return KYBER_SYNC_WRITE;
+	return KYBER_OTHER;
+}
+
+static void kyber_schedule_dispatch(struct kyber_data *kd)
+{
+	if (kd->queue->nr_sorted)
+		kblockd_schedule_work(kd->queue, &kd->unplug_work);
+}
+
+static void kyber_kick_queue(struct work_struct *work)
+{
+	struct kyber_data *kd =
+		container_of(work, struct kyber_data, unplug_work);
+	struct request_queue *q = kd->queue;
+
+	spin_lock_irq(q->queue_lock);
+	__blk_run_queue(q);
+	spin_unlock_irq(q->queue_lock);
+}
+
+/*
+ * Did more than a tenth of the requests sampled for @domain miss its target
+ * in the last window?  Returns -1 if there is too little data to say.
+ */
+static int kyber_domain_slow(struct kyber_data *kd, unsigned int domain)
+{
+	unsigned int total = 0, bad = 0;
+	int i;
+
+	for (i = 0; i < KYBER_LAT_BUCKETS; i++) {
+		total += kd->latency[domain][i];
+		if (i >= KYBER_GOOD_BUCKETS)
+			bad += kd->latency[domain][i];
+	}
+
+	if (total < KYBER_MIN_SAMPLES)
+		return -1;
+	return bad * 10 > total;
+}
+
+static void kyber_throttle(struct kyber_data *kd, unsigned int domain)
+{
+	kd->cur_depth[domain] = max(kd->cur_depth[domain] / 2, 1U);
+}
+
+static void kyber_unthrottle(struct kyber_data *kd, unsigned int domain)
+{
+	unsigned int max_depth = kd->depth[domain];
+
+	kd->cur_depth[domain] += max(max_depth / 4, 1U);
+	if (kd->cur_depth[domain] > max_depth)
+		kd->cur_depth[domain] = max_depth;
+}
+
+/*
+ * End of a sampling window.  Reads missing their target throttle both
+ * kinds of writes, sync writes missing theirs throttle async writes.
+ * Domains nobody complained about get some of their depth back.
+ */
+static void kyber_window_timer(unsigned long data)
+{
+	struct kyber_data *kd = (struct kyber_data *)data;
+	struct request_queue *q = kd->queue;
+	unsigned long flags;
+	bool slow[KYBER_NUM_DOMAINS] = { false, };
+	unsigned int domain;
+
+	spin_lock_irqsave(q->queue_lock, flags);
+
+	if (kyber_domain_slow(kd, KYBER_READ) > 0)
+		slow[KYBER_SYNC_WRITE] = slow[KYBER_OTHER] = true;
+	if (kyber_domain_slow(kd, KYBER_SYNC_WRITE) > 0)
+		slow[KYBER_OTHER] = true;
+
+	for (domain = 0; domain < KYBER_NUM_DOMAINS; domain++) {
+		if (slow[domain])
+			kyber_throttle(kd, domain);
+		else
+			kyber_unthrottle(kd, domain);
+	}
+
+	memset(kd->latency, 0, sizeof(kd->latency));
+
+	if (kd->throttled)
+		kyber_schedule_dispatch(kd);
+
+	spin_unlock_irqrestore(q->queue_lock, flags);
+}
+
+static void kyber_add_request(struct request_queue *q, struct request *rq)
+{
+	struct kyber_data *kd = q->elevator->elevator_data;
+
+	list_add_tail(&rq->queuelist, &kd->fifo_list[kyber_rq_domain(rq)]);
+}
+
+static void kyber_merged_requests(struct request_queue *q, struct request *rq,
+				  struct request *next)
+{
+	list_del_init(&next->queuelist);
+}
+
+/*
+ * Merging a sync bio into an async request would leave the request in the
+ * wrong domain.
+ */
+static int kyber_allow_merge(struct request_queue *q, struct request *rq,
+			     struct bio *bio)
+{
+	return rq_is_sync(rq) == rw_is_sync(bio->bi_rw);
+}
+
+static void kyber_move_to_dispatch(struct kyber_data *kd, struct request *rq,
+				   unsigned int domain)
+{
+	list_del_init(&rq->queuelist);
+	kd->inflight[domain]++;
+	rq->elv.priv[0] = (void *)(unsigned long)(domain + 1);
+	rq->elv.priv[1] = NULL;
+	elv_dispatch_add_tail(rq->q, rq);
+}
+
+/*
+ * Round robin over the domains, taking up to a batch of requests from each
+ * one that has requests and free tokens.  When forced, as while draining
+ * the queue, the tokens are ignored.
+ */
+static int kyber_dispatch_requests(struct request_queue *q, int force)
+{
+	struct kyber_data *kd = q->elevator->elevator_data;
+	unsigned int i, domain;
+	bool throttled = false;
+	struct request *rq;
+
+	for (i = 0; i < KYBER_NUM_DOMAINS; i++) {
+		domain = (kd->cur_domain + i) % KYBER_NUM_DOMAINS;
+
+		if (list_empty(&kd->fifo_list[domain]))
+			continue;
+		if (!force && kd->inflight[domain] >= kd->cur_depth[domain]) {
+			throttled = true;
+			continue;
+		}
+
+		if (domain != kd->cur_domain) {
+			kd->cur_domain = domain;
+			kd->batching = 0;
+		}
+
+		rq = list_entry(kd->fifo_list[domain].next, struct request,
+				queuelist);
+		kyber_move_to_dispatch(kd, rq, domain);
+
+		if (++kd->batching >= kyber_batch[domain]) {
+			kd->cur_domain = (domain + 1) % KYBER_NUM_DOMAINS;
+			kd->batching = 0;
+		}
+		kd->throttled = false;
+		return 1;
+	}
+
+	kd->throttled = throttled;
+	return 0;
+}
+
+static void kyber_activate_request(struct request_queue *q, struct request *rq)
+{
+	rq->elv.priv[1] = (void *)(unsigned long)ktime_to_us(ktime_get());
+}
+
+static void kyber_put_token(struct kyber_data *kd, struct request *rq)
+{
+	kd->inflight[RQ_DOMAIN(rq) - 1]--;
+	rq->elv.priv[0] = NULL;
+
+	/* a token came back, the driver won't ask again by itself */
+	if (kd->throttled)
+		kyber_schedule_dispatch(kd);
+}
+
+static void kyber_completed_request(struct request_queue *q,
+				    struct request *rq)
+{
+	struct kyber_data *kd = q->elevator->elevator_data;
+	unsigned int domain, bucket, i;
+	unsigned long lat;
+	bool arm = false;
+
+	if (!RQ_DOMAIN(rq))
+		return;
+
+	domain = RQ_DOMAIN(rq) - 1;
+	if (kd->lat_target[domain] && RQ_START(rq)) {
+		lat = (unsigned long)ktime_to_us(ktime_get()) - RQ_START(rq);
+		bucket = min_t(unsigned long,
+			       lat * KYBER_GOOD_BUCKETS / kd->lat_target[domain],
+			       KYBER_LAT_BUCKETS - 1);
+		kd->latency[domain][bucket]++;
+		arm = true;
+	}
+
+	/*
+	 * A throttled domain only gets its depth back when a window ends,
+	 * even if nothing completing has a latency target, as with async
+	 * writes alone.
+	 */
+	for (i = 0; !arm && i < KYBER_NUM_DOMAINS; i++)
+		arm = kd->cur_depth[i] < kd->depth[i];
+
+	if (arm && !timer_pending(&kd->window_timer))
+		mod_timer(&kd->window_timer, jiffies + KYBER_WINDOW);
+
+	kyber_put_token(kd, rq);
+}
+
+/*
+ * A request dispatched but never started, as when the driver kills it
+ * in prep, does not go through kyber_completed_request.
+ */
+static void kyber_put_request(struct request *rq)
+{
+	if (RQ_DOMAIN(rq))
+		kyber_put_token(rq->q->elevator->elevator_data, rq);
+}
+
+static void kyber_exit_queue(struct elevator_queue *e)
+{
+	struct kyber_data *kd = e->elevator_data;
+	unsigned int domain;
+
+	del_timer_sync(&kd->window_timer);
+	cancel_work_sync(&kd->unplug_work);
+
+	for (domain = 0; domain < KYBER_NUM_DOMAINS; domain++)
+		BUG_ON(!list_empty(&kd->fifo_list[domain]));
+
+	kfree(kd);
+}
+
+/*
+ * initialize elevator private data (kyber_data).
+ */
+static int kyber_init_queue(struct request_queue *q)
+{
+	struct kyber_data *kd;
+	unsigned int domain;
+
+	kd = kmalloc_node(sizeof(*kd), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!kd)
+		return -ENOMEM;
+
+	kd->queue = q;
+	for (domain = 0; domain < KYBER_NUM_DOMAINS; domain++) {
+		INIT_LIST_HEAD(&kd->fifo_list[domain]);
+		kd->depth[domain] = kyber_depth[domain];
+		kd->cur_depth[domain] = kyber_depth[domain];
+	}
+	kd->lat_target[KYBER_READ] = read_lat_usec;
+	kd->lat_target[KYBER_SYNC_WRITE] = sync_write_lat_usec;
+
+	setup_timer(&kd->window_timer, kyber_window_timer, (unsigned long)kd);
+	INIT_WORK(&kd->unplug_work, kyber_kick_queue);
+
+	q->elevator->elevator_data = kd;
+	return 0;
+}
+
+/*
+ * sysfs parts below
+ */
+static ssize_t
+kyber_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+kyber_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR)					\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct kyber_data *kd = e->elevator_data;			\
+	return kyber_var_show(__VAR, (page));				\
+}
+SHOW_FUNCTION(kyber_read_lat_usec_show, kd->lat_target[KYBER_READ]);
+SHOW_FUNCTION(kyber_sync_write_lat_usec_show, kd->lat_target[KYBER_SYNC_WRITE]);
+SHOW_FUNCTION(kyber_read_depth_show, kd->depth[KYBER_READ]);
+SHOW_FUNCTION(kyber_sync_write_depth_show, kd->depth[KYBER_SYNC_WRITE]);
+SHOW_FUNCTION(kyber_async_depth_show, kd->depth[KYBER_OTHER]);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX)				\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct kyber_data *kd = e->elevator_data;			\
+	int __data;							\
+	int ret = kyber_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	*(__PTR) = __data;						\
+	return ret;							\
+}
+STORE_FUNCTION(kyber_read_lat_usec_store, &kd->lat_target[KYBER_READ], 0, INT_MAX);
+STORE_FUNCTION(kyber_sync_write_lat_usec_store, &kd->lat_target[KYBER_SYNC_WRITE], 0, INT_MAX);
+#undef STORE_FUNCTION
+
+/*
+ * A new maximum depth applies at once, throttling or not.
+ */
+#define DEPTH_STORE_FUNCTION(__FUNC, __DOMAIN)				\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct kyber_data *kd = e->elevator_data;			\
+	struct request_queue *q = kd->queue;				\
+	int __data;							\
+	int ret = kyber_var_store(&__data, (page), count);		\
+	if (__data < 1)							\
+		__data = 1;						\
+	else if (__data > q->nr_requests)				\
+		__data = q->nr_requests;				\
+	spin_lock_irq(q->queue_lock);					\
+	kd->depth[__DOMAIN] = __data;					\
+	kd->cur_depth[__DOMAIN] = __data;				\
+	kyber_schedule_dispatch(kd);					\
+	spin_unlock_irq(q->queue_lock);					\
+	return ret;							\
+}
+DEPTH_STORE_FUNCTION(kyber_read_depth_store, KYBER_READ);
+DEPTH_STORE_FUNCTION(kyber_sync_write_depth_store, KYBER_SYNC_WRITE);
+DEPTH_STORE_FUNCTION(kyber_async_depth_store, KYBER_OTHER);
+#undef DEPTH_STORE_FUNCTION
+
+/*
+ * Current token usage, one line per domain: name, requests dispatched,
+ * current depth and maximum depth.
+ */
+static ssize_t kyber_tokens_show(struct elevator_queue *e, char *page)
+{
+	struct kyber_data *kd = e->elevator_data;
+	struct request_queue *q = kd->queue;
+	unsigned int domain;
+	ssize_t len = 0;
+
+	spin_lock_irq(q->queue_lock);
+	for (domain = 0; domain < KYBER_NUM_DOMAINS; domain++)
+		len += sprintf(page + len, "%s %u %u %d\n",
+			       kyber_domain_names[domain],
+			       kd->inflight[domain], kd->cur_depth[domain],
+			       kd->depth[domain]);
+	spin_unlock_irq(q->queue_lock);
+
+	return len;
+}
+
+#define KD_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, kyber_##name##_show, \
+				      kyber_##name##_store)
+
+static struct elv_fs_entry kyber_attrs[] = {
+	KD_ATTR(read_lat_usec),
+	KD_ATTR(sync_write_lat_usec),
+	KD_ATTR(read_depth),
+	KD_ATTR(sync_write_depth),
+	KD_ATTR(async_depth),
+	__ATTR(tokens, S_IRUGO, kyber_tokens_show, NULL),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_kyber = {
+	.ops = {
+		.elevator_allow_merge_fn =	kyber_allow_merge,
+		.elevator_merge_req_fn =	kyber_merged_requests,
+		.elevator_dispatch_fn =		kyber_dispatch_requests,
+		.elevator_add_req_fn =		kyber_add_request,
+		.elevator_activate_req_fn =	kyber_activate_request,
+		.elevator_completed_req_fn =	kyber_completed_request,
+		.elevator_put_req_fn =		kyber_put_request,
+		.elevator_init_fn =		kyber_init_queue,
+		.elevator_exit_fn =		kyber_exit_queue,
+	},
+	.elevator_attrs = kyber_attrs,
+	.elevator_name = "kyber",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init kyber_init(void)
+{
+	return elv_register(&iosched_kyber);
+}
+
+static void __exit kyber_exit(void)
+{
+	elv_unregister(&iosched_kyber);
+}
+
+module_init(kyber_init);
+module_exit(kyber_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Kyber IO scheduler");
@@ -513,6 +513,13 @@ int __init_or_module platform_driver_probe(struct platform_driver *drv,
 {
 	int retval, code;
 
+	/*
+	 * Because the probe routine may live in an __init section, it has
+	 * to run before platform_driver_probe() returns, not later from
+	 * the async thread pool.
+	 */
+	drv->driver.probe_type = PROBE_FORCE_SYNCHRONOUS;
+
 	/* make sure driver won't have bind/unbind attributes */
 	drv->driver.suppress_bind_attrs = true;
 
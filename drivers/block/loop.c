@@ -76,6 +76,9 @@
 #include <linux/sysfs.h>
 #include <linux/miscdevice.h>
 #include <linux/falloc.h>
+#include <linux/kref.h>
+#include <linux/mempool.h>
+#include <linux/fiemap.h>
 
 #include <asm/uaccess.h>
 
@@ -85,6 +88,9 @@ static DEFINE_MUTEX(loop_index_mutex);
 static int max_part;
 static int part_shift;
 
+static struct bio_set *loop_bio_set;
+static mempool_t *loop_io_pool;
+
 /*
  * Transfer functions
  */
@@ -458,6 +464,538 @@ out:
 	return ret;
 }
 
+/*
+ * Direct mode
+ *
+ * The blocks of the backing file are looked up once with bmap(), the way
+ * swapon does it, and bios are then remapped straight onto the device
+ * holding the file.  Data never goes through the page cache of the backing
+ * file, is not copied, and the I/O is as asynchronous as the device under
+ * it; the loop thread is not involved.
+ *
+ * This needs a fully allocated and written file: holes are refused, and
+ * so are preallocated (unwritten) extents, which bmap() maps like written
+ * ones although writes going around the filesystem would never convert
+ * them.  Like a swap file it is marked S_SWAPFILE so that it cannot be
+ * truncated or have its blocks moved while the mapping is in use.  The
+ * backing file must not be written through the filesystem while the loop
+ * device is in direct mode.
+ */
+struct loop_extent {
+	sector_t		start;		/* first sector on the loop device */
+	sector_t		nr_sects;
+	sector_t		disk_start;	/* first sector on map->bdev */
+};
+
+struct loop_dio_map {
+	struct kref		kref;
+	struct block_device	*bdev;
+	unsigned int		nr_extents;
+	struct loop_extent	*extents;
+	atomic_t		inflight;	/* bios remapped through us */
+	wait_queue_head_t	wait;		/* for inflight to drop to 0 */
+};
+
+/*
+ * A bio remapped in direct mode.  It is either sent on with its completion
+ * hooked, or, when it crosses extents, completed once all its pieces are.
+ */
+struct loop_dio_io {
+	struct loop_dio_map	*map;
+	struct bio		*parent;
+	bio_end_io_t		*end_io;
+	void			*private;
+	atomic_t		remaining;
+	int			error;
+};
+
+static void loop_free_dio_map(struct kref *kref)
+{
+	struct loop_dio_map *map = container_of(kref, struct loop_dio_map, kref);
+
+	kfree(map->extents);
+	kfree(map);
+}
+
+static int loop_add_extent(struct loop_dio_map *map, unsigned int *max,
+			   sector_t start, sector_t nr_sects, sector_t disk_start)
+{
+	struct loop_extent *ext;
+
+	if (map->nr_extents) {
+		ext = &map->extents[map->nr_extents - 1];
+		if (ext->start + ext->nr_sects == start &&
+		    ext->disk_start + ext->nr_sects == disk_start) {
+			ext->nr_sects += nr_sects;
+			return 0;
+		}
+	}
+
+	if (map->nr_extents == *max) {
+		*max = *max ? *max * 2 : 16;
+		ext = krealloc(map->extents, *max * sizeof(*ext), GFP_KERNEL);
+		if (!ext)
+			return -ENOMEM;
+		map->extents = ext;
+	}
+
+	ext = &map->extents[map->nr_extents++];
+	ext->start = start;
+	ext->nr_sects = nr_sects;
+	ext->disk_start = disk_start;
+	return 0;
+}
+
+#define LOOP_FIEMAP_EXTENTS	32
+
+/*
+ * Extents whose blocks can't simply be written in place: they don't hold
+ * the file's data yet (unwritten extents read back as zeroes through the
+ * filesystem whatever we write to them), are shared with other files or
+ * the filesystem's metadata, or hold the data in another form.
+ */
+#define LOOP_DIO_BAD_EXTENT	(FIEMAP_EXTENT_UNKNOWN |		\
+				 FIEMAP_EXTENT_DELALLOC |		\
+				 FIEMAP_EXTENT_ENCODED |		\
+				 FIEMAP_EXTENT_DATA_ENCRYPTED |		\
+				 FIEMAP_EXTENT_NOT_ALIGNED |		\
+				 FIEMAP_EXTENT_DATA_INLINE |		\
+				 FIEMAP_EXTENT_DATA_TAIL |		\
+				 FIEMAP_EXTENT_UNWRITTEN |		\
+				 FIEMAP_EXTENT_SHARED)
+
+/*
+ * Refuse backing files with extents that bmap() maps but that we can't
+ * write to directly, see LOOP_DIO_BAD_EXTENT.  Filesystems without
+ * ->fiemap have no such extents.
+ */
+static int loop_check_extents(struct inode *inode, loff_t start, loff_t len)
+{
+	struct fiemap_extent_info fieinfo = { 0, };
+	struct fiemap_extent *extents, *fe;
+	mm_segment_t old_fs;
+	unsigned int i;
+	int err = 0;
+
+	if (!inode->i_op->fiemap)
+		return 0;
+
+	extents = kmalloc(LOOP_FIEMAP_EXTENTS * sizeof(*extents), GFP_KERNEL);
+	if (!extents)
+		return -ENOMEM;
+
+	/* ->fiemap() copies the extents out as if to userspace */
+	old_fs = get_fs();
+	set_fs(KERNEL_DS);
+	while (len > 0) {
+		fieinfo.fi_extents_mapped = 0;
+		fieinfo.fi_extents_max = LOOP_FIEMAP_EXTENTS;
+		fieinfo.fi_extents_start =
+			(struct fiemap_extent __user *)extents;
+		err = inode->i_op->fiemap(inode, &fieinfo, start, len);
+		/* nothing mapped: only holes are left, bmap() refuses those */
+		if (err || !fieinfo.fi_extents_mapped)
+			break;
+
+		for (i = 0; i < fieinfo.fi_extents_mapped; i++) {
+			fe = &extents[i];
+			if (fe->fe_flags & LOOP_DIO_BAD_EXTENT) {
+				err = -EINVAL;
+				goto out;
+			}
+		}
+
+		fe = &extents[fieinfo.fi_extents_mapped - 1];
+		if ((fe->fe_flags & FIEMAP_EXTENT_LAST) ||
+		    fe->fe_logical + fe->fe_length <= start)
+			break;
+		len -= fe->fe_logical + fe->fe_length - start;
+		start = fe->fe_logical + fe->fe_length;
+		cond_resched();
+	}
+out:
+	set_fs(old_fs);
+	kfree(extents);
+	return err;
+}
+
+static struct loop_dio_map *loop_build_dio_map(struct loop_device *lo)
+{
+	struct file *file = lo->lo_backing_file;
+	struct inode *inode = file->f_mapping->host;
+	sector_t size = get_capacity(lo->lo_disk);
+	struct loop_dio_map *map;
+	unsigned int max = 0;
+	int err;
+
+	map = kzalloc(sizeof(*map), GFP_KERNEL);
+	if (!map)
+		return ERR_PTR(-ENOMEM);
+	kref_init(&map->kref);
+	atomic_set(&map->inflight, 0);
+	init_waitqueue_head(&map->wait);
+
+	if (S_ISBLK(inode->i_mode)) {
+		err = -EINVAL;
+		if (lo->lo_offset & 511)
+			goto out_free;
+
+		map->bdev = I_BDEV(inode);
+		err = loop_add_extent(map, &max, 0, size, lo->lo_offset >> 9);
+		if (err)
+			goto out_free;
+	} else {
+		unsigned int blkbits = inode->i_blkbits;
+		unsigned int sect_shift = blkbits - 9;
+		sector_t first = lo->lo_offset >> blkbits;
+		sector_t nr_blocks = (size + (1 << sect_shift) - 1) >> sect_shift;
+		sector_t block, disk_block;
+
+		err = -EINVAL;
+		if (!file->f_mapping->a_ops->bmap || !inode->i_sb->s_bdev ||
+		    (lo->lo_offset & ((1 << blkbits) - 1)))
+			goto out_free;
+
+		err = loop_check_extents(inode, lo->lo_offset,
+					 (loff_t)nr_blocks << blkbits);
+		if (err)
+			goto out_free;
+
+		map->bdev = inode->i_sb->s_bdev;
+		for (block = 0; block < nr_blocks; block++) {
+			disk_block = bmap(inode, first + block);
+			if (!disk_block) {
+				/* holes can't be mapped */
+				err = -EINVAL;
+				goto out_free;
+			}
+			err = loop_add_extent(map, &max, block << sect_shift,
+					      1 << sect_shift,
+					      disk_block << sect_shift);
+			if (err)
+				goto out_free;
+			cond_resched();
+		}
+	}
+
+	return map;
+
+out_free:
+	loop_free_dio_map(&map->kref);
+	return ERR_PTR(err);
+}
+
+static struct loop_extent *loop_find_extent(struct loop_dio_map *map,
+					    sector_t sector)
+{
+	unsigned int lo = 0, hi = map->nr_extents;
+
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+		struct loop_extent *ext = &map->extents[mid];
+
+		if (sector < ext->start)
+			hi = mid;
+		else if (sector >= ext->start + ext->nr_sects)
+			lo = mid + 1;
+		else
+			return ext;
+	}
+	return NULL;
+}
+
+static void loop_bio_destructor(struct bio *bio)
+{
+	bio_free(bio, loop_bio_set);
+}
+
+/* a bio taken by loop_make_request() in direct mode has completed */
+static void loop_dio_done(struct loop_dio_map *map)
+{
+	if (atomic_dec_and_test(&map->inflight))
+		wake_up(&map->wait);
+	kref_put(&map->kref, loop_free_dio_map);
+}
+
+static struct loop_dio_io *loop_alloc_io(struct loop_dio_map *map,
+					 struct bio *bio)
+{
+	struct loop_dio_io *io = mempool_alloc(loop_io_pool, GFP_NOIO);
+
+	io->map = map;
+	io->parent = bio;
+	atomic_set(&io->remaining, 1);
+	io->error = 0;
+	return io;
+}
+
+static void loop_dio_endio(struct bio *bio, int error)
+{
+	struct loop_dio_io *io = bio->bi_private;
+	struct loop_dio_map *map = io->map;
+
+	bio->bi_end_io = io->end_io;
+	bio->bi_private = io->private;
+	mempool_free(io, loop_io_pool);
+
+	bio_endio(bio, error);
+	loop_dio_done(map);
+}
+
+static void loop_put_split(struct loop_dio_io *split)
+{
+	struct loop_dio_map *map = split->map;
+
+	if (atomic_dec_and_test(&split->remaining)) {
+		bio_endio(split->parent, split->error);
+		mempool_free(split, loop_io_pool);
+		loop_dio_done(map);
+	}
+}
+
+static void loop_split_endio(struct bio *bio, int error)
+{
+	struct loop_dio_io *split = bio->bi_private;
+
+	if (error)
+		split->error = error;
+	bio_put(bio);
+	loop_put_split(split);
+}
+
+/*
+ * Slow path for a bio that crosses extents: send one bio per extent, each
+ * carrying the part of the original's pages that falls into it.
+ */
+static void loop_dio_split(struct loop_dio_map *map, struct bio *bio)
+{
+	struct loop_dio_io *split = loop_alloc_io(map, bio);
+	struct loop_extent *ext = NULL;
+	struct bio *child = NULL;
+	sector_t sector = bio->bi_sector;
+	struct bio_vec *bvec;
+	int i;
+
+	bio_for_each_segment(bvec, bio, i) {
+		unsigned int off = 0;
+
+		if (unlikely(bvec->bv_len & 511)) {
+			split->error = -EIO;
+			break;
+		}
+
+		while (off < bvec->bv_len) {
+			unsigned int len = bvec->bv_len - off;
+			struct bio_vec *cv;
+
+			if (!child) {
+				ext = loop_find_extent(map, sector);
+				if (!ext) {
+					split->error = -EIO;
+					goto out;
+				}
+
+				child = bio_alloc_bioset(GFP_NOIO,
+							 bio->bi_vcnt - i,
+							 loop_bio_set);
+				child->bi_destructor = loop_bio_destructor;
+				child->bi_bdev = map->bdev;
+				child->bi_sector = ext->disk_start +
+						   (sector - ext->start);
+				child->bi_rw = bio->bi_rw;
+				child->bi_end_io = loop_split_endio;
+				child->bi_private = split;
+			}
+
+			if (len >> 9 > ext->start + ext->nr_sects - sector)
+				len = (ext->start + ext->nr_sects - sector) << 9;
+
+			cv = &child->bi_io_vec[child->bi_vcnt++];
+			cv->bv_page = bvec->bv_page;
+			cv->bv_offset = bvec->bv_offset + off;
+			cv->bv_len = len;
+			child->bi_size += len;
+
+			off += len;
+			sector += len >> 9;
+
+			if (sector == ext->start + ext->nr_sects) {
+				atomic_inc(&split->remaining);
+				generic_make_request(child);
+				child = NULL;
+			}
+		}
+	}
+
+out:
+	if (child) {
+		if (split->error) {
+			bio_put(child);
+		} else {
+			atomic_inc(&split->remaining);
+			generic_make_request(child);
+		}
+	}
+	loop_put_split(split);
+}
+
+/*
+ * Called with a reference to the map and map->inflight raised for the bio,
+ * both are dropped by loop_dio_done() once it has completed.
+ */
+static void loop_dio_submit(struct loop_dio_map *map, struct bio *bio)
+{
+	struct loop_extent *ext = NULL;
+	struct loop_dio_io *io;
+
+	if (unlikely(bio->bi_rw & REQ_DISCARD)) {
+		bio_endio(bio, -EOPNOTSUPP);
+		loop_dio_done(map);
+		return;
+	}
+
+	/* an empty flush only needs to reach the device */
+	if (bio->bi_size) {
+		ext = loop_find_extent(map, bio->bi_sector);
+		if (unlikely(!ext)) {
+			bio_io_error(bio);
+			loop_dio_done(map);
+			return;
+		}
+
+		if (bio->bi_sector + bio_sectors(bio) >
+		    ext->start + ext->nr_sects) {
+			loop_dio_split(map, bio);
+			return;
+		}
+	}
+
+	io = loop_alloc_io(map, bio);
+	io->end_io = bio->bi_end_io;
+	io->private = bio->bi_private;
+	bio->bi_end_io = loop_dio_endio;
+	bio->bi_private = io;
+
+	bio->bi_bdev = map->bdev;
+	if (ext)
+		bio->bi_sector = ext->disk_start +
+				 (bio->bi_sector - ext->start);
+	generic_make_request(bio);
+}
+
+/*
+ * Keep the block map of a regular backing file stable while we use it, as
+ * swapon does.
+ */
+static int loop_pin_file(struct file *file)
+{
+	struct inode *inode = file->f_mapping->host;
+	int err = 0;
+
+	if (!S_ISREG(inode->i_mode))
+		return 0;
+
+	mutex_lock(&inode->i_mutex);
+	if (IS_SWAPFILE(inode))
+		err = -EBUSY;
+	else
+		inode->i_flags |= S_SWAPFILE;
+	mutex_unlock(&inode->i_mutex);
+	return err;
+}
+
+static void loop_unpin_file(struct file *file)
+{
+	struct inode *inode = file->f_mapping->host;
+
+	if (!S_ISREG(inode->i_mode))
+		return;
+
+	mutex_lock(&inode->i_mutex);
+	inode->i_flags &= ~S_SWAPFILE;
+	mutex_unlock(&inode->i_mutex);
+}
+
+static void loop_config_discard(struct loop_device *lo);
+static int loop_flush(struct loop_device *lo);
+
+/*
+ * Switch direct mode on or off.  Turning it on while it is already on
+ * rebuilds the block map, after the offset or size changed.
+ */
+static int loop_set_dio(struct loop_device *lo, bool enable)
+{
+	struct file *file = lo->lo_backing_file;
+	struct loop_dio_map *map = NULL, *old;
+	int err;
+
+	/* loop_clr_fd turns it off once the device is in Lo_rundown */
+	if (lo->lo_state == Lo_unbound)
+		return -ENXIO;
+
+	if (enable) {
+		if (lo->lo_encrypt_key_size || lo->transfer != transfer_none)
+			return -EINVAL;
+
+		if (!lo->lo_dio) {
+			err = loop_pin_file(file);
+			if (err)
+				return err;
+		}
+
+		/* whatever went through the page cache has to be on disk */
+		loop_flush(lo);
+		err = vfs_fsync(file, 0);
+		if (!err) {
+			map = loop_build_dio_map(lo);
+			if (IS_ERR(map))
+				err = PTR_ERR(map);
+		}
+		if (err) {
+			if (!lo->lo_dio)
+				loop_unpin_file(file);
+			return err;
+		}
+
+		if (!lo->lo_dio)
+			lo->lo_limits = lo->lo_queue->limits;
+		else
+			lo->lo_queue->limits = lo->lo_limits;
+		blk_queue_stack_limits(lo->lo_queue, bdev_get_queue(map->bdev));
+		/*
+		 * We can't honour the merge_bvec_fn of the device under us,
+		 * so stick to single page bios as dm does.
+		 */
+		if (bdev_get_queue(map->bdev)->merge_bvec_fn)
+			blk_queue_max_hw_sectors(lo->lo_queue, PAGE_SIZE >> 9);
+	}
+
+	spin_lock_irq(&lo->lo_lock);
+	old = lo->lo_dio;
+	lo->lo_dio = map;
+	spin_unlock_irq(&lo->lo_lock);
+
+	if (old) {
+		/* bios remapped with the old map must not outlive it */
+		wait_event(old->wait, !atomic_read(&old->inflight));
+		kref_put(&old->kref, loop_free_dio_map);
+	}
+	if (old && !enable) {
+		loop_unpin_file(file);
+		lo->lo_queue->limits = lo->lo_limits;
+	}
+
+	/* the page cache of the file is stale either way */
+	invalidate_inode_pages2(file->f_mapping);
+
+	if (enable)
+		lo->lo_flags |= LO_FLAGS_DIRECT_IO;
+	else
+		lo->lo_flags &= ~LO_FLAGS_DIRECT_IO;
+	loop_config_discard(lo);
+	return 0;
+}
+
 /*
  * Add bio to back of pending list
  */
@@ -477,6 +1015,7 @@ static struct bio *loop_get_bio(struct loop_device *lo)
 static void loop_make_request(struct request_queue *q, struct bio *old_bio)
 {
 	struct loop_device *lo = q->queuedata;
+	struct loop_dio_map *map;
 	int rw = bio_rw(old_bio);
 
 	if (rw == READA)
@@ -489,6 +1028,15 @@ static void loop_make_request(struct request_queue *q, struct bio *old_bio)
 		goto out;
 	if (unlikely(rw == WRITE && (lo->lo_flags & LO_FLAGS_READ_ONLY)))
 		goto out;
+	/* switch requests (no bdev) always go through the loop thread */
+	map = lo->lo_dio;
+	if (map && old_bio->bi_bdev) {
+		kref_get(&map->kref);
+		atomic_inc(&map->inflight);
+		spin_unlock_irq(&lo->lo_lock);
+		loop_dio_submit(map, old_bio);
+		return;
+	}
 	loop_add_bio(lo, old_bio);
 	wake_up(&lo->lo_event);
 	spin_unlock_irq(&lo->lo_lock);
@@ -636,6 +1184,10 @@ static int loop_change_fd(struct loop_device *lo, struct block_device *bdev,
 	if (!(lo->lo_flags & LO_FLAGS_READ_ONLY))
 		goto out;
 
+	/* and not in direct mode, the block map is the old file's */
+	if (lo->lo_flags & LO_FLAGS_DIRECT_IO)
+		goto out;
+
 	error = -EBADF;
 	file = fget(arg);
 	if (!file)
@@ -743,11 +1295,19 @@ static ssize_t loop_attr_partscan_show(struct loop_device *lo, char *buf)
 	return sprintf(buf, "%s\n", partscan ? "1" : "0");
 }
 
+static ssize_t loop_attr_dio_show(struct loop_device *lo, char *buf)
+{
+	int dio = (lo->lo_flags & LO_FLAGS_DIRECT_IO);
+
+	return sprintf(buf, "%s\n", dio ? "1" : "0");
+}
+
 LOOP_ATTR_RO(backing_file);
 LOOP_ATTR_RO(offset);
 LOOP_ATTR_RO(sizelimit);
 LOOP_ATTR_RO(autoclear);
 LOOP_ATTR_RO(partscan);
+LOOP_ATTR_RO(dio);
 
 static struct attribute *loop_attrs[] = {
 	&loop_attr_backing_file.attr,
@@ -755,6 +1315,7 @@ static struct attribute *loop_attrs[] = {
 	&loop_attr_sizelimit.attr,
 	&loop_attr_autoclear.attr,
 	&loop_attr_partscan.attr,
+	&loop_attr_dio.attr,
 	NULL,
 };
 
@@ -785,10 +1346,11 @@ static void loop_config_discard(struct loop_device *lo)
 	 * We use punch hole to reclaim the free space used by the
 	 * image a.k.a. discard. However we do support discard if
 	 * encryption is enabled, because it may give an attacker
-	 * useful information.
+	 * useful information.  Nor in direct mode, where punching a hole
+	 * would change the block map under us.
 	 */
 	if ((!file->f_op->fallocate) ||
-	    lo->lo_encrypt_key_size) {
+	    lo->lo_encrypt_key_size || (lo->lo_flags & LO_FLAGS_DIRECT_IO)) {
 		q->limits.discard_granularity = 0;
 		q->limits.discard_alignment = 0;
 		q->limits.max_discard_sectors = 0;
@@ -988,6 +1550,9 @@ static int loop_clr_fd(struct loop_device *lo)
 
 	kthread_stop(lo->lo_thread);
 
+	if (lo->lo_dio)
+		loop_set_dio(lo, false);
+
 	spin_lock_irq(&lo->lo_lock);
 	lo->lo_backing_file = NULL;
 	spin_unlock_irq(&lo->lo_lock);
@@ -1039,6 +1604,7 @@ loop_set_status(struct loop_device *lo, const struct loop_info64 *info)
 	int err;
 	struct loop_func_table *xfer;
 	uid_t uid = current_uid();
+	bool resized = false;
 
 	if (lo->lo_encrypt_key_size &&
 	    lo->lo_key_owner != uid &&
@@ -1049,6 +1615,20 @@ loop_set_status(struct loop_device *lo, const struct loop_info64 *info)
 	if ((unsigned int) info->lo_encrypt_key_size > LO_KEY_SIZE)
 		return -EINVAL;
 
+	/* direct mode bypasses the transfer functions */
+	if ((info->lo_flags & LO_FLAGS_DIRECT_IO) && info->lo_encrypt_type)
+		return -EINVAL;
+	/* and pins the backing file's blocks, as swapon does */
+	if ((info->lo_flags & LO_FLAGS_DIRECT_IO) &&
+	    !(lo->lo_flags & LO_FLAGS_DIRECT_IO) && !capable(CAP_SYS_ADMIN))
+		return -EPERM;
+	if ((lo->lo_flags & LO_FLAGS_DIRECT_IO) &&
+	    !(info->lo_flags & LO_FLAGS_DIRECT_IO)) {
+		err = loop_set_dio(lo, false);
+		if (err)
+			return err;
+	}
+
 	err = loop_release_xfer(lo);
 	if (err)
 		return err;
@@ -1072,6 +1652,7 @@ loop_set_status(struct loop_device *lo, const struct loop_info64 *info)
 	    lo->lo_sizelimit != info->lo_sizelimit) {
 		if (figure_loop_size(lo, info->lo_offset, info->lo_sizelimit))
 			return -EFBIG;
+		resized = true;
 	}
 	loop_config_discard(lo);
 
@@ -1105,6 +1686,10 @@ loop_set_status(struct loop_device *lo, const struct loop_info64 *info)
 		lo->lo_key_owner = uid;
 	}	
 
+	if ((info->lo_flags & LO_FLAGS_DIRECT_IO) &&
+	    (resized || !(lo->lo_flags & LO_FLAGS_DIRECT_IO)))
+		return loop_set_dio(lo, true);
+
 	return 0;
 }
 
@@ -1259,6 +1844,11 @@ static int loop_set_capacity(struct loop_device *lo, struct block_device *bdev)
 	err = figure_loop_size(lo, lo->lo_offset, lo->lo_sizelimit);
 	if (unlikely(err))
 		goto out;
+	if (lo->lo_flags & LO_FLAGS_DIRECT_IO) {
+		err = loop_set_dio(lo, true);
+		if (unlikely(err))
+			goto out;
+	}
 	sec = get_capacity(lo->lo_disk);
 	/* the width of sector_t may be narrow for bit-shift */
 	sz = sec;
@@ -1316,6 +1906,11 @@ static int lo_ioctl(struct block_device *bdev, fmode_t mode,
 		if ((mode & FMODE_WRITE) || capable(CAP_SYS_ADMIN))
 			err = loop_set_capacity(lo, bdev);
 		break;
+	case LOOP_SET_DIRECT_IO:
+		err = -EPERM;
+		if (capable(CAP_SYS_ADMIN))
+			err = loop_set_dio(lo, !!arg);
+		break;
 	default:
 		err = lo->ioctl ? lo->ioctl(lo, cmd, arg) : -EINVAL;
 	}
@@ -1470,6 +2065,7 @@ static int lo_compat_ioctl(struct block_device *bdev, fmode_t mode,
 		arg = (unsigned long) compat_ptr(arg);
 	case LOOP_SET_FD:
 	case LOOP_CHANGE_FD:
+	case LOOP_SET_DIRECT_IO:
 		err = lo_ioctl(bdev, mode, cmd, arg);
 		break;
 	default:
@@ -1816,9 +2412,19 @@ static int __init loop_init(void)
 	struct loop_device *lo;
 	int err;
 
+	loop_bio_set = bioset_create(BIO_POOL_SIZE, 0);
+	if (!loop_bio_set)
+		return -ENOMEM;
+	loop_io_pool = mempool_create_kmalloc_pool(BIO_POOL_SIZE,
+					sizeof(struct loop_dio_io));
+	if (!loop_io_pool) {
+		err = -ENOMEM;
+		goto out_bioset;
+	}
+
 	err = misc_register(&loop_misc);
 	if (err < 0)
-		return err;
+		goto out_pool;
 
 	part_shift = 0;
 	if (max_part > 0) {
@@ -1835,11 +2441,12 @@ static int __init loop_init(void)
 		max_part = (1UL << part_shift) - 1;
 	}
 
+	err = -EINVAL;
 	if ((1UL << part_shift) > DISK_MAX_PARTS)
-		return -EINVAL;
+		goto out_misc;
 
 	if (max_loop > 1UL << (MINORBITS - part_shift))
-		return -EINVAL;
+		goto out_misc;
 
 	/*
 	 * If max_loop is specified, create that many devices upfront.
@@ -1857,8 +2464,9 @@ static int __init loop_init(void)
 		range = 1UL << MINORBITS;
 	}
 
+	err = -EIO;
 	if (register_blkdev(LOOP_MAJOR, "loop"))
-		return -EIO;
+		goto out_misc;
 
 	blk_register_region(MKDEV(LOOP_MAJOR, 0), range,
 				  THIS_MODULE, loop_probe, NULL, NULL);
@@ -1871,6 +2479,14 @@ static int __init loop_init(void)
 
 	printk(KERN_INFO "loop: module loaded\n");
 	return 0;
+
+out_misc:
+	misc_deregister(&loop_misc);
+out_pool:
+	mempool_destroy(loop_io_pool);
+out_bioset:
+	bioset_free(loop_bio_set);
+	return err;
 }
 
 static int loop_exit_cb(int id, void *ptr, void *data)
@@ -1895,6 +2511,9 @@ static void __exit loop_exit(void)
 	unregister_blkdev(LOOP_MAJOR, "loop");
 
 	misc_deregister(&loop_misc);
+
+	mempool_destroy(loop_io_pool);
+	bioset_free(loop_bio_set);
 }
 
 module_init(loop_init);
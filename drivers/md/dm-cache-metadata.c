@@ -0,0 +1,581 @@
+/*
+ * This file is released under the GPL.
+ *
+ * Persistent metadata of the cache target.
+ *
+ * The metadata device holds a superblock followed by two copies of a
+ * flat array with one 64 bit entry per cache block, recording the origin
+ * block it caches and whether it is dirty.  The whole array is kept in
+ * core.  The superblock names the active copy; a commit writes the other
+ * one, flushes it and only then rewrites the superblock to point at it,
+ * so a crash in the middle of a commit leaves the previous copy intact.
+ * The superblock fields fit in its first sector, which the device writes
+ * atomically.  Each block carries a checksum so that corruption is
+ * detected when the cache is loaded.
+ *
+ * A commit only makes the metadata consistent with the data that has
+ * already reached the cache device; the target must flush that device
+ * first.  If the cache was not shut down cleanly the dirty bits may be
+ * stale, so every valid mapping is then treated as dirty.
+ *
+ * A table reload constructs the new target before the old one is
+ * suspended, so both instances share one in core copy per metadata
+ * device.  The new instance reads the mappings on its first resume, by
+ * which time the old one has committed its last changes.
+ */
+
+#include <linux/crc32c.h>
+#include <linux/mutex.h>
+#include <linux/vmalloc.h>
+#include <linux/slab.h>
+#include <linux/err.h>
+
+#include "dm-bufio.h"
+#include "dm-cache-metadata.h"
+
+#define DM_MSG_PREFIX "cache metadata"
+
+#define CACHE_SUPERBLOCK_MAGIC 0x0ca5e1a6
+#define CACHE_METADATA_VERSION 1
+#define SUPERBLOCK_LOCATION 0
+#define SUPERBLOCK_CSUM_XOR 0x2c4a6b1d
+#define MAPPING_CSUM_XOR 0x5a7e3c09
+
+/* superblock flags */
+#define CACHE_CLEAN_SHUTDOWN (1 << 0)
+
+/* mapping entry flags, stored below the origin block number */
+#define M_VALID (1ULL << 0)
+#define M_DIRTY (1ULL << 1)
+#define M_FLAGS_SHIFT 2
+
+struct cache_disk_superblock {
+	__le32 csum;	/* covers everything after this field */
+	__le32 flags;
+	__le64 blocknr;
+	__le64 magic;
+	__le32 version;
+	__le32 data_block_size;	/* in sectors */
+	__le32 cache_blocks;
+	__le32 active_copy;	/* mapping array copy in use, 0 or 1 */
+} __packed;
+
+struct cache_disk_mapping_header {
+	__le32 csum;
+	__le32 padding;
+	__le64 blocknr;
+} __packed;
+
+#define ENTRIES_PER_BLOCK ((DM_CACHE_METADATA_BLOCK_SIZE - \
+			    sizeof(struct cache_disk_mapping_header)) / \
+			   sizeof(__le64))
+
+struct dm_cache_metadata {
+	struct list_head list;
+	unsigned ref_count;
+
+	struct block_device *bdev;
+	struct dm_bufio_client *bufio;
+
+	sector_t data_block_size;
+	dm_cblock_t cache_blocks;
+	bool clean;
+
+	/* in core copy of the mapping array, one entry per cache block */
+	__le64 *mappings;
+	unsigned nr_mapping_blocks;
+
+	/*
+	 * The on disk copy the superblock points at, and per copy the
+	 * mapping blocks that differ from the in core array.
+	 */
+	unsigned active_copy;
+	unsigned long *dirty_blocks[2];
+	bool changed;
+
+	/* a superblock write failed, the active copy on disk is unknown */
+	bool failed;
+};
+
+static LIST_HEAD(_metadata_list);
+static DEFINE_MUTEX(_metadata_lock);
+
+static u32 calc_csum(const void *data, size_t len, u32 xor)
+{
+	return crc32c(~(u32) 0, data, len) ^ xor;
+}
+
+static u32 superblock_csum(struct cache_disk_superblock *disk_super)
+{
+	return calc_csum(&disk_super->flags,
+			 sizeof(*disk_super) - sizeof(disk_super->csum),
+			 SUPERBLOCK_CSUM_XOR);
+}
+
+static u32 mapping_block_csum(void *data)
+{
+	return calc_csum(data + sizeof(__le32),
+			 DM_CACHE_METADATA_BLOCK_SIZE - sizeof(__le32),
+			 MAPPING_CSUM_XOR);
+}
+
+static sector_t mapping_location(struct dm_cache_metadata *cmd,
+				 unsigned copy, unsigned index)
+{
+	return SUPERBLOCK_LOCATION + 1 + copy * cmd->nr_mapping_blocks + index;
+}
+
+/* Superblock plus both copies of the mapping array. */
+static sector_t metadata_blocks(struct dm_cache_metadata *cmd)
+{
+	return mapping_location(cmd, 2, 0);
+}
+
+/*----------------------------------------------------------------*/
+
+static int write_superblock(struct dm_cache_metadata *cmd, unsigned copy,
+			    bool clean)
+{
+	struct cache_disk_superblock *disk_super;
+	struct dm_buffer *b;
+
+	disk_super = dm_bufio_new(cmd->bufio, SUPERBLOCK_LOCATION, &b);
+	if (IS_ERR(disk_super))
+		return PTR_ERR(disk_super);
+
+	memset(disk_super, 0, DM_CACHE_METADATA_BLOCK_SIZE);
+	disk_super->flags = cpu_to_le32(clean ? CACHE_CLEAN_SHUTDOWN : 0);
+	disk_super->blocknr = cpu_to_le64(SUPERBLOCK_LOCATION);
+	disk_super->magic = cpu_to_le64(CACHE_SUPERBLOCK_MAGIC);
+	disk_super->version = cpu_to_le32(CACHE_METADATA_VERSION);
+	disk_super->data_block_size = cpu_to_le32(cmd->data_block_size);
+	disk_super->cache_blocks = cpu_to_le32(cmd->cache_blocks);
+	disk_super->active_copy = cpu_to_le32(copy);
+	disk_super->csum = cpu_to_le32(superblock_csum(disk_super));
+
+	dm_bufio_mark_buffer_dirty(b);
+	dm_bufio_release(b);
+
+	return 0;
+}
+
+static int write_mapping_block(struct dm_cache_metadata *cmd, unsigned copy,
+			       unsigned index)
+{
+	struct cache_disk_mapping_header *header;
+	struct dm_buffer *b;
+	unsigned first = index * ENTRIES_PER_BLOCK;
+	unsigned nr = min_t(unsigned, ENTRIES_PER_BLOCK,
+			    cmd->cache_blocks - first);
+
+	header = dm_bufio_new(cmd->bufio, mapping_location(cmd, copy, index), &b);
+	if (IS_ERR(header))
+		return PTR_ERR(header);
+
+	memset(header, 0, DM_CACHE_METADATA_BLOCK_SIZE);
+	header->blocknr = cpu_to_le64(mapping_location(cmd, copy, index));
+	memcpy(header + 1, cmd->mappings + first, nr * sizeof(__le64));
+	header->csum = cpu_to_le32(mapping_block_csum(header));
+
+	dm_bufio_mark_buffer_dirty(b);
+	dm_bufio_release(b);
+
+	return 0;
+}
+
+static int read_mapping_block(struct dm_cache_metadata *cmd, unsigned copy,
+			      unsigned index)
+{
+	struct cache_disk_mapping_header *header;
+	struct dm_buffer *b;
+	unsigned first = index * ENTRIES_PER_BLOCK;
+	unsigned nr = min_t(unsigned, ENTRIES_PER_BLOCK,
+			    cmd->cache_blocks - first);
+	int r = 0;
+
+	header = dm_bufio_read(cmd->bufio, mapping_location(cmd, copy, index), &b);
+	if (IS_ERR(header))
+		return PTR_ERR(header);
+
+	if (le64_to_cpu(header->blocknr) != mapping_location(cmd, copy, index) ||
+	    le32_to_cpu(header->csum) != mapping_block_csum(header)) {
+		DMERR("mapping block %u of copy %u is corrupt", index, copy);
+		r = -EILSEQ;
+	} else
+		memcpy(cmd->mappings + first, header + 1, nr * sizeof(__le64));
+
+	dm_bufio_release(b);
+
+	return r;
+}
+
+static int format_metadata(struct dm_cache_metadata *cmd)
+{
+	unsigned i;
+	int r;
+
+	for (i = 0; i < cmd->nr_mapping_blocks; i++) {
+		r = write_mapping_block(cmd, 0, i);
+		if (r)
+			return r;
+	}
+
+	r = dm_bufio_write_dirty_buffers(cmd->bufio);
+	if (r)
+		return r;
+
+	r = write_superblock(cmd, 0, true);
+	if (r)
+		return r;
+
+	r = dm_bufio_write_dirty_buffers(cmd->bufio);
+	if (r)
+		return r;
+
+	cmd->clean = true;
+	cmd->active_copy = 0;
+	bitmap_fill(cmd->dirty_blocks[1], cmd->nr_mapping_blocks);
+
+	return dm_bufio_issue_flush(cmd->bufio);
+}
+
+/*
+ * Returns 1 if there is valid metadata, 0 if the device needs formatting.
+ */
+static int read_superblock(struct dm_cache_metadata *cmd)
+{
+	struct cache_disk_superblock *disk_super;
+	struct dm_buffer *b;
+	int r = 1;
+
+	disk_super = dm_bufio_read(cmd->bufio, SUPERBLOCK_LOCATION, &b);
+	if (IS_ERR(disk_super))
+		return PTR_ERR(disk_super);
+
+	if (le64_to_cpu(disk_super->magic) != CACHE_SUPERBLOCK_MAGIC) {
+		r = 0;
+		goto out;
+	}
+
+	if (le32_to_cpu(disk_super->csum) != superblock_csum(disk_super)) {
+		DMERR("superblock checksum failed");
+		r = -EILSEQ;
+		goto out;
+	}
+
+	if (le32_to_cpu(disk_super->version) != CACHE_METADATA_VERSION) {
+		DMERR("unsupported metadata version %u",
+		      le32_to_cpu(disk_super->version));
+		r = -EINVAL;
+		goto out;
+	}
+
+	if (le32_to_cpu(disk_super->data_block_size) != cmd->data_block_size ||
+	    le32_to_cpu(disk_super->cache_blocks) != cmd->cache_blocks) {
+		DMERR("metadata was written for %u blocks of %u sectors",
+		      le32_to_cpu(disk_super->cache_blocks),
+		      le32_to_cpu(disk_super->data_block_size));
+		r = -EINVAL;
+		goto out;
+	}
+
+	if (le32_to_cpu(disk_super->active_copy) > 1) {
+		DMERR("invalid active mapping copy %u",
+		      le32_to_cpu(disk_super->active_copy));
+		r = -EINVAL;
+		goto out;
+	}
+
+	cmd->clean = le32_to_cpu(disk_super->flags) & CACHE_CLEAN_SHUTDOWN;
+	cmd->active_copy = le32_to_cpu(disk_super->active_copy);
+
+out:
+	dm_bufio_release(b);
+
+	return r;
+}
+
+static int open_metadata(struct dm_cache_metadata *cmd)
+{
+	unsigned i;
+	int r;
+
+	r = read_superblock(cmd);
+	if (r < 0)
+		return r;
+
+	if (!r)
+		return format_metadata(cmd);
+
+	for (i = 0; i < cmd->nr_mapping_blocks; i++) {
+		r = read_mapping_block(cmd, cmd->active_copy, i);
+		if (r)
+			return r;
+	}
+
+	/* the other copy may hold anything, a commit may have been cut short */
+	bitmap_fill(cmd->dirty_blocks[!cmd->active_copy],
+		    cmd->nr_mapping_blocks);
+
+	return 0;
+}
+
+static void metadata_destroy(struct dm_cache_metadata *cmd)
+{
+	if (cmd->bufio)
+		dm_bufio_client_destroy(cmd->bufio);
+	vfree(cmd->dirty_blocks[1]);
+	vfree(cmd->dirty_blocks[0]);
+	vfree(cmd->mappings);
+	kfree(cmd);
+}
+
+static struct dm_cache_metadata *metadata_create(struct block_device *bdev,
+						 sector_t data_block_size,
+						 dm_cblock_t cache_size)
+{
+	struct dm_cache_metadata *cmd;
+	unsigned i;
+	int r;
+
+	cmd = kzalloc(sizeof(*cmd), GFP_KERNEL);
+	if (!cmd)
+		return ERR_PTR(-ENOMEM);
+
+	cmd->ref_count = 1;
+	cmd->bdev = bdev;
+	cmd->data_block_size = data_block_size;
+	cmd->cache_blocks = cache_size;
+	cmd->nr_mapping_blocks = dm_div_up(cache_size, ENTRIES_PER_BLOCK);
+
+	r = -ENOMEM;
+	cmd->mappings = vzalloc(sizeof(*cmd->mappings) * cache_size);
+	if (!cmd->mappings)
+		goto bad;
+
+	for (i = 0; i < 2; i++) {
+		cmd->dirty_blocks[i] =
+			vzalloc(BITS_TO_LONGS(cmd->nr_mapping_blocks) *
+				sizeof(unsigned long));
+		if (!cmd->dirty_blocks[i])
+			goto bad;
+	}
+
+	cmd->bufio = dm_bufio_client_create(bdev, DM_CACHE_METADATA_BLOCK_SIZE,
+					    1, 0, NULL, NULL);
+	if (IS_ERR(cmd->bufio)) {
+		r = PTR_ERR(cmd->bufio);
+		cmd->bufio = NULL;
+		goto bad;
+	}
+
+	r = -ENOSPC;
+	if (dm_bufio_get_device_size(cmd->bufio) < metadata_blocks(cmd)) {
+		DMERR("metadata device too small, %u blocks needed",
+		      (unsigned) metadata_blocks(cmd));
+		goto bad;
+	}
+
+	r = open_metadata(cmd);
+	if (r)
+		goto bad;
+
+	return cmd;
+
+bad:
+	metadata_destroy(cmd);
+	return ERR_PTR(r);
+}
+
+struct dm_cache_metadata *dm_cache_metadata_open(struct block_device *bdev,
+						 sector_t data_block_size,
+						 dm_cblock_t cache_size)
+{
+	struct dm_cache_metadata *cmd;
+
+	mutex_lock(&_metadata_lock);
+	list_for_each_entry(cmd, &_metadata_list, list) {
+		if (cmd->bdev != bdev)
+			continue;
+
+		if (cmd->data_block_size != data_block_size ||
+		    cmd->cache_blocks != cache_size)
+			cmd = ERR_PTR(-EINVAL);
+		else
+			cmd->ref_count++;
+		goto out;
+	}
+
+	cmd = metadata_create(bdev, data_block_size, cache_size);
+	if (!IS_ERR(cmd))
+		list_add(&cmd->list, &_metadata_list);
+out:
+	mutex_unlock(&_metadata_lock);
+
+	return cmd;
+}
+
+void dm_cache_metadata_close(struct dm_cache_metadata *cmd)
+{
+	mutex_lock(&_metadata_lock);
+	if (!--cmd->ref_count) {
+		list_del(&cmd->list);
+		metadata_destroy(cmd);
+	}
+	mutex_unlock(&_metadata_lock);
+}
+
+bool dm_cache_metadata_clean(struct dm_cache_metadata *cmd)
+{
+	return cmd->clean;
+}
+
+int dm_cache_load_mappings(struct dm_cache_metadata *cmd,
+			   load_mapping_fn fn, void *context)
+{
+	dm_cblock_t cblock;
+	u64 value;
+	int r;
+
+	for (cblock = 0; cblock < cmd->cache_blocks; cblock++) {
+		value = le64_to_cpu(cmd->mappings[cblock]);
+		if (!(value & M_VALID))
+			continue;
+
+		r = fn(context, value >> M_FLAGS_SHIFT, cblock,
+		       !cmd->clean || (value & M_DIRTY));
+		if (r)
+			return r;
+	}
+
+	return 0;
+}
+
+int dm_cache_get_mapping(struct dm_cache_metadata *cmd, dm_cblock_t cblock,
+			 dm_oblock_t *oblock)
+{
+	u64 value;
+
+	if (cblock >= cmd->cache_blocks)
+		return -EINVAL;
+
+	value = le64_to_cpu(cmd->mappings[cblock]);
+	if (!(value & M_VALID))
+		return -ENODATA;
+
+	*oblock = value >> M_FLAGS_SHIFT;
+
+	return 0;
+}
+
+static int set_entry(struct dm_cache_metadata *cmd, dm_cblock_t cblock,
+		     u64 value)
+{
+	if (cblock >= cmd->cache_blocks)
+		return -EINVAL;
+
+	cmd->mappings[cblock] = cpu_to_le64(value);
+	set_bit(cblock / ENTRIES_PER_BLOCK, cmd->dirty_blocks[0]);
+	set_bit(cblock / ENTRIES_PER_BLOCK, cmd->dirty_blocks[1]);
+	cmd->changed = true;
+
+	return 0;
+}
+
+int dm_cache_insert_mapping(struct dm_cache_metadata *cmd, dm_cblock_t cblock,
+			    dm_oblock_t oblock)
+{
+	return set_entry(cmd, cblock, ((u64) oblock << M_FLAGS_SHIFT) | M_VALID);
+}
+
+int dm_cache_remove_mapping(struct dm_cache_metadata *cmd, dm_cblock_t cblock)
+{
+	return set_entry(cmd, cblock, 0);
+}
+
+int dm_cache_set_dirty(struct dm_cache_metadata *cmd, dm_cblock_t cblock,
+		       bool dirty)
+{
+	u64 value;
+
+	if (cblock >= cmd->cache_blocks)
+		return -EINVAL;
+
+	value = le64_to_cpu(cmd->mappings[cblock]);
+	if (!(value & M_VALID))
+		return -ENODATA;
+
+	if (dirty)
+		value |= M_DIRTY;
+	else
+		value &= ~M_DIRTY;
+
+	return set_entry(cmd, cblock, value);
+}
+
+int dm_cache_commit(struct dm_cache_metadata *cmd, bool clean_shutdown)
+{
+	unsigned next = !cmd->active_copy;
+	unsigned i;
+	int r;
+
+	if (cmd->failed)
+		return -EIO;
+
+	if (!cmd->changed && cmd->clean == clean_shutdown)
+		return 0;
+
+	/*
+	 * Bring the inactive copy up to date.  Its dirty bits are only
+	 * cleared once the superblock points at it, so a failed commit
+	 * is retried in full.
+	 */
+	for (i = 0; i < cmd->nr_mapping_blocks; i++) {
+		if (!test_bit(i, cmd->dirty_blocks[next]))
+			continue;
+
+		r = write_mapping_block(cmd, next, i);
+		if (r)
+			return r;
+	}
+
+	/* the mappings must be on disk before the superblock vouches for them */
+	r = dm_bufio_write_dirty_buffers(cmd->bufio);
+	if (r)
+		return r;
+
+	r = dm_bufio_issue_flush(cmd->bufio);
+	if (r)
+		return r;
+
+	r = write_superblock(cmd, next, clean_shutdown);
+	if (r)
+		return r;
+
+	r = dm_bufio_write_dirty_buffers(cmd->bufio);
+	if (!r)
+		r = dm_bufio_issue_flush(cmd->bufio);
+	if (r) {
+		/*
+		 * The superblock may or may not point at the new copy now,
+		 * writing either copy again could overwrite the live one.
+		 */
+		DMERR("superblock write failed, metadata is now read only");
+		cmd->failed = true;
+		return r;
+	}
+
+	bitmap_zero(cmd->dirty_blocks[next], cmd->nr_mapping_blocks);
+	cmd->active_copy = next;
+	cmd->clean = clean_shutdown;
+	cmd->changed = false;
+
+	return 0;
+}
+
+void dm_cache_metadata_usage(struct dm_cache_metadata *cmd,
+			     sector_t *used, sector_t *total)
+{
+	*used = metadata_blocks(cmd);
+	*total = dm_bufio_get_device_size(cmd->bufio);
+}
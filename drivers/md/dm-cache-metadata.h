@@ -0,0 +1,59 @@
+/*
+ * This file is released under the GPL.
+ */
+
+#ifndef DM_CACHE_METADATA_H
+#define DM_CACHE_METADATA_H
+
+#include "dm-cache-policy.h"
+
+#define DM_CACHE_METADATA_BLOCK_SIZE 4096
+
+struct dm_cache_metadata;
+
+/*
+ * Opens the metadata on @bdev, formatting it if it holds no cache
+ * metadata.  Existing metadata must have been written for the same cache
+ * block size and number of cache blocks.  Opening a device that is
+ * already open returns the same object with an extra reference.
+ */
+struct dm_cache_metadata *dm_cache_metadata_open(struct block_device *bdev,
+						 sector_t data_block_size,
+						 dm_cblock_t cache_size);
+void dm_cache_metadata_close(struct dm_cache_metadata *cmd);
+
+/* Returns true if the cache was last shut down cleanly. */
+bool dm_cache_metadata_clean(struct dm_cache_metadata *cmd);
+
+typedef int (*load_mapping_fn)(void *context, dm_oblock_t oblock,
+			       dm_cblock_t cblock, bool dirty);
+int dm_cache_load_mappings(struct dm_cache_metadata *cmd,
+			   load_mapping_fn fn, void *context);
+
+/* Looks up the origin block cached in @cblock, -ENODATA if unmapped. */
+int dm_cache_get_mapping(struct dm_cache_metadata *cmd, dm_cblock_t cblock,
+			 dm_oblock_t *oblock);
+
+/*
+ * Updates only change the in core copy and do not block, they reach the
+ * metadata device with the next dm_cache_commit().  Callers serialise
+ * them against each other and against commits.
+ */
+int dm_cache_insert_mapping(struct dm_cache_metadata *cmd, dm_cblock_t cblock,
+			    dm_oblock_t oblock);
+int dm_cache_remove_mapping(struct dm_cache_metadata *cmd, dm_cblock_t cblock);
+int dm_cache_set_dirty(struct dm_cache_metadata *cmd, dm_cblock_t cblock,
+		       bool dirty);
+
+/*
+ * Writes out all buffered updates and flushes the metadata device.  The
+ * commit is atomic: after a crash the metadata holds either all of it or
+ * none of it.  @clean_shutdown is recorded in the superblock.
+ */
+int dm_cache_commit(struct dm_cache_metadata *cmd, bool clean_shutdown);
+
+/* Number of metadata blocks used, and available on the device. */
+void dm_cache_metadata_usage(struct dm_cache_metadata *cmd,
+			     sector_t *used, sector_t *total);
+
+#endif
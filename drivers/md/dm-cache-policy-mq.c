@@ -0,0 +1,548 @@
+/*
+ * This file is released under the GPL.
+ *
+ * Multiqueue cache promotion policy.
+ *
+ * Every origin block that sees I/O gets an entry recording how often it
+ * was hit.  Entries are kept on one of two multiqueues: the pre cache for
+ * blocks that are only being tracked, and the cache for blocks that live
+ * on the cache device.  A multiqueue is a set of LRU lists, one per
+ * log2(hit count) level, so that the least recently used entry of the
+ * least frequently used level can be found in constant time.
+ *
+ * A tracked block is promoted once it has been hit promote_threshold
+ * times and more often than the coldest cached block, which it replaces.
+ * Hit counts are halved periodically so that old popularity fades.
+ * Sequential streams are not tracked at all: they are served well enough
+ * by the origin and would otherwise flush the cache.
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/hash.h>
+#include <linux/vmalloc.h>
+#include <linux/err.h>
+
+#include "dm-cache-policy.h"
+
+#define DM_MSG_PREFIX "cache-policy-mq"
+
+#define NR_QUEUE_LEVELS		16
+#define MAX_HIT_COUNT		(1U << 20)
+
+/* hit counts are halved after this many accesses per entry */
+#define AGE_PERIOD		4
+
+#define DEF_SEQUENTIAL_THRESHOLD	512
+#define DEF_PROMOTE_THRESHOLD		4
+
+/*----------------------------------------------------------------*/
+
+struct entry {
+	struct hlist_node hlist;
+	struct list_head list;
+	dm_oblock_t oblock;
+	dm_cblock_t cblock;
+	unsigned hit_count;
+	bool in_cache;
+};
+
+struct queue {
+	unsigned nr_elts;
+	struct list_head qs[NR_QUEUE_LEVELS];
+};
+
+static void queue_init(struct queue *q)
+{
+	unsigned i;
+
+	q->nr_elts = 0;
+	for (i = 0; i < NR_QUEUE_LEVELS; i++)
+		INIT_LIST_HEAD(q->qs + i);
+}
+
+static unsigned queue_level(struct entry *e)
+{
+	return min_t(unsigned, ilog2(e->hit_count + 1), NR_QUEUE_LEVELS - 1);
+}
+
+static void queue_push(struct queue *q, struct entry *e)
+{
+	list_add_tail(&e->list, q->qs + queue_level(e));
+	q->nr_elts++;
+}
+
+static void queue_remove(struct queue *q, struct entry *e)
+{
+	list_del(&e->list);
+	q->nr_elts--;
+}
+
+/* least recently used entry of the lowest populated level */
+static struct entry *queue_peek(struct queue *q)
+{
+	unsigned i;
+
+	for (i = 0; i < NR_QUEUE_LEVELS; i++)
+		if (!list_empty(q->qs + i))
+			return list_first_entry(q->qs + i, struct entry, list);
+
+	return NULL;
+}
+
+static struct entry *queue_pop(struct queue *q)
+{
+	struct entry *e = queue_peek(q);
+
+	if (e)
+		queue_remove(q, e);
+
+	return e;
+}
+
+/* halve all hit counts, keeping the LRU order within each level */
+static void queue_age(struct queue *q)
+{
+	struct list_head all;
+	struct entry *e, *tmp;
+	unsigned i;
+
+	INIT_LIST_HEAD(&all);
+	for (i = 0; i < NR_QUEUE_LEVELS; i++)
+		list_splice_tail_init(q->qs + i, &all);
+
+	q->nr_elts = 0;
+	list_for_each_entry_safe(e, tmp, &all, list) {
+		e->hit_count >>= 1;
+		queue_push(q, e);
+	}
+}
+
+/*----------------------------------------------------------------*/
+
+struct mq_policy {
+	struct dm_cache_policy policy;
+
+	dm_cblock_t cache_size;
+	dm_cblock_t nr_cblocks_allocated;
+	unsigned long *allocated_cblocks;
+	dm_cblock_t cblock_hint;
+
+	unsigned nr_entries;
+	struct entry *entries;
+	struct list_head free;
+
+	struct queue pre_cache;
+	struct queue cache;
+
+	unsigned hash_bits;
+	struct hlist_head *table;
+
+	unsigned long accesses;
+
+	dm_oblock_t last_oblock;
+	unsigned nr_seq;
+
+	unsigned sequential_threshold;
+	unsigned promote_threshold;
+};
+
+static struct mq_policy *to_mq_policy(struct dm_cache_policy *p)
+{
+	return container_of(p, struct mq_policy, policy);
+}
+
+static struct hlist_head *hash_bucket(struct mq_policy *mq, dm_oblock_t oblock)
+{
+	return mq->table + hash_64((u64)oblock, mq->hash_bits);
+}
+
+static struct entry *hash_lookup(struct mq_policy *mq, dm_oblock_t oblock)
+{
+	struct hlist_node *node;
+	struct entry *e;
+
+	hlist_for_each_entry(e, node, hash_bucket(mq, oblock), hlist)
+		if (e->oblock == oblock)
+			return e;
+
+	return NULL;
+}
+
+static void free_entry(struct mq_policy *mq, struct entry *e)
+{
+	hlist_del(&e->hlist);
+	list_add(&e->list, &mq->free);
+}
+
+/*
+ * Takes an entry off the free list or, if there is none, recycles the
+ * coldest tracked block.  There are twice as many entries as cache blocks,
+ * so the pre cache can never be empty when the free list is.
+ */
+static struct entry *alloc_entry(struct mq_policy *mq, dm_oblock_t oblock)
+{
+	struct entry *e;
+
+	if (!list_empty(&mq->free)) {
+		e = list_first_entry(&mq->free, struct entry, list);
+		list_del(&e->list);
+	} else {
+		e = queue_pop(&mq->pre_cache);
+		if (!e)
+			return NULL;
+		hlist_del(&e->hlist);
+	}
+
+	e->oblock = oblock;
+	e->hit_count = 1;
+	e->in_cache = false;
+	hlist_add_head(&e->hlist, hash_bucket(mq, oblock));
+
+	return e;
+}
+
+static bool alloc_cblock(struct mq_policy *mq, dm_cblock_t *result)
+{
+	unsigned long b;
+
+	if (mq->nr_cblocks_allocated >= mq->cache_size)
+		return false;
+
+	b = find_next_zero_bit(mq->allocated_cblocks, mq->cache_size,
+			       mq->cblock_hint);
+	if (b >= mq->cache_size)
+		b = find_first_zero_bit(mq->allocated_cblocks, mq->cache_size);
+
+	set_bit(b, mq->allocated_cblocks);
+	mq->nr_cblocks_allocated++;
+	mq->cblock_hint = b + 1;
+	*result = b;
+
+	return true;
+}
+
+static void free_cblock(struct mq_policy *mq, dm_cblock_t cblock)
+{
+	clear_bit(cblock, mq->allocated_cblocks);
+	mq->nr_cblocks_allocated--;
+}
+
+static struct queue *entry_queue(struct mq_policy *mq, struct entry *e)
+{
+	return e->in_cache ? &mq->cache : &mq->pre_cache;
+}
+
+static void hit_entry(struct mq_policy *mq, struct entry *e)
+{
+	struct queue *q = entry_queue(mq, e);
+
+	queue_remove(q, e);
+	if (e->hit_count < MAX_HIT_COUNT)
+		e->hit_count++;
+	queue_push(q, e);
+}
+
+static void age_entries(struct mq_policy *mq)
+{
+	queue_age(&mq->pre_cache);
+	queue_age(&mq->cache);
+	mq->accesses = 0;
+}
+
+/*
+ * Returns true if @oblock continues a run of consecutive blocks long enough
+ * to be treated as streaming I/O.
+ */
+static bool update_io_pattern(struct mq_policy *mq, dm_oblock_t oblock)
+{
+	if (oblock == mq->last_oblock + 1)
+		mq->nr_seq++;
+	else if (oblock != mq->last_oblock)
+		mq->nr_seq = 0;
+	mq->last_oblock = oblock;
+
+	return mq->sequential_threshold &&
+		mq->nr_seq >= mq->sequential_threshold;
+}
+
+static bool should_promote(struct mq_policy *mq, struct entry *e)
+{
+	struct entry *victim;
+
+	/* fill the cache with whatever is touched while it has room */
+	if (mq->nr_cblocks_allocated < mq->cache_size)
+		return true;
+
+	if (e->hit_count < mq->promote_threshold)
+		return false;
+
+	victim = queue_peek(&mq->cache);
+	return victim && e->hit_count > victim->hit_count;
+}
+
+static void promote(struct mq_policy *mq, struct entry *e,
+		    struct policy_result *result)
+{
+	struct entry *victim;
+	dm_cblock_t cblock;
+
+	queue_remove(&mq->pre_cache, e);
+
+	if (alloc_cblock(mq, &cblock))
+		result->op = POLICY_NEW;
+	else {
+		victim = queue_pop(&mq->cache);
+		cblock = victim->cblock;
+		result->op = POLICY_REPLACE;
+		result->old_oblock = victim->oblock;
+
+		/* keep its history so that it can earn its way back */
+		victim->in_cache = false;
+		queue_push(&mq->pre_cache, victim);
+	}
+
+	e->cblock = cblock;
+	e->in_cache = true;
+	queue_push(&mq->cache, e);
+	result->cblock = cblock;
+}
+
+static void mq_map(struct dm_cache_policy *p, dm_oblock_t oblock, int rw,
+		   bool can_migrate, struct policy_result *result)
+{
+	struct mq_policy *mq = to_mq_policy(p);
+	bool sequential = update_io_pattern(mq, oblock);
+	struct entry *e;
+
+	if (++mq->accesses >= mq->nr_entries * AGE_PERIOD)
+		age_entries(mq);
+
+	result->op = POLICY_MISS;
+
+	e = hash_lookup(mq, oblock);
+	if (e) {
+		hit_entry(mq, e);
+		if (e->in_cache) {
+			result->op = POLICY_HIT;
+			result->cblock = e->cblock;
+			return;
+		}
+	} else {
+		if (sequential)
+			return;
+
+		e = alloc_entry(mq, oblock);
+		if (!e)
+			return;
+		queue_push(&mq->pre_cache, e);
+	}
+
+	if (can_migrate && !sequential && should_promote(mq, e))
+		promote(mq, e, result);
+}
+
+static int mq_load_mapping(struct dm_cache_policy *p, dm_oblock_t oblock,
+			   dm_cblock_t cblock)
+{
+	struct mq_policy *mq = to_mq_policy(p);
+	struct entry *e;
+
+	if (cblock >= mq->cache_size || test_bit(cblock, mq->allocated_cblocks))
+		return -EINVAL;
+
+	e = hash_lookup(mq, oblock);
+	if (e) {
+		if (e->in_cache)
+			return -EINVAL;
+		queue_remove(&mq->pre_cache, e);
+	} else {
+		e = alloc_entry(mq, oblock);
+		if (!e)
+			return -ENOMEM;
+	}
+
+	set_bit(cblock, mq->allocated_cblocks);
+	mq->nr_cblocks_allocated++;
+
+	e->cblock = cblock;
+	e->in_cache = true;
+	queue_push(&mq->cache, e);
+
+	return 0;
+}
+
+static void mq_remove_mapping(struct dm_cache_policy *p, dm_oblock_t oblock)
+{
+	struct mq_policy *mq = to_mq_policy(p);
+	struct entry *e = hash_lookup(mq, oblock);
+
+	if (!e || !e->in_cache)
+		return;
+
+	queue_remove(&mq->cache, e);
+	free_cblock(mq, e->cblock);
+	free_entry(mq, e);
+}
+
+static dm_cblock_t mq_residency(struct dm_cache_policy *p)
+{
+	return to_mq_policy(p)->nr_cblocks_allocated;
+}
+
+static int mq_status(struct dm_cache_policy *p, status_type_t type,
+		     char *result, unsigned maxlen)
+{
+	struct mq_policy *mq = to_mq_policy(p);
+	unsigned sz = 0;
+
+	switch (type) {
+	case STATUSTYPE_INFO:
+		DMEMIT("%u %u", mq->pre_cache.nr_elts, mq->cache.nr_elts);
+		break;
+
+	case STATUSTYPE_TABLE:
+		DMEMIT("4 sequential_threshold %u promote_threshold %u",
+		       mq->sequential_threshold, mq->promote_threshold);
+		break;
+	}
+
+	return 0;
+}
+
+static void mq_destroy(struct dm_cache_policy *p)
+{
+	struct mq_policy *mq = to_mq_policy(p);
+
+	vfree(mq->table);
+	vfree(mq->entries);
+	vfree(mq->allocated_cblocks);
+	kfree(mq);
+}
+
+static int mq_parse_args(struct mq_policy *mq, unsigned argc, char **argv,
+			 char **error)
+{
+	unsigned i, value;
+	char dummy;
+
+	if (argc & 1) {
+		*error = "Policy arguments must be <key> <value> pairs";
+		return -EINVAL;
+	}
+
+	for (i = 0; i < argc; i += 2) {
+		if (sscanf(argv[i + 1], "%u%c", &value, &dummy) != 1) {
+			*error = "Invalid policy argument value";
+			return -EINVAL;
+		}
+
+		if (!strcasecmp(argv[i], "sequential_threshold"))
+			mq->sequential_threshold = value;
+		else if (!strcasecmp(argv[i], "promote_threshold"))
+			mq->promote_threshold = value;
+		else {
+			*error = "Unrecognised policy argument";
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+static struct dm_cache_policy *mq_create(dm_cblock_t cache_size,
+					 dm_oblock_t origin_size,
+					 unsigned argc, char **argv,
+					 char **error)
+{
+	struct mq_policy *mq;
+	unsigned i, nr_buckets;
+	int r;
+
+	mq = kzalloc(sizeof(*mq), GFP_KERNEL);
+	if (!mq) {
+		*error = "Cannot allocate policy";
+		return ERR_PTR(-ENOMEM);
+	}
+
+	mq->policy.map = mq_map;
+	mq->policy.load_mapping = mq_load_mapping;
+	mq->policy.remove_mapping = mq_remove_mapping;
+	mq->policy.residency = mq_residency;
+	mq->policy.status = mq_status;
+	mq->policy.destroy = mq_destroy;
+
+	mq->cache_size = cache_size;
+	mq->sequential_threshold = DEF_SEQUENTIAL_THRESHOLD;
+	mq->promote_threshold = DEF_PROMOTE_THRESHOLD;
+	mq->last_oblock = (dm_oblock_t)-2;
+	queue_init(&mq->pre_cache);
+	queue_init(&mq->cache);
+	INIT_LIST_HEAD(&mq->free);
+
+	r = mq_parse_args(mq, argc, argv, error);
+	if (r)
+		goto bad;
+
+	r = -ENOMEM;
+	mq->allocated_cblocks = vzalloc(BITS_TO_LONGS(cache_size) *
+					sizeof(unsigned long));
+	if (!mq->allocated_cblocks) {
+		*error = "Cannot allocate cache block bitmap";
+		goto bad;
+	}
+
+	mq->nr_entries = max_t(unsigned, 2 * cache_size, 64);
+	mq->entries = vzalloc(sizeof(*mq->entries) * mq->nr_entries);
+	if (!mq->entries) {
+		*error = "Cannot allocate policy entries";
+		goto bad;
+	}
+	for (i = 0; i < mq->nr_entries; i++)
+		list_add_tail(&mq->entries[i].list, &mq->free);
+
+	nr_buckets = roundup_pow_of_two(max(mq->nr_entries / 4, 16U));
+	mq->hash_bits = ilog2(nr_buckets);
+	mq->table = vzalloc(sizeof(*mq->table) * nr_buckets);
+	if (!mq->table) {
+		*error = "Cannot allocate policy hash table";
+		goto bad;
+	}
+	for (i = 0; i < nr_buckets; i++)
+		INIT_HLIST_HEAD(mq->table + i);
+
+	return &mq->policy;
+
+bad:
+	mq_destroy(&mq->policy);
+	return ERR_PTR(r);
+}
+
+/*----------------------------------------------------------------*/
+
+static struct dm_cache_policy_type mq_policy_type = {
+	.name = "mq",
+	.owner = THIS_MODULE,
+	.create = mq_create
+};
+
+static int __init mq_init(void)
+{
+	int r = dm_cache_policy_register(&mq_policy_type);
+
+	if (r)
+		DMERR("register failed %d", r);
+
+	return r;
+}
+
+static void __exit mq_exit(void)
+{
+	dm_cache_policy_unregister(&mq_policy_type);
+}
+
+module_init(mq_init);
+module_exit(mq_exit);
+
+MODULE_DESCRIPTION("mq cache policy");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,122 @@
+/*
+ * This file is released under the GPL.
+ *
+ * Cache promotion policy registration.
+ */
+
+#include <linux/device-mapper.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/err.h>
+
+#include "dm-cache-policy.h"
+
+#define DM_MSG_PREFIX "cache-policy"
+
+static LIST_HEAD(_policy_types);
+static DECLARE_RWSEM(_policy_lock);
+
+static struct dm_cache_policy_type *__find_policy(const char *name)
+{
+	struct dm_cache_policy_type *t;
+
+	list_for_each_entry(t, &_policy_types, list)
+		if (!strcmp(t->name, name))
+			return t;
+
+	return NULL;
+}
+
+static struct dm_cache_policy_type *get_policy_once(const char *name)
+{
+	struct dm_cache_policy_type *t;
+
+	down_read(&_policy_lock);
+	t = __find_policy(name);
+	if (t && !try_module_get(t->owner))
+		t = NULL;
+	up_read(&_policy_lock);
+
+	return t;
+}
+
+static struct dm_cache_policy_type *get_policy(const char *name)
+{
+	struct dm_cache_policy_type *t;
+
+	t = get_policy_once(name);
+	if (!t) {
+		request_module("dm-cache-%s", name);
+		t = get_policy_once(name);
+	}
+
+	return t;
+}
+
+int dm_cache_policy_register(struct dm_cache_policy_type *type)
+{
+	int r = 0;
+
+	down_write(&_policy_lock);
+	if (__find_policy(type->name)) {
+		DMWARN("attempt to register policy under duplicate name %s",
+		       type->name);
+		r = -EINVAL;
+	} else
+		list_add(&type->list, &_policy_types);
+	up_write(&_policy_lock);
+
+	return r;
+}
+EXPORT_SYMBOL_GPL(dm_cache_policy_register);
+
+void dm_cache_policy_unregister(struct dm_cache_policy_type *type)
+{
+	down_write(&_policy_lock);
+	list_del_init(&type->list);
+	up_write(&_policy_lock);
+}
+EXPORT_SYMBOL_GPL(dm_cache_policy_unregister);
+
+struct dm_cache_policy *dm_cache_policy_create(const char *name,
+					       dm_cblock_t cache_size,
+					       dm_oblock_t origin_size,
+					       unsigned argc, char **argv,
+					       char **error)
+{
+	struct dm_cache_policy *p;
+	struct dm_cache_policy_type *type;
+
+	type = get_policy(name);
+	if (!type) {
+		*error = "Unknown cache policy";
+		return ERR_PTR(-EINVAL);
+	}
+
+	p = type->create(cache_size, origin_size, argc, argv, error);
+	if (IS_ERR(p)) {
+		module_put(type->owner);
+		return p;
+	}
+	p->private = type;
+
+	return p;
+}
+EXPORT_SYMBOL_GPL(dm_cache_policy_create);
+
+void dm_cache_policy_destroy(struct dm_cache_policy *p)
+{
+	struct dm_cache_policy_type *type = p->private;
+
+	p->destroy(p);
+	module_put(type->owner);
+}
+EXPORT_SYMBOL_GPL(dm_cache_policy_destroy);
+
+const char *dm_cache_policy_get_name(struct dm_cache_policy *p)
+{
+	struct dm_cache_policy_type *type = p->private;
+
+	return type->name;
+}
+EXPORT_SYMBOL_GPL(dm_cache_policy_get_name);
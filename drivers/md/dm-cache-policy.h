@@ -0,0 +1,114 @@
+/*
+ * This file is released under the GPL.
+ *
+ * Cache promotion policy interface.
+ */
+
+#ifndef DM_CACHE_POLICY_H
+#define DM_CACHE_POLICY_H
+
+#include <linux/device-mapper.h>
+
+/*
+ * Blocks of the origin (slow) device and of the cache (fast) device are
+ * addressed in units of the cache block size.
+ */
+typedef sector_t dm_oblock_t;
+typedef uint32_t dm_cblock_t;
+
+/*
+ * The policy decides which origin blocks live on the cache device.  The
+ * cache target asks it what to do with every bio and carries out the data
+ * movement that the answer implies:
+ *
+ * POLICY_HIT:     the block is cached in result->cblock.
+ * POLICY_MISS:    the block is not cached, use the origin.
+ * POLICY_NEW:     promote the block into the unused result->cblock.
+ * POLICY_REPLACE: demote result->old_oblock from result->cblock, writing
+ *                 it back first if it is dirty, then promote the block
+ *                 into that cblock.
+ *
+ * The policy updates its own mapping as soon as it returns NEW or REPLACE.
+ * If the target then fails to migrate the data it undoes that with
+ * remove_mapping() and load_mapping().
+ */
+enum policy_operation {
+	POLICY_HIT,
+	POLICY_MISS,
+	POLICY_NEW,
+	POLICY_REPLACE
+};
+
+struct policy_result {
+	enum policy_operation op;
+	dm_oblock_t old_oblock;
+	dm_cblock_t cblock;
+};
+
+struct dm_cache_policy {
+	/*
+	 * Looks up @oblock for a bio of direction @rw and updates the access
+	 * statistics.  If @can_migrate is false only POLICY_HIT or
+	 * POLICY_MISS may be returned.  Called with the cache lock held,
+	 * must not block.
+	 */
+	void (*map)(struct dm_cache_policy *p, dm_oblock_t oblock, int rw,
+		    bool can_migrate, struct policy_result *result);
+
+	/*
+	 * Populates the policy with a mapping read back from the metadata
+	 * when the cache is loaded.
+	 */
+	int (*load_mapping)(struct dm_cache_policy *p, dm_oblock_t oblock,
+			    dm_cblock_t cblock);
+
+	/* Drops the mapping of @oblock, its cblock becomes free. */
+	void (*remove_mapping)(struct dm_cache_policy *p, dm_oblock_t oblock);
+
+	/* Number of cache blocks in use. */
+	dm_cblock_t (*residency)(struct dm_cache_policy *p);
+
+	/*
+	 * Emits "<#args> <args>*" for the table line, or the policy's
+	 * tunables for the info line.
+	 */
+	int (*status)(struct dm_cache_policy *p, status_type_t type,
+		      char *result, unsigned maxlen);
+
+	void (*destroy)(struct dm_cache_policy *p);
+
+	/* For use by the registration code only. */
+	void *private;
+};
+
+struct dm_cache_policy_type {
+	char name[16];
+	struct module *owner;
+	struct list_head list;
+
+	/*
+	 * Creates a policy for a cache of @cache_size blocks in front of an
+	 * origin of @origin_size blocks, taking policy specific arguments.
+	 */
+	struct dm_cache_policy *(*create)(dm_cblock_t cache_size,
+					  dm_oblock_t origin_size,
+					  unsigned argc, char **argv,
+					  char **error);
+};
+
+int dm_cache_policy_register(struct dm_cache_policy_type *type);
+void dm_cache_policy_unregister(struct dm_cache_policy_type *type);
+
+/*
+ * Looks up the named policy, loading module dm-cache-<name> if needed.
+ * Returns an ERR_PTR on failure.
+ */
+struct dm_cache_policy *dm_cache_policy_create(const char *name,
+					       dm_cblock_t cache_size,
+					       dm_oblock_t origin_size,
+					       unsigned argc, char **argv,
+					       char **error);
+void dm_cache_policy_destroy(struct dm_cache_policy *p);
+const char *dm_cache_policy_get_name(struct dm_cache_policy *p);
+
+#endif
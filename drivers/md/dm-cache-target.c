@@ -0,0 +1,1443 @@
+/*
+ * This file is released under the GPL.
+ *
+ * Cache target: keeps the hot blocks of a slow origin device on a fast
+ * cache device.
+ */
+
+#include "dm.h"
+#include "dm-bio-record.h"
+#include "dm-cache-metadata.h"
+#include "dm-cache-policy.h"
+
+#include <linux/device-mapper.h>
+#include <linux/dm-io.h>
+#include <linux/dm-kcopyd.h>
+#include <linux/blkdev.h>
+#include <linux/list.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
+#define DM_MSG_PREFIX "cache"
+
+/*
+ * Tunable constants
+ */
+#define ENDIO_HOOK_POOL_SIZE 1024
+#define MIGRATION_POOL_SIZE 128
+#define BIO_DETAILS_POOL_SIZE 16
+#define DEFERRED_SET_SIZE 64
+#define MAX_MIGRATIONS 16
+#define COMMIT_PERIOD HZ
+
+/* no bios for this long lets background writeback start */
+#define IDLE_PERIOD HZ
+
+/*
+ * The cache block size must be a power of 2 between 32KB and 1GB.
+ */
+#define DATA_DEV_BLOCK_SIZE_MIN_SECTORS (32 * 1024 >> SECTOR_SHIFT)
+#define DATA_DEV_BLOCK_SIZE_MAX_SECTORS (1024 * 1024 * 1024 >> SECTOR_SHIFT)
+
+/*----------------------------------------------------------------*/
+
+/*
+ * The deferred set keeps track of bios in flight to the cache device, so
+ * that a cache block is only overwritten once nobody is using it anymore.
+ * (Identical to the one in dm-thin.)
+ */
+struct deferred_set;
+struct deferred_entry {
+	struct deferred_set *ds;
+	unsigned count;
+	struct list_head work_items;
+};
+
+struct deferred_set {
+	spinlock_t lock;
+	unsigned current_entry;
+	unsigned sweeper;
+	struct deferred_entry entries[DEFERRED_SET_SIZE];
+};
+
+static void ds_init(struct deferred_set *ds)
+{
+	int i;
+
+	spin_lock_init(&ds->lock);
+	ds->current_entry = 0;
+	ds->sweeper = 0;
+	for (i = 0; i < DEFERRED_SET_SIZE; i++) {
+		ds->entries[i].ds = ds;
+		ds->entries[i].count = 0;
+		INIT_LIST_HEAD(&ds->entries[i].work_items);
+	}
+}
+
+static struct deferred_entry *ds_inc(struct deferred_set *ds)
+{
+	unsigned long flags;
+	struct deferred_entry *entry;
+
+	spin_lock_irqsave(&ds->lock, flags);
+	entry = ds->entries + ds->current_entry;
+	entry->count++;
+	spin_unlock_irqrestore(&ds->lock, flags);
+
+	return entry;
+}
+
+static unsigned ds_next(unsigned index)
+{
+	return (index + 1) % DEFERRED_SET_SIZE;
+}
+
+static void __sweep(struct deferred_set *ds, struct list_head *head)
+{
+	while ((ds->sweeper != ds->current_entry) &&
+	       !ds->entries[ds->sweeper].count) {
+		list_splice_init(&ds->entries[ds->sweeper].work_items, head);
+		ds->sweeper = ds_next(ds->sweeper);
+	}
+
+	if ((ds->sweeper == ds->current_entry) && !ds->entries[ds->sweeper].count)
+		list_splice_init(&ds->entries[ds->sweeper].work_items, head);
+}
+
+static void ds_dec(struct deferred_entry *entry, struct list_head *head)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&entry->ds->lock, flags);
+	BUG_ON(!entry->count);
+	--entry->count;
+	__sweep(entry->ds, head);
+	spin_unlock_irqrestore(&entry->ds->lock, flags);
+}
+
+/*
+ * Returns 1 if deferred or 0 if no pending items to delay job.
+ */
+static int ds_add_work(struct deferred_set *ds, struct list_head *work)
+{
+	int r = 1;
+	unsigned long flags;
+	unsigned next_entry;
+
+	spin_lock_irqsave(&ds->lock, flags);
+	if ((ds->sweeper == ds->current_entry) &&
+	    !ds->entries[ds->current_entry].count)
+		r = 0;
+	else {
+		list_add(work, &ds->entries[ds->current_entry].work_items);
+		next_entry = ds_next(ds->current_entry);
+		if (!ds->entries[next_entry].count)
+			ds->current_entry = next_entry;
+	}
+	spin_unlock_irqrestore(&ds->lock, flags);
+
+	return r;
+}
+
+/*----------------------------------------------------------------*/
+
+struct cache_stats {
+	atomic_t read_hit;
+	atomic_t read_miss;
+	atomic_t write_hit;
+	atomic_t write_miss;
+	atomic_t demotion;
+	atomic_t promotion;
+	atomic_t writeback;
+};
+
+struct cache {
+	struct dm_target *ti;
+
+	struct dm_dev *metadata_dev;
+	struct dm_dev *origin_dev;
+	struct dm_dev *cache_dev;
+
+	sector_t origin_sectors;
+	sector_t sectors_per_block;
+	unsigned sectors_per_block_shift;
+	dm_cblock_t cache_size;
+	bool writethrough;
+
+	struct dm_cache_metadata *cmd;
+	struct dm_cache_policy *policy;
+	bool loaded_mappings;
+
+	spinlock_t lock;
+	struct bio_list deferred_bios;
+	struct bio_list deferred_flush_bios;
+	struct bio_list deferred_writethrough_bios;
+
+	/* active migrations, each locks the origin blocks it touches */
+	struct list_head migrations;
+	unsigned nr_migrations;
+	wait_queue_head_t migration_wait;
+	bool quiescing;
+
+	struct list_head quiesced_migrations;
+	struct list_head completed_migrations;
+
+	/* only touched by the worker */
+	struct list_head need_commit_migrations;
+	bool commit_needed;
+	dm_cblock_t writeback_cursor;
+
+	unsigned long *dirty_bitset;
+	unsigned long *dirty_changed;
+	dm_cblock_t nr_dirty;
+
+	unsigned long last_io;
+
+	struct workqueue_struct *wq;
+	struct work_struct worker;
+	struct delayed_work waker;
+
+	struct dm_kcopyd_client *copier;
+	struct deferred_set all_io_ds;
+
+	mempool_t *endio_hook_pool;
+	mempool_t *migration_pool;
+	mempool_t *bio_details_pool;
+
+	struct cache_stats stats;
+};
+
+struct dm_cache_endio_hook {
+	struct deferred_entry *all_io_entry;
+
+	/* writethrough writes hitting the cache, see cache_end_io() */
+	bool writethrough;
+	dm_cblock_t cblock;
+	struct dm_bio_details *details;
+};
+
+struct dm_cache_migration {
+	struct list_head list;
+	struct list_head work;
+	struct cache *cache;
+
+	bool writeback;
+	bool demote;
+	bool promote;
+	bool err;
+
+	enum {
+		MG_WRITEBACK,
+		MG_PROMOTE
+	} stage;
+
+	dm_oblock_t old_oblock;
+	dm_oblock_t new_oblock;
+	dm_cblock_t cblock;
+
+	/* bios to either oblock that arrived during the migration */
+	struct bio_list bios;
+};
+
+static struct kmem_cache *_endio_hook_cache;
+static struct kmem_cache *_migration_cache;
+
+static void wake_worker(struct cache *cache)
+{
+	queue_work(cache->wq, &cache->worker);
+}
+
+/*----------------------------------------------------------------*/
+
+static dm_oblock_t get_bio_block(struct cache *cache, struct bio *bio)
+{
+	return dm_target_offset(cache->ti, bio->bi_sector) >>
+		cache->sectors_per_block_shift;
+}
+
+static void remap_to_origin(struct cache *cache, struct bio *bio)
+{
+	bio->bi_bdev = cache->origin_dev->bdev;
+	bio->bi_sector = dm_target_offset(cache->ti, bio->bi_sector);
+}
+
+static void remap_to_cache(struct cache *cache, struct bio *bio,
+			   dm_cblock_t cblock)
+{
+	sector_t offset = dm_target_offset(cache->ti, bio->bi_sector);
+
+	bio->bi_bdev = cache->cache_dev->bdev;
+	bio->bi_sector = ((sector_t) cblock << cache->sectors_per_block_shift) |
+		(offset & (cache->sectors_per_block - 1));
+}
+
+/*
+ * Bios to an origin block that a migration is moving must wait for it.
+ * Called with the cache lock held.
+ */
+static struct dm_cache_migration *__find_locker(struct cache *cache,
+						dm_oblock_t oblock)
+{
+	struct dm_cache_migration *m;
+
+	list_for_each_entry(m, &cache->migrations, list) {
+		if (m->promote && m->new_oblock == oblock)
+			return m;
+		if ((m->demote || m->writeback) && m->old_oblock == oblock)
+			return m;
+	}
+
+	return NULL;
+}
+
+static void __set_dirty(struct cache *cache, dm_cblock_t cblock)
+{
+	if (!test_and_set_bit(cblock, cache->dirty_bitset)) {
+		cache->nr_dirty++;
+		set_bit(cblock, cache->dirty_changed);
+	}
+}
+
+static void clear_dirty(struct cache *cache, dm_cblock_t cblock)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&cache->lock, flags);
+	if (test_and_clear_bit(cblock, cache->dirty_bitset)) {
+		cache->nr_dirty--;
+		set_bit(cblock, cache->dirty_changed);
+	}
+	spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+/*
+ * Brings the metadata up to date with the cache device.  The dirty bits
+ * are tracked in core by the I/O path and copied into the metadata here.
+ */
+static int commit(struct cache *cache, bool clean_shutdown)
+{
+	unsigned long b;
+	int r;
+
+	spin_lock_irq(&cache->lock);
+	for (b = find_first_bit(cache->dirty_changed, cache->cache_size);
+	     b < cache->cache_size;
+	     b = find_next_bit(cache->dirty_changed, cache->cache_size, b + 1)) {
+		clear_bit(b, cache->dirty_changed);
+		dm_cache_set_dirty(cache->cmd, b,
+				   test_bit(b, cache->dirty_bitset));
+	}
+	spin_unlock_irq(&cache->lock);
+
+	/*
+	 * Blocks written back to the origin and copied to the cache must be
+	 * on disk before the metadata that depends on them.
+	 */
+	r = blkdev_issue_flush(cache->origin_dev->bdev, GFP_NOIO, NULL);
+	if (!r)
+		r = blkdev_issue_flush(cache->cache_dev->bdev, GFP_NOIO, NULL);
+	if (!r)
+		r = dm_cache_commit(cache->cmd, clean_shutdown);
+
+	if (r)
+		DMERR_LIMIT("commit failed: error = %d", r);
+	else
+		cache->commit_needed = false;
+
+	return r;
+}
+
+/*----------------------------------------------------------------
+ * Migrations
+ *
+ * A migration moves data between the devices for one cache block:
+ *
+ *   writeback: copy a dirty block back to the origin;
+ *   demote:    drop the mapping of the block, committed before the cache
+ *              block is reused;
+ *   promote:   copy an origin block into the cache block and map it.
+ *
+ * Promotions to a free cache block, demotions followed by a promotion,
+ * and writebacks of dirty blocks on their own when the cache is idle
+ * all use the same machinery.  Every step runs in the worker.
+ *--------------------------------------------------------------*/
+static void copy_complete(int read_err, unsigned long write_err, void *context)
+{
+	struct dm_cache_migration *m = context;
+	struct cache *cache = m->cache;
+	unsigned long flags;
+
+	if (read_err || write_err)
+		m->err = true;
+
+	spin_lock_irqsave(&cache->lock, flags);
+	list_add_tail(&m->work, &cache->completed_migrations);
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	wake_worker(cache);
+}
+
+static void copy_block(struct dm_cache_migration *m, bool promote)
+{
+	struct cache *cache = m->cache;
+	struct dm_io_region o_region, c_region;
+	dm_oblock_t oblock = promote ? m->new_oblock : m->old_oblock;
+	int r;
+
+	o_region.bdev = cache->origin_dev->bdev;
+	o_region.sector = oblock << cache->sectors_per_block_shift;
+	o_region.count = min(cache->sectors_per_block,
+			     cache->origin_sectors - o_region.sector);
+
+	c_region.bdev = cache->cache_dev->bdev;
+	c_region.sector = (sector_t) m->cblock << cache->sectors_per_block_shift;
+	c_region.count = o_region.count;
+
+	if (promote)
+		r = dm_kcopyd_copy(cache->copier, &o_region, 1, &c_region,
+				   0, copy_complete, m);
+	else
+		r = dm_kcopyd_copy(cache->copier, &c_region, 1, &o_region,
+				   0, copy_complete, m);
+	if (r < 0) {
+		DMERR_LIMIT("dm_kcopyd_copy() failed");
+		copy_complete(1, 1, m);
+	}
+}
+
+static void cleanup_migration(struct dm_cache_migration *m)
+{
+	struct cache *cache = m->cache;
+	unsigned long flags;
+
+	spin_lock_irqsave(&cache->lock, flags);
+	list_del(&m->list);
+	bio_list_merge(&cache->deferred_bios, &m->bios);
+	cache->nr_migrations--;
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	wake_up(&cache->migration_wait);
+	mempool_free(m, cache->migration_pool);
+}
+
+static void migration_failure(struct dm_cache_migration *m)
+{
+	struct cache *cache = m->cache;
+	unsigned long flags;
+
+	DMERR_LIMIT("migration of cache block %u failed", m->cblock);
+
+	/*
+	 * A failed writeback leaves the old block in place, so put its
+	 * mapping back.  After a failed promotion the cache block is free.
+	 */
+	spin_lock_irqsave(&cache->lock, flags);
+	if (m->promote)
+		cache->policy->remove_mapping(cache->policy, m->new_oblock);
+	if (m->demote && m->stage == MG_WRITEBACK)
+		cache->policy->load_mapping(cache->policy, m->old_oblock,
+					    m->cblock);
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	cleanup_migration(m);
+}
+
+static void issue_promote(struct dm_cache_migration *m)
+{
+	m->stage = MG_PROMOTE;
+	copy_block(m, true);
+}
+
+static void writeback_done(struct dm_cache_migration *m)
+{
+	struct cache *cache = m->cache;
+
+	if (m->writeback) {
+		atomic_inc(&cache->stats.writeback);
+		clear_dirty(cache, m->cblock);
+	}
+
+	if (!m->demote) {
+		if (m->promote)
+			issue_promote(m);
+		else
+			cleanup_migration(m);
+		return;
+	}
+
+	dm_cache_remove_mapping(cache->cmd, m->cblock);
+	atomic_inc(&cache->stats.demotion);
+	cache->commit_needed = true;
+
+	/* the old mapping must be gone from disk before the block is reused */
+	list_add_tail(&m->work, &cache->need_commit_migrations);
+}
+
+static void issue_migration(struct dm_cache_migration *m)
+{
+	m->stage = MG_WRITEBACK;
+
+	if (m->writeback)
+		copy_block(m, false);
+	else
+		writeback_done(m);
+}
+
+static void complete_migration(struct dm_cache_migration *m)
+{
+	struct cache *cache = m->cache;
+
+	if (m->err) {
+		migration_failure(m);
+		return;
+	}
+
+	switch (m->stage) {
+	case MG_WRITEBACK:
+		writeback_done(m);
+		break;
+
+	case MG_PROMOTE:
+		dm_cache_insert_mapping(cache->cmd, m->cblock, m->new_oblock);
+		atomic_inc(&cache->stats.promotion);
+		cache->commit_needed = true;
+		cleanup_migration(m);
+		break;
+	}
+}
+
+static void process_migrations(struct cache *cache, struct list_head *head,
+			       void (*fn)(struct dm_cache_migration *))
+{
+	unsigned long flags;
+	struct list_head list;
+	struct dm_cache_migration *m, *tmp;
+
+	INIT_LIST_HEAD(&list);
+	spin_lock_irqsave(&cache->lock, flags);
+	list_splice_init(head, &list);
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	list_for_each_entry_safe(m, tmp, &list, work) {
+		list_del(&m->work);
+		fn(m);
+	}
+}
+
+/*
+ * Starts a migration once all I/O to its cache block has drained.  Called
+ * with the cache lock held.
+ */
+static void __quiesce_migration(struct cache *cache,
+				struct dm_cache_migration *m)
+{
+	list_add(&m->list, &cache->migrations);
+	cache->nr_migrations++;
+
+	if (!ds_add_work(&cache->all_io_ds, &m->work))
+		list_add_tail(&m->work, &cache->quiesced_migrations);
+}
+
+/*
+ * Writes back a few dirty blocks when there is nothing else to do.  In
+ * writethrough mode blocks left dirty by an earlier writeback session are
+ * cleaned straight away.
+ */
+static void writeback_some_dirty_blocks(struct cache *cache)
+{
+	struct dm_cache_migration *m;
+	dm_oblock_t oblock;
+	unsigned long b;
+	unsigned tries, queued = 0;
+
+	if (!cache->writethrough &&
+	    time_before(jiffies, cache->last_io + IDLE_PERIOD))
+		return;
+
+	for (tries = 0; tries < MAX_MIGRATIONS; tries++) {
+		if (cache->quiescing || !cache->nr_dirty ||
+		    cache->nr_migrations >= MAX_MIGRATIONS / 2)
+			break;
+
+		b = find_next_bit(cache->dirty_bitset, cache->cache_size,
+				  cache->writeback_cursor);
+		if (b >= cache->cache_size)
+			b = find_first_bit(cache->dirty_bitset, cache->cache_size);
+		if (b >= cache->cache_size)
+			break;
+		cache->writeback_cursor = b + 1;
+
+		if (dm_cache_get_mapping(cache->cmd, b, &oblock))
+			continue;
+
+		m = mempool_alloc(cache->migration_pool, GFP_NOIO);
+		m->cache = cache;
+		m->writeback = true;
+		m->demote = false;
+		m->promote = false;
+		m->err = false;
+		m->old_oblock = oblock;
+		m->cblock = b;
+		bio_list_init(&m->bios);
+
+		spin_lock_irq(&cache->lock);
+		if (__find_locker(cache, oblock) ||
+		    !test_bit(b, cache->dirty_bitset)) {
+			spin_unlock_irq(&cache->lock);
+			mempool_free(m, cache->migration_pool);
+			continue;
+		}
+		__quiesce_migration(cache, m);
+		spin_unlock_irq(&cache->lock);
+		queued++;
+	}
+
+	/*
+	 * On an idle device the migrations are quiesced straight away and
+	 * nothing else will run the worker to start them.
+	 */
+	if (queued)
+		wake_worker(cache);
+}
+
+/*----------------------------------------------------------------
+ * Bio mapping
+ *--------------------------------------------------------------*/
+static void inc_hit_counter(struct cache *cache, struct bio *bio)
+{
+	atomic_inc(bio_data_dir(bio) == READ ?
+		   &cache->stats.read_hit : &cache->stats.write_hit);
+}
+
+static void inc_miss_counter(struct cache *cache, struct bio *bio)
+{
+	atomic_inc(bio_data_dir(bio) == READ ?
+		   &cache->stats.read_miss : &cache->stats.write_miss);
+}
+
+static void init_migration(struct dm_cache_migration *m, struct cache *cache,
+			   dm_oblock_t oblock, struct policy_result *result)
+{
+	m->cache = cache;
+	m->err = false;
+	m->promote = true;
+	m->new_oblock = oblock;
+	m->cblock = result->cblock;
+	bio_list_init(&m->bios);
+
+	if (result->op == POLICY_REPLACE) {
+		m->demote = true;
+		m->old_oblock = result->old_oblock;
+		m->writeback = test_bit(result->cblock, cache->dirty_bitset);
+	} else {
+		m->demote = false;
+		m->writeback = false;
+	}
+}
+
+/*
+ * Looks up the block in the policy and either remaps the bio or hands it
+ * to a migration.  The hook has already been allocated.
+ */
+static int map_bio(struct cache *cache, struct bio *bio,
+		   struct dm_cache_endio_hook *h)
+{
+	struct dm_cache_migration *m = NULL, *locker;
+	struct policy_result result;
+	dm_oblock_t oblock = get_bio_block(cache, bio);
+	bool write = bio_data_dir(bio) == WRITE;
+	int r = DM_MAPIO_REMAPPED;
+
+	cache->last_io = jiffies;
+
+	if (!cache->quiescing && cache->nr_migrations < MAX_MIGRATIONS)
+		m = mempool_alloc(cache->migration_pool, GFP_NOWAIT);
+
+	if (cache->writethrough && write && !h->details)
+		h->details = mempool_alloc(cache->bio_details_pool, GFP_NOIO);
+
+	spin_lock_irq(&cache->lock);
+
+	locker = __find_locker(cache, oblock);
+	if (locker) {
+		bio_list_add(&locker->bios, bio);
+		r = DM_MAPIO_SUBMITTED;
+		goto out;
+	}
+
+	cache->policy->map(cache->policy, oblock, bio_data_dir(bio),
+			   m && !cache->quiescing &&
+			   cache->nr_migrations < MAX_MIGRATIONS,
+			   &result);
+
+	if (result.op == POLICY_REPLACE && __find_locker(cache, result.old_oblock)) {
+		/* the victim is being written back, leave it in the cache */
+		cache->policy->remove_mapping(cache->policy, oblock);
+		cache->policy->load_mapping(cache->policy, result.old_oblock,
+					    result.cblock);
+		result.op = POLICY_MISS;
+	}
+
+	switch (result.op) {
+	case POLICY_HIT:
+		inc_hit_counter(cache, bio);
+		h->all_io_entry = ds_inc(&cache->all_io_ds);
+
+		if (write && cache->writethrough) {
+			h->writethrough = true;
+			h->cblock = result.cblock;
+			dm_bio_record(h->details, bio);
+			remap_to_origin(cache, bio);
+			break;
+		}
+
+		if (write)
+			__set_dirty(cache, result.cblock);
+		remap_to_cache(cache, bio, result.cblock);
+		break;
+
+	case POLICY_MISS:
+		inc_miss_counter(cache, bio);
+		remap_to_origin(cache, bio);
+		break;
+
+	case POLICY_NEW:
+	case POLICY_REPLACE:
+		inc_miss_counter(cache, bio);
+		init_migration(m, cache, oblock, &result);
+		bio_list_add(&m->bios, bio);
+		__quiesce_migration(cache, m);
+		m = NULL;
+		r = DM_MAPIO_SUBMITTED;
+		wake_worker(cache);
+		break;
+	}
+
+out:
+	spin_unlock_irq(&cache->lock);
+
+	if (m)
+		mempool_free(m, cache->migration_pool);
+
+	return r;
+}
+
+static void process_deferred_bios(struct cache *cache)
+{
+	struct bio_list bios;
+	struct bio *bio;
+
+	bio_list_init(&bios);
+
+	spin_lock_irq(&cache->lock);
+	bio_list_merge(&bios, &cache->deferred_bios);
+	bio_list_init(&cache->deferred_bios);
+	spin_unlock_irq(&cache->lock);
+
+	while ((bio = bio_list_pop(&bios)))
+		if (map_bio(cache, bio, dm_get_mapinfo(bio)->ptr) ==
+		    DM_MAPIO_REMAPPED)
+			generic_make_request(bio);
+}
+
+/*
+ * Flushes and FUA writes need every mapping they depend on to be on disk
+ * first.  The flush itself is passed on to the origin here, the cache
+ * device gets its own copy straight from cache_map().
+ */
+static void process_deferred_flush_bios(struct cache *cache)
+{
+	struct bio_list bios;
+	struct bio *bio;
+	int r = 0;
+
+	bio_list_init(&bios);
+
+	spin_lock_irq(&cache->lock);
+	bio_list_merge(&bios, &cache->deferred_flush_bios);
+	bio_list_init(&cache->deferred_flush_bios);
+	spin_unlock_irq(&cache->lock);
+
+	if (bio_list_empty(&bios))
+		return;
+
+	if (cache->commit_needed)
+		r = commit(cache, false);
+
+	while ((bio = bio_list_pop(&bios))) {
+		if (r)
+			bio_endio(bio, r);
+		else if (bio->bi_rw & REQ_FLUSH) {
+			remap_to_origin(cache, bio);
+			generic_make_request(bio);
+		} else if (map_bio(cache, bio, dm_get_mapinfo(bio)->ptr) ==
+			   DM_MAPIO_REMAPPED)
+			generic_make_request(bio);
+	}
+}
+
+static void process_deferred_writethrough_bios(struct cache *cache)
+{
+	struct bio_list bios;
+	struct bio *bio;
+
+	bio_list_init(&bios);
+
+	spin_lock_irq(&cache->lock);
+	bio_list_merge(&bios, &cache->deferred_writethrough_bios);
+	bio_list_init(&cache->deferred_writethrough_bios);
+	spin_unlock_irq(&cache->lock);
+
+	while ((bio = bio_list_pop(&bios)))
+		generic_make_request(bio);
+}
+
+static void process_need_commit_migrations(struct cache *cache)
+{
+	struct dm_cache_migration *m, *tmp;
+
+	if (list_empty(&cache->need_commit_migrations))
+		return;
+
+	if (commit(cache, false)) {
+		list_for_each_entry_safe(m, tmp, &cache->need_commit_migrations,
+					 work) {
+			list_del(&m->work);
+			dm_cache_insert_mapping(cache->cmd, m->cblock,
+						m->old_oblock);
+			m->err = true;
+			migration_failure(m);
+		}
+		return;
+	}
+
+	list_for_each_entry_safe(m, tmp, &cache->need_commit_migrations, work) {
+		list_del(&m->work);
+		issue_promote(m);
+	}
+}
+
+static void do_worker(struct work_struct *ws)
+{
+	struct cache *cache = container_of(ws, struct cache, worker);
+
+	process_deferred_writethrough_bios(cache);
+	process_migrations(cache, &cache->quiesced_migrations, issue_migration);
+	process_migrations(cache, &cache->completed_migrations,
+			   complete_migration);
+	process_need_commit_migrations(cache);
+	process_deferred_flush_bios(cache);
+	process_deferred_bios(cache);
+}
+
+/*
+ * We want to commit periodically so that not too much unwritten metadata
+ * builds up.
+ */
+static void do_waker(struct work_struct *ws)
+{
+	struct cache *cache = container_of(to_delayed_work(ws), struct cache,
+					   waker);
+
+	if (cache->commit_needed)
+		commit(cache, false);
+	writeback_some_dirty_blocks(cache);
+
+	queue_delayed_work(cache->wq, &cache->waker, COMMIT_PERIOD);
+}
+
+/*----------------------------------------------------------------
+ * Target methods
+ *--------------------------------------------------------------*/
+static void destroy(struct cache *cache)
+{
+	if (cache->wq)
+		destroy_workqueue(cache->wq);
+	if (cache->copier)
+		dm_kcopyd_client_destroy(cache->copier);
+	if (cache->bio_details_pool)
+		mempool_destroy(cache->bio_details_pool);
+	if (cache->migration_pool)
+		mempool_destroy(cache->migration_pool);
+	if (cache->endio_hook_pool)
+		mempool_destroy(cache->endio_hook_pool);
+	if (cache->policy)
+		dm_cache_policy_destroy(cache->policy);
+	if (cache->cmd)
+		dm_cache_metadata_close(cache->cmd);
+	vfree(cache->dirty_changed);
+	vfree(cache->dirty_bitset);
+
+	if (cache->metadata_dev)
+		dm_put_device(cache->ti, cache->metadata_dev);
+	if (cache->cache_dev)
+		dm_put_device(cache->ti, cache->cache_dev);
+	if (cache->origin_dev)
+		dm_put_device(cache->ti, cache->origin_dev);
+
+	kfree(cache);
+}
+
+static void cache_dtr(struct dm_target *ti)
+{
+	destroy(ti->private);
+}
+
+static sector_t get_dev_size(struct dm_dev *dev)
+{
+	return i_size_read(dev->bdev->bd_inode) >> SECTOR_SHIFT;
+}
+
+static int parse_block_size(struct cache *cache, const char *arg,
+			    char **error)
+{
+	unsigned long block_size;
+	char dummy;
+
+	if (sscanf(arg, "%lu%c", &block_size, &dummy) != 1 ||
+	    block_size < DATA_DEV_BLOCK_SIZE_MIN_SECTORS ||
+	    block_size > DATA_DEV_BLOCK_SIZE_MAX_SECTORS ||
+	    !is_power_of_2(block_size)) {
+		*error = "Invalid block size";
+		return -EINVAL;
+	}
+
+	cache->sectors_per_block = block_size;
+	cache->sectors_per_block_shift = __ffs(block_size);
+
+	return 0;
+}
+
+static int parse_features(struct cache *cache, struct dm_arg_set *as,
+			  char **error)
+{
+	int r;
+	unsigned argc;
+	const char *arg;
+
+	static struct dm_arg _args[] = {
+		{0, 1, "Invalid number of cache feature arguments"},
+	};
+
+	r = dm_read_arg_group(_args, as, &argc, error);
+	if (r)
+		return -EINVAL;
+
+	while (argc--) {
+		arg = dm_shift_arg(as);
+
+		if (!strcasecmp(arg, "writeback"))
+			cache->writethrough = false;
+
+		else if (!strcasecmp(arg, "writethrough"))
+			cache->writethrough = true;
+
+		else {
+			*error = "Unrecognised cache feature requested";
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+static int create_cache_policy(struct cache *cache, struct dm_arg_set *as,
+			       char **error)
+{
+	int r;
+	unsigned argc;
+	const char *name;
+	struct dm_cache_policy *p;
+
+	static struct dm_arg _args[] = {
+		{0, 1024, "Invalid number of policy arguments"},
+	};
+
+	name = dm_shift_arg(as);
+	if (!name) {
+		*error = "Cache policy name missing";
+		return -EINVAL;
+	}
+
+	r = dm_read_arg_group(_args, as, &argc, error);
+	if (r)
+		return -EINVAL;
+
+	p = dm_cache_policy_create(name, cache->cache_size,
+				   dm_div_up(cache->origin_sectors,
+					     cache->sectors_per_block),
+				   argc, as->argv, error);
+	if (IS_ERR(p))
+		return PTR_ERR(p);
+
+	dm_consume_args(as, argc);
+	cache->policy = p;
+
+	return 0;
+}
+
+/*
+ * Construct a cache device mapping:
+ *
+ * cache <metadata dev> <cache dev> <origin dev> <block size>
+ *       <#feature args> [<feature arg>]*
+ *       <policy> <#policy args> [<policy arg>]*
+ *
+ * metadata dev: fast device holding the persistent metadata
+ * cache dev: fast device holding the cached data blocks
+ * origin dev: slow device holding the original data blocks
+ * block size: cache unit size in sectors, a power of 2
+ *
+ * Optional feature arguments are:
+ *	     writeback: write hits go to the cache only (default)
+ *	     writethrough: write hits go to the origin, then the cache
+ *
+ * policy: the replacement policy to use, e.g. mq
+ */
+static int cache_ctr(struct dm_target *ti, unsigned argc, char **argv)
+{
+	int r;
+	struct cache *cache;
+	struct dm_arg_set as;
+	fmode_t mode = dm_table_get_mode(ti->table);
+	sector_t cache_sectors;
+
+	if (argc < 6) {
+		ti->error = "Invalid argument count";
+		return -EINVAL;
+	}
+
+	cache = kzalloc(sizeof(*cache), GFP_KERNEL);
+	if (!cache) {
+		ti->error = "Cannot allocate cache context";
+		return -ENOMEM;
+	}
+	cache->ti = ti;
+	ti->private = cache;
+
+	spin_lock_init(&cache->lock);
+	bio_list_init(&cache->deferred_bios);
+	bio_list_init(&cache->deferred_flush_bios);
+	bio_list_init(&cache->deferred_writethrough_bios);
+	INIT_LIST_HEAD(&cache->migrations);
+	INIT_LIST_HEAD(&cache->quiesced_migrations);
+	INIT_LIST_HEAD(&cache->completed_migrations);
+	INIT_LIST_HEAD(&cache->need_commit_migrations);
+	init_waitqueue_head(&cache->migration_wait);
+	ds_init(&cache->all_io_ds);
+	cache->quiescing = true;
+
+	r = dm_get_device(ti, argv[0], FMODE_READ | FMODE_WRITE,
+			  &cache->metadata_dev);
+	if (r) {
+		ti->error = "Error opening metadata device";
+		goto bad;
+	}
+
+	r = dm_get_device(ti, argv[1], mode, &cache->cache_dev);
+	if (r) {
+		ti->error = "Error opening cache device";
+		goto bad;
+	}
+
+	r = dm_get_device(ti, argv[2], mode, &cache->origin_dev);
+	if (r) {
+		ti->error = "Error opening origin device";
+		goto bad;
+	}
+
+	cache->origin_sectors = ti->len;
+	if (get_dev_size(cache->origin_dev) < ti->len) {
+		ti->error = "Device size exceeds origin device size";
+		r = -EINVAL;
+		goto bad;
+	}
+
+	r = parse_block_size(cache, argv[3], &ti->error);
+	if (r)
+		goto bad;
+
+	cache_sectors = get_dev_size(cache->cache_dev);
+	cache->cache_size = cache_sectors >> cache->sectors_per_block_shift;
+	if (!cache->cache_size) {
+		ti->error = "Cache device smaller than one block";
+		r = -EINVAL;
+		goto bad;
+	}
+
+	as.argc = argc - 4;
+	as.argv = argv + 4;
+
+	r = parse_features(cache, &as, &ti->error);
+	if (r)
+		goto bad;
+
+	r = create_cache_policy(cache, &as, &ti->error);
+	if (r)
+		goto bad;
+
+	if (as.argc) {
+		ti->error = "Too many arguments";
+		r = -EINVAL;
+		goto bad;
+	}
+
+	r = -ENOMEM;
+	cache->dirty_bitset = vzalloc(BITS_TO_LONGS(cache->cache_size) *
+				      sizeof(unsigned long));
+	cache->dirty_changed = vzalloc(BITS_TO_LONGS(cache->cache_size) *
+				       sizeof(unsigned long));
+	if (!cache->dirty_bitset || !cache->dirty_changed) {
+		ti->error = "Cannot allocate dirty bitsets";
+		goto bad;
+	}
+
+	cache->endio_hook_pool = mempool_create_slab_pool(ENDIO_HOOK_POOL_SIZE,
+							  _endio_hook_cache);
+	if (!cache->endio_hook_pool) {
+		ti->error = "Error creating cache's endio_hook mempool";
+		goto bad;
+	}
+
+	cache->migration_pool = mempool_create_slab_pool(MIGRATION_POOL_SIZE,
+							 _migration_cache);
+	if (!cache->migration_pool) {
+		ti->error = "Error creating cache's migration mempool";
+		goto bad;
+	}
+
+	if (cache->writethrough) {
+		cache->bio_details_pool =
+			mempool_create_kmalloc_pool(BIO_DETAILS_POOL_SIZE,
+						    sizeof(struct dm_bio_details));
+		if (!cache->bio_details_pool) {
+			ti->error = "Error creating cache's bio details mempool";
+			goto bad;
+		}
+	}
+
+	cache->copier = dm_kcopyd_client_create();
+	if (IS_ERR(cache->copier)) {
+		r = PTR_ERR(cache->copier);
+		cache->copier = NULL;
+		ti->error = "Couldn't create kcopyd client";
+		goto bad;
+	}
+
+	cache->wq = alloc_ordered_workqueue("dm-" DM_MSG_PREFIX, WQ_MEM_RECLAIM);
+	if (!cache->wq) {
+		ti->error = "Couldn't create cache workqueue";
+		goto bad;
+	}
+	INIT_WORK(&cache->worker, do_worker);
+	INIT_DELAYED_WORK(&cache->waker, do_waker);
+
+	cache->cmd = dm_cache_metadata_open(cache->metadata_dev->bdev,
+					    cache->sectors_per_block,
+					    cache->cache_size);
+	if (IS_ERR(cache->cmd)) {
+		r = PTR_ERR(cache->cmd);
+		cache->cmd = NULL;
+		ti->error = "Error opening metadata";
+		goto bad;
+	}
+
+	r = dm_set_target_max_io_len(ti, cache->sectors_per_block);
+	if (r)
+		goto bad;
+
+	/* request 0 goes to the origin after a commit, 1 to the cache */
+	ti->num_flush_requests = 2;
+	ti->flush_supported = true;
+
+	return 0;
+
+bad:
+	destroy(cache);
+	return r;
+}
+
+static int cache_map(struct dm_target *ti, struct bio *bio,
+		     union map_info *map_context)
+{
+	struct cache *cache = ti->private;
+	struct dm_cache_endio_hook *h;
+	unsigned request_nr = map_context->target_request_nr;
+
+	h = mempool_alloc(cache->endio_hook_pool, GFP_NOIO);
+	h->all_io_entry = NULL;
+	h->writethrough = false;
+	h->details = NULL;
+	map_context->ptr = h;
+
+	if (bio->bi_rw & REQ_FLUSH) {
+		BUG_ON(bio->bi_size);
+		if (request_nr) {
+			bio->bi_bdev = cache->cache_dev->bdev;
+			return DM_MAPIO_REMAPPED;
+		}
+	}
+
+	if (bio->bi_rw & (REQ_FLUSH | REQ_FUA)) {
+		spin_lock_irq(&cache->lock);
+		bio_list_add(&cache->deferred_flush_bios, bio);
+		spin_unlock_irq(&cache->lock);
+
+		wake_worker(cache);
+		return DM_MAPIO_SUBMITTED;
+	}
+
+	return map_bio(cache, bio, h);
+}
+
+static int cache_end_io(struct dm_target *ti, struct bio *bio,
+			int error, union map_info *map_context)
+{
+	struct cache *cache = ti->private;
+	struct dm_cache_endio_hook *h = map_context->ptr;
+	unsigned long flags;
+	struct list_head work;
+
+	/*
+	 * The origin is up to date, now write the same data to the cache
+	 * block.  Errors from either device are returned to the caller.
+	 */
+	if (h->writethrough && !error) {
+		h->writethrough = false;
+		dm_bio_restore(h->details, bio);
+		remap_to_cache(cache, bio, h->cblock);
+
+		spin_lock_irqsave(&cache->lock, flags);
+		bio_list_add(&cache->deferred_writethrough_bios, bio);
+		spin_unlock_irqrestore(&cache->lock, flags);
+
+		wake_worker(cache);
+		return DM_ENDIO_INCOMPLETE;
+	}
+
+	if (h->all_io_entry) {
+		INIT_LIST_HEAD(&work);
+		ds_dec(h->all_io_entry, &work);
+		if (!list_empty(&work)) {
+			spin_lock_irqsave(&cache->lock, flags);
+			list_splice_tail(&work, &cache->quiesced_migrations);
+			spin_unlock_irqrestore(&cache->lock, flags);
+			wake_worker(cache);
+		}
+	}
+
+	if (h->details)
+		mempool_free(h->details, cache->bio_details_pool);
+	mempool_free(h, cache->endio_hook_pool);
+
+	return 0;
+}
+
+static void cache_presuspend(struct dm_target *ti)
+{
+	struct cache *cache = ti->private;
+
+	spin_lock_irq(&cache->lock);
+	cache->quiescing = true;
+	spin_unlock_irq(&cache->lock);
+}
+
+static void cache_postsuspend(struct dm_target *ti)
+{
+	struct cache *cache = ti->private;
+
+	cancel_delayed_work_sync(&cache->waker);
+	wait_event(cache->migration_wait, !cache->nr_migrations);
+	flush_workqueue(cache->wq);
+
+	commit(cache, true);
+}
+
+static int load_mapping(void *context, dm_oblock_t oblock, dm_cblock_t cblock,
+			bool dirty)
+{
+	struct cache *cache = context;
+	int r;
+
+	r = cache->policy->load_mapping(cache->policy, oblock, cblock);
+	if (r)
+		return r;
+
+	if (dirty)
+		__set_dirty(cache, cblock);
+
+	return 0;
+}
+
+static int cache_preresume(struct dm_target *ti)
+{
+	struct cache *cache = ti->private;
+	int r;
+
+	/*
+	 * The mappings are only loaded now, an old table using the same
+	 * metadata has committed its last changes by the time we get here.
+	 */
+	if (!cache->loaded_mappings) {
+		r = dm_cache_load_mappings(cache->cmd, load_mapping, cache);
+		if (r) {
+			DMERR("could not load cache mappings");
+			return r;
+		}
+		cache->loaded_mappings = true;
+	}
+
+	/* mark the metadata as in use so that a crash is noticed */
+	return commit(cache, false);
+}
+
+static void cache_resume(struct dm_target *ti)
+{
+	struct cache *cache = ti->private;
+
+	spin_lock_irq(&cache->lock);
+	cache->quiescing = false;
+	spin_unlock_irq(&cache->lock);
+
+	queue_delayed_work(cache->wq, &cache->waker, 0);
+}
+
+/*
+ * Status format:
+ *
+ * <used metadata blocks>/<total metadata blocks>
+ * <used cache blocks>/<total cache blocks>
+ * <read hits> <read misses> <write hits> <write misses>
+ * <demotions> <promotions> <writebacks> <dirty blocks>
+ * <#features> <features>* <policy name> <policy info>*
+ */
+static int cache_status(struct dm_target *ti, status_type_t type,
+			unsigned status_flags, char *result, unsigned maxlen)
+{
+	struct cache *cache = ti->private;
+	unsigned sz = 0;
+	sector_t md_used, md_total;
+	char buf[BDEVNAME_SIZE];
+
+	switch (type) {
+	case STATUSTYPE_INFO:
+		dm_cache_metadata_usage(cache->cmd, &md_used, &md_total);
+
+		DMEMIT("%llu/%llu %u/%u %u %u %u %u %u %u %u %u 1 %s %s ",
+		       (unsigned long long) md_used,
+		       (unsigned long long) md_total,
+		       (unsigned) cache->policy->residency(cache->policy),
+		       (unsigned) cache->cache_size,
+		       (unsigned) atomic_read(&cache->stats.read_hit),
+		       (unsigned) atomic_read(&cache->stats.read_miss),
+		       (unsigned) atomic_read(&cache->stats.write_hit),
+		       (unsigned) atomic_read(&cache->stats.write_miss),
+		       (unsigned) atomic_read(&cache->stats.demotion),
+		       (unsigned) atomic_read(&cache->stats.promotion),
+		       (unsigned) atomic_read(&cache->stats.writeback),
+		       (unsigned) cache->nr_dirty,
+		       cache->writethrough ? "writethrough" : "writeback",
+		       dm_cache_policy_get_name(cache->policy));
+		break;
+
+	case STATUSTYPE_TABLE:
+		DMEMIT("%s ", format_dev_t(buf, cache->metadata_dev->bdev->bd_dev));
+		DMEMIT("%s ", format_dev_t(buf, cache->cache_dev->bdev->bd_dev));
+		DMEMIT("%s ", format_dev_t(buf, cache->origin_dev->bdev->bd_dev));
+		DMEMIT("%llu 1 %s %s ",
+		       (unsigned long long) cache->sectors_per_block,
+		       cache->writethrough ? "writethrough" : "writeback",
+		       dm_cache_policy_get_name(cache->policy));
+		break;
+	}
+
+	if (sz < maxlen)
+		cache->policy->status(cache->policy, type, result + sz,
+				      maxlen - sz);
+
+	return 0;
+}
+
+static int cache_iterate_devices(struct dm_target *ti,
+				 iterate_devices_callout_fn fn, void *data)
+{
+	struct cache *cache = ti->private;
+	int r;
+
+	r = fn(ti, cache->cache_dev, 0, get_dev_size(cache->cache_dev), data);
+	if (!r)
+		r = fn(ti, cache->origin_dev, 0, ti->len, data);
+
+	return r;
+}
+
+static void cache_io_hints(struct dm_target *ti, struct queue_limits *limits)
+{
+	struct cache *cache = ti->private;
+
+	blk_limits_io_min(limits, 0);
+	blk_limits_io_opt(limits, cache->sectors_per_block << SECTOR_SHIFT);
+}
+
+static struct target_type cache_target = {
+	.name = "cache",
+	.version = {1, 0, 0},
+	.module = THIS_MODULE,
+	.ctr = cache_ctr,
+	.dtr = cache_dtr,
+	.map = cache_map,
+	.end_io = cache_end_io,
+	.presuspend = cache_presuspend,
+	.postsuspend = cache_postsuspend,
+	.preresume = cache_preresume,
+	.resume = cache_resume,
+	.status = cache_status,
+	.iterate_devices = cache_iterate_devices,
+	.io_hints = cache_io_hints,
+};
+
+static int __init dm_cache_init(void)
+{
+	int r;
+
+	r = dm_register_target(&cache_target);
+	if (r) {
+		DMERR("cache target registration failed: %d", r);
+		return r;
+	}
+
+	r = -ENOMEM;
+
+	_endio_hook_cache = KMEM_CACHE(dm_cache_endio_hook, 0);
+	if (!_endio_hook_cache)
+		goto bad_endio_hook_cache;
+
+	_migration_cache = KMEM_CACHE(dm_cache_migration, 0);
+	if (!_migration_cache)
+		goto bad_migration_cache;
+
+	return 0;
+
+bad_migration_cache:
+	kmem_cache_destroy(_endio_hook_cache);
+bad_endio_hook_cache:
+	dm_unregister_target(&cache_target);
+
+	return r;
+}
+
+static void __exit dm_cache_exit(void)
+{
+	dm_unregister_target(&cache_target);
+
+	kmem_cache_destroy(_endio_hook_cache);
+	kmem_cache_destroy(_migration_cache);
+}
+
+module_init(dm_cache_init);
+module_exit(dm_cache_exit);
+
+MODULE_DESCRIPTION(DM_NAME " cache target");
+MODULE_LICENSE("GPL");
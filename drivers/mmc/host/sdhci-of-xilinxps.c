@@ -261,6 +261,7 @@ static struct platform_driver sdhci_zynq_driver = {
 		.owner = THIS_MODULE,
 		.of_match_table = sdhci_zynq_of_match,
 		.pm = XSDHCIPS_PM,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe = sdhci_zynq_probe,
 	.remove = __devexit_p(sdhci_zynq_remove),
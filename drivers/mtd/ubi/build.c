@@ -1218,7 +1218,8 @@ out:
 	ubi_err("UBI error: cannot initialize UBI, error %d", err);
 	return err;
 }
-module_init(ubi_init);
+/* attaching may scan every eraseblock, let the rest of the boot go on */
+device_initcall_async(ubi_init);
 
 static void __exit ubi_exit(void)
 {
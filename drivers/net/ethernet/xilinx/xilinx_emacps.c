@@ -3244,6 +3244,7 @@ static struct platform_driver xemacps_driver = {
 		.owner = THIS_MODULE,
 		.of_match_table = xemacps_of_match,
 		.pm = XEMACPS_PM,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 };
 
@@ -272,6 +272,7 @@ static struct platform_driver xusbps_dr_driver = {
 		.name = "xusbps-dr",
 		.owner = THIS_MODULE,
 		.of_match_table = xusbps_dr_of_match,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe	= xusbps_dr_of_probe,
 	.remove	= __devexit_p(xusbps_dr_of_remove),
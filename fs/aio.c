@@ -55,6 +55,7 @@ static struct kmem_cache	*kiocb_cachep;
 static struct kmem_cache	*kioctx_cachep;
 
 static struct workqueue_struct *aio_wq;
+static struct workqueue_struct *aio_read_wq;
 
 static void aio_kick_handler(struct work_struct *);
 static void aio_queue_work(struct kioctx *);
@@ -70,6 +71,8 @@ static int __init aio_setup(void)
 
 	aio_wq = alloc_workqueue("aio", 0, 1);	/* used to limit concurrency */
 	BUG_ON(!aio_wq);
+	aio_read_wq = alloc_workqueue("aio_read", WQ_UNBOUND, 0);
+	BUG_ON(!aio_read_wq);
 
 	pr_debug("aio_setup: sizeof(struct page) = %d\n", (int)sizeof(struct page));
 
@@ -1350,6 +1353,96 @@ static ssize_t aio_rw_vect_retry(struct kiocb *iocb)
 	return ret;
 }
 
+/*
+ * Buffered reads larger than this are never attempted inline, checking
+ * the page cache for them costs more than the context switch we save.
+ */
+#define AIO_READ_INLINE_PAGES	16
+
+/*
+ * Returns true if every page backing the remaining range of a buffered
+ * read is already uptodate in the page cache, so that ->aio_read() can
+ * complete it without waiting for I/O.
+ */
+static bool aio_read_cached(struct kiocb *iocb)
+{
+	struct address_space *mapping = iocb->ki_filp->f_mapping;
+	pgoff_t index, end;
+
+	if (!iocb->ki_left)
+		return true;
+
+	index = iocb->ki_pos >> PAGE_CACHE_SHIFT;
+	end = (iocb->ki_pos + iocb->ki_left - 1) >> PAGE_CACHE_SHIFT;
+	if (end - index >= AIO_READ_INLINE_PAGES)
+		return false;
+
+	for (; index <= end; index++) {
+		struct page *page = find_get_page(mapping, index);
+		bool uptodate = page && PageUptodate(page);
+
+		if (page)
+			page_cache_release(page);
+		if (!uptodate)
+			return false;
+	}
+	return true;
+}
+
+static void aio_read_work(struct work_struct *work)
+{
+	struct kiocb *iocb = container_of(work, struct kiocb, ki_work);
+	struct mm_struct *mm = iocb->ki_ctx->mm;
+	mm_segment_t oldfs = get_fs();
+	ssize_t ret;
+
+	if (kiocbIsCancelled(iocb)) {
+		aio_complete(iocb, -EINTR, 0);
+		return;
+	}
+
+	set_fs(USER_DS);
+	use_mm(mm);
+	ret = aio_rw_vect_retry(iocb);
+	unuse_mm(mm);
+	set_fs(oldfs);
+
+	if (ret == -EIOCBQUEUED)
+		return;
+	if (unlikely(ret == -ERESTARTSYS || ret == -ERESTARTNOINTR ||
+		     ret == -ERESTARTNOHAND || ret == -ERESTART_RESTARTBLOCK ||
+		     ret == -EIOCBRETRY))
+		ret = -EINTR;
+	aio_complete(iocb, ret, 0);
+}
+
+/*
+ * Buffered reads go through the page cache and ->aio_read() waits for
+ * any missing pages synchronously, which would otherwise block the
+ * io_submit() caller.  Reads that are fully cached are done inline;
+ * everything else is handed to aio_read_wq, which performs the read in
+ * the submitter's mm and completes the iocb from there.
+ */
+static ssize_t aio_buffered_read_retry(struct kiocb *iocb)
+{
+	if (aio_read_cached(iocb))
+		return aio_rw_vect_retry(iocb);
+
+	INIT_WORK(&iocb->ki_work, aio_read_work);
+	queue_work(aio_read_wq, &iocb->ki_work);
+	return -EIOCBQUEUED;
+}
+
+/*
+ * Only regular files opened without O_DIRECT read through the page
+ * cache; direct I/O already queues its bios and returns -EIOCBQUEUED.
+ */
+static inline bool aio_read_is_buffered(struct file *file)
+{
+	return !(file->f_flags & O_DIRECT) &&
+		S_ISREG(file->f_mapping->host->i_mode);
+}
+
 static ssize_t aio_fdsync(struct kiocb *iocb)
 {
 	struct file *file = iocb->ki_filp;
@@ -1444,7 +1537,8 @@ static ssize_t aio_setup_iocb(struct kiocb *kiocb, bool compat)
 			break;
 		ret = -EINVAL;
 		if (file->f_op->aio_read)
-			kiocb->ki_retry = aio_rw_vect_retry;
+			kiocb->ki_retry = aio_read_is_buffered(file) ?
+				aio_buffered_read_retry : aio_rw_vect_retry;
 		break;
 	case IOCB_CMD_PWRITE:
 		ret = -EBADF;
@@ -1470,7 +1564,8 @@ static ssize_t aio_setup_iocb(struct kiocb *kiocb, bool compat)
 			break;
 		ret = -EINVAL;
 		if (file->f_op->aio_read)
-			kiocb->ki_retry = aio_rw_vect_retry;
+			kiocb->ki_retry = aio_read_is_buffered(file) ?
+				aio_buffered_read_retry : aio_rw_vect_retry;
 		break;
 	case IOCB_CMD_PWRITEV:
 		ret = -EBADF;
@@ -27,6 +27,7 @@
 #include <linux/namei.h>
 #include <linux/log2.h>
 #include <linux/cleancache.h>
+#include <linux/task_io_accounting_ops.h>
 #include <asm/uaccess.h>
 #include "internal.h"
 
@@ -209,14 +210,289 @@ blkdev_get_blocks(struct inode *inode, sector_t iblock,
 	return 0;
 }
 
+/*
+ * Synchronous direct I/O to a block device needs none of the block mapping
+ * done by __blockdev_direct_IO(): the file offset is the device offset.
+ * Requests that fit in DIO_INLINE_BIO_VECS pages of a single segment are
+ * issued as one bio on the stack, anything larger as a chain of bios that
+ * is tracked by a struct blkdev_dio on the stack.  Async iocbs still go
+ * through the generic code.
+ */
+#define DIO_INLINE_BIO_VECS	4
+#define DIO_PAGE_BATCH		16
+
+static void blkdev_bio_end_io_simple(struct bio *bio, int error)
+{
+	struct task_struct *waiter = bio->bi_private;
+
+	ACCESS_ONCE(bio->bi_private) = NULL;
+	wake_up_process(waiter);
+}
+
+static void blkdev_dio_wait(struct block_device *bdev, ktime_t start,
+			    void **done)
+{
+	for (;;) {
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		if (!ACCESS_ONCE(*done))
+			break;
+		if (!blk_poll(bdev_get_queue(bdev), start))
+			io_schedule();
+	}
+	__set_current_state(TASK_RUNNING);
+}
+
+static ssize_t
+__blkdev_direct_IO_simple(int rw, struct block_device *bdev,
+			  unsigned long uaddr, size_t count, loff_t pos)
+{
+	struct bio_vec inline_vecs[DIO_INLINE_BIO_VECS];
+	struct page *pages[DIO_INLINE_BIO_VECS];
+	unsigned int offset = uaddr & ~PAGE_MASK;
+	int nr_pages = DIV_ROUND_UP(offset + count, PAGE_SIZE);
+	size_t left = count;
+	struct bio bio;
+	ktime_t start;
+	ssize_t ret;
+	int i;
+
+	ret = get_user_pages_fast(uaddr, nr_pages, rw == READ, pages);
+	if (ret < nr_pages) {
+		for (i = 0; i < ret; i++)
+			put_page(pages[i]);
+		return ret < 0 ? ret : -EFAULT;
+	}
+
+	bio_init(&bio);
+	bio.bi_io_vec = inline_vecs;
+	bio.bi_max_vecs = DIO_INLINE_BIO_VECS;
+	bio.bi_bdev = bdev;
+	bio.bi_sector = pos >> 9;
+	bio.bi_private = current;
+	bio.bi_end_io = blkdev_bio_end_io_simple;
+
+	for (i = 0; i < nr_pages; i++) {
+		unsigned int len = min_t(size_t, PAGE_SIZE - offset, left);
+
+		if (bio_add_page(&bio, pages[i], len, offset) != len) {
+			/* queue limits too small, let the caller split it */
+			for (i = 0; i < nr_pages; i++)
+				put_page(pages[i]);
+			return -EAGAIN;
+		}
+		left -= len;
+		offset = 0;
+	}
+
+	if (rw == WRITE) {
+		task_io_account_write(count);
+		rw = WRITE_ODIRECT;
+	}
+
+	start = ktime_get();
+	submit_bio(rw, &bio);
+	blkdev_dio_wait(bdev, start, &bio.bi_private);
+
+	/*
+	 * The bio never goes through bio_put(), drop the io_context and
+	 * cgroup references the block layer takes when it is throttled.
+	 * Devices with integrity metadata never get here.
+	 */
+	bio_disassociate_task(&bio);
+
+	for (i = 0; i < nr_pages; i++) {
+		if (rw == READ && !PageCompound(pages[i]))
+			set_page_dirty_lock(pages[i]);
+		put_page(pages[i]);
+	}
+
+	if (!test_bit(BIO_UPTODATE, &bio.bi_flags))
+		return -EIO;
+	return count;
+}
+
+struct blkdev_dio {
+	atomic_t		ref;		/* bios in flight, plus one */
+	struct task_struct	*waiter;
+	void			*pending;	/* cleared when ref drops to 0 */
+	int			error;
+};
+
+static void blkdev_bio_end_io(struct bio *bio, int error)
+{
+	struct blkdev_dio *dio = bio->bi_private;
+	struct task_struct *waiter = dio->waiter;
+
+	if (error)
+		dio->error = error;
+
+	if (bio_data_dir(bio) == READ) {
+		/* releases the pages and the bio */
+		bio_check_pages_dirty(bio);
+	} else {
+		struct bio_vec *bvec;
+		int i;
+
+		__bio_for_each_segment(bvec, bio, i, 0)
+			put_page(bvec->bv_page);
+		bio_put(bio);
+	}
+
+	if (atomic_dec_and_test(&dio->ref)) {
+		ACCESS_ONCE(dio->pending) = NULL;
+		wake_up_process(waiter);
+	}
+}
+
+static void blkdev_dio_submit(int rw, struct blkdev_dio *dio, struct bio *bio)
+{
+	atomic_inc(&dio->ref);
+	if (rw == READ)
+		bio_set_pages_dirty(bio);
+	submit_bio(rw == WRITE ? WRITE_ODIRECT : READ, bio);
+}
+
+static ssize_t
+__blkdev_direct_IO(int rw, struct block_device *bdev, const struct iovec *iov,
+		   unsigned long nr_segs, size_t count, loff_t pos)
+{
+	struct blkdev_dio dio;
+	struct blk_plug plug;
+	struct bio *bio = NULL;
+	sector_t sector = pos >> 9;
+	ktime_t start = ktime_get();
+	size_t done = 0;
+	unsigned long seg;
+	ssize_t ret = 0;
+
+	atomic_set(&dio.ref, 1);
+	dio.waiter = current;
+	dio.pending = &dio;
+	dio.error = 0;
+
+	blk_start_plug(&plug);
+	for (seg = 0; seg < nr_segs && done < count; seg++) {
+		unsigned long uaddr = (unsigned long)iov[seg].iov_base;
+		size_t len = min(iov[seg].iov_len, count - done);
+
+		while (len) {
+			struct page *pages[DIO_PAGE_BATCH];
+			unsigned int offset = uaddr & ~PAGE_MASK;
+			int nr, got, i;
+
+			nr = min_t(size_t, DIO_PAGE_BATCH,
+				   DIV_ROUND_UP(offset + len, PAGE_SIZE));
+			got = get_user_pages_fast(uaddr, nr, rw == READ, pages);
+			if (got <= 0) {
+				ret = got < 0 ? got : -EFAULT;
+				goto submit;
+			}
+
+			for (i = 0; i < got; i++) {
+				unsigned int plen = min_t(size_t,
+							  PAGE_SIZE - offset, len);
+
+				if (!bio) {
+					bio = bio_alloc(GFP_KERNEL,
+						min_t(size_t, BIO_MAX_PAGES,
+						      DIV_ROUND_UP(count - done,
+								   PAGE_SIZE) + 1));
+					bio->bi_bdev = bdev;
+					bio->bi_sector = sector;
+					bio->bi_private = &dio;
+					bio->bi_end_io = blkdev_bio_end_io;
+				}
+
+				if (bio_add_page(bio, pages[i], plen, offset) !=
+				    plen) {
+					if (!bio->bi_vcnt) {
+						/* not even one page fits */
+						while (i < got)
+							put_page(pages[i++]);
+						ret = -EINVAL;
+						goto submit;
+					}
+					blkdev_dio_submit(rw, &dio, bio);
+					bio = NULL;
+					i--;
+					continue;
+				}
+
+				if (rw == WRITE)
+					task_io_account_write(plen);
+				sector += plen >> 9;
+				uaddr += plen;
+				len -= plen;
+				done += plen;
+				offset = 0;
+			}
+		}
+	}
+
+submit:
+	if (bio) {
+		if (bio->bi_vcnt)
+			blkdev_dio_submit(rw, &dio, bio);
+		else
+			bio_put(bio);
+	}
+	blk_finish_plug(&plug);
+
+	if (!atomic_dec_and_test(&dio.ref))
+		blkdev_dio_wait(bdev, start, &dio.pending);
+
+	if (dio.error)
+		return -EIO;
+	if (done)
+		return done;
+	return ret;
+}
+
 static ssize_t
 blkdev_direct_IO(int rw, struct kiocb *iocb, const struct iovec *iov,
 			loff_t offset, unsigned long nr_segs)
 {
 	struct file *file = iocb->ki_filp;
 	struct inode *inode = file->f_mapping->host;
+	struct block_device *bdev = I_BDEV(inode);
+	unsigned int mask = bdev_logical_block_size(bdev) - 1;
+	size_t count = 0;
+	loff_t size;
+	unsigned long seg;
+	ssize_t ret;
+
+	if (!is_sync_kiocb(iocb) || bdev_get_integrity(bdev))
+		goto generic;
+
+	if (offset & mask)
+		return -EINVAL;
+	for (seg = 0; seg < nr_segs; seg++) {
+		if (((unsigned long)iov[seg].iov_base | iov[seg].iov_len) & mask)
+			return -EINVAL;
+		count += iov[seg].iov_len;
+	}
+
+	size = i_size_read(inode);
+	if (offset >= size)
+		return rw == READ ? 0 : -EIO;
+	if (count > size - offset)
+		count = size - offset;
+	if (!count)
+		return 0;
+
+	if (nr_segs == 1 &&
+	    DIV_ROUND_UP(((unsigned long)iov->iov_base & ~PAGE_MASK) + count,
+			 PAGE_SIZE) <= DIO_INLINE_BIO_VECS) {
+		ret = __blkdev_direct_IO_simple(rw, bdev,
+				(unsigned long)iov->iov_base, count, offset);
+		if (ret != -EAGAIN)
+			return ret;
+	}
+
+	return __blkdev_direct_IO(rw, bdev, iov, nr_segs, count, offset);
 
-	return __blockdev_direct_IO(rw, iocb, inode, I_BDEV(inode), iov, offset,
+generic:
+	return __blockdev_direct_IO(rw, iocb, inode, bdev, iov, offset,
 				    nr_segs, blkdev_get_blocks, NULL, NULL, 0);
 }
 
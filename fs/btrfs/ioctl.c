@@ -2336,12 +2336,11 @@ out:
 	return ret;
 }
 
-static noinline long btrfs_ioctl_clone(struct file *file, unsigned long srcfd,
+static noinline long btrfs_clone_files(struct file *file, struct file *src_file,
 				       u64 off, u64 olen, u64 destoff)
 {
 	struct inode *inode = fdentry(file)->d_inode;
 	struct btrfs_root *root = BTRFS_I(inode)->root;
-	struct file *src_file;
 	struct inode *src;
 	struct btrfs_trans_handle *trans;
 	struct btrfs_path *path;
@@ -2365,59 +2364,38 @@ static noinline long btrfs_ioctl_clone(struct file *file, unsigned long srcfd,
 	 *   they don't overlap)?
 	 */
 
-	/* the destination must be opened for writing */
-	if (!(file->f_mode & FMODE_WRITE) || (file->f_flags & O_APPEND))
-		return -EINVAL;
-
-	if (btrfs_root_readonly(root))
-		return -EROFS;
-
-	ret = mnt_want_write_file(file);
-	if (ret)
-		return ret;
-
-	src_file = fget(srcfd);
-	if (!src_file) {
-		ret = -EBADF;
-		goto out_drop_write;
-	}
-
-	ret = -EXDEV;
-	if (src_file->f_path.mnt != file->f_path.mnt)
-		goto out_fput;
-
 	src = src_file->f_dentry->d_inode;
 
 	ret = -EINVAL;
 	if (src == inode)
-		goto out_fput;
+		return ret;
 
 	/* the src must be open for reading */
 	if (!(src_file->f_mode & FMODE_READ))
-		goto out_fput;
+		return ret;
 
 	/* don't make the dst file partly checksummed */
 	if ((BTRFS_I(src)->flags & BTRFS_INODE_NODATASUM) !=
 	    (BTRFS_I(inode)->flags & BTRFS_INODE_NODATASUM))
-		goto out_fput;
+		return ret;
 
 	ret = -EISDIR;
 	if (S_ISDIR(src->i_mode) || S_ISDIR(inode->i_mode))
-		goto out_fput;
+		return ret;
 
 	ret = -EXDEV;
 	if (src->i_sb != inode->i_sb)
-		goto out_fput;
+		return ret;
 
 	ret = -ENOMEM;
 	buf = vmalloc(btrfs_level_size(root, 0));
 	if (!buf)
-		goto out_fput;
+		return ret;
 
 	path = btrfs_alloc_path();
 	if (!path) {
 		vfree(buf);
-		goto out_fput;
+		return ret;
 	}
 	path->reada = 2;
 
@@ -2723,6 +2701,40 @@ out_unlock:
 	mutex_unlock(&inode->i_mutex);
 	vfree(buf);
 	btrfs_free_path(path);
+	return ret;
+}
+
+static noinline long btrfs_ioctl_clone(struct file *file, unsigned long srcfd,
+				       u64 off, u64 olen, u64 destoff)
+{
+	struct inode *inode = fdentry(file)->d_inode;
+	struct btrfs_root *root = BTRFS_I(inode)->root;
+	struct file *src_file;
+	int ret;
+
+	/* the destination must be opened for writing */
+	if (!(file->f_mode & FMODE_WRITE) || (file->f_flags & O_APPEND))
+		return -EINVAL;
+
+	if (btrfs_root_readonly(root))
+		return -EROFS;
+
+	ret = mnt_want_write_file(file);
+	if (ret)
+		return ret;
+
+	src_file = fget(srcfd);
+	if (!src_file) {
+		ret = -EBADF;
+		goto out_drop_write;
+	}
+
+	ret = -EXDEV;
+	if (src_file->f_path.mnt != file->f_path.mnt)
+		goto out_fput;
+
+	ret = btrfs_clone_files(file, src_file, off, olen, destoff);
+
 out_fput:
 	fput(src_file);
 out_drop_write:
@@ -2730,6 +2742,47 @@ out_drop_write:
 	return ret;
 }
 
+/*
+ * copy_file_range shares the extents when it can, that is for block
+ * aligned ranges of two different files.  Anything else is left to the
+ * generic copy.
+ */
+ssize_t btrfs_copy_file_range(struct file *file_in, loff_t pos_in,
+			      struct file *file_out, loff_t pos_out,
+			      size_t len, unsigned int flags)
+{
+	struct inode *src = fdentry(file_in)->d_inode;
+	struct inode *inode = fdentry(file_out)->d_inode;
+	struct btrfs_root *root = BTRFS_I(inode)->root;
+	u64 bs = root->fs_info->sb->s_blocksize;
+	u64 isize = i_size_read(src);
+	long ret;
+
+	if (pos_in >= isize)
+		return 0;
+	if (pos_in + len > isize)
+		len = isize - pos_in;
+
+	if (!IS_ALIGNED(pos_in, bs) || !IS_ALIGNED(pos_out, bs) ||
+	    (!IS_ALIGNED(pos_in + len, bs) && pos_in + len != isize))
+		return -EOPNOTSUPP;
+
+	if (btrfs_root_readonly(root))
+		return -EROFS;
+
+	ret = mnt_want_write_file(file_out);
+	if (ret)
+		return ret;
+
+	ret = btrfs_clone_files(file_out, file_in, pos_in, len, pos_out);
+	mnt_drop_write_file(file_out);
+
+	/* the source changed under us, or the files can't share extents */
+	if (ret == -EINVAL)
+		return -EOPNOTSUPP;
+	return ret ? ret : len;
+}
+
 static long btrfs_ioctl_clone_range(struct file *file, void __user *argp)
 {
 	struct btrfs_ioctl_clone_range_args args;
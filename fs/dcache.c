@@ -117,6 +117,19 @@ struct dentry_stat_t dentry_stat = {
 	.age_limit = 45,
 };
 
+/*
+ * Negative dentries are cheap to create and nothing but memory pressure
+ * gets rid of them, so a workload looking up lots of names that do not
+ * exist can fill the LRU with them and push out the dentries that are
+ * actually being used.  Each superblock may keep this many unused negative
+ * dentries; past that dput() reclaims the oldest ones.  0 means no limit.
+ */
+int sysctl_negative_dentry_limit __read_mostly;
+
+/* one reclaim pass frees up to BATCH dentries, looking at up to SCAN */
+#define NEGATIVE_PRUNE_BATCH	32
+#define NEGATIVE_PRUNE_SCAN	128
+
 static DEFINE_PER_CPU(unsigned int, nr_dentry);
 
 #if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
@@ -303,17 +316,62 @@ static void dentry_unlink_inode(struct dentry * dentry)
 		iput(inode);
 }
 
+/*
+ * Unused negative dentries are kept on an LRU of their own,
+ * sb->s_negative_lru, so that they can be reclaimed without walking past
+ * the positive ones.  DCACHE_NEGATIVE_LRU marks the dentries on it, which
+ * are counted per superblock.  Both must be called with d_lock and
+ * dcache_lru_lock held.
+ */
+static inline void dentry_negative_add(struct dentry *dentry)
+{
+	if (!(dentry->d_flags & DCACHE_NEGATIVE_LRU)) {
+		dentry->d_flags |= DCACHE_NEGATIVE_LRU;
+		atomic_inc(&dentry->d_sb->s_nr_negative);
+	}
+}
+
+static inline void dentry_negative_del(struct dentry *dentry)
+{
+	if (dentry->d_flags & DCACHE_NEGATIVE_LRU) {
+		dentry->d_flags &= ~DCACHE_NEGATIVE_LRU;
+		atomic_dec(&dentry->d_sb->s_nr_negative);
+	}
+}
+
+static inline bool negative_dentries_over_limit(struct super_block *sb)
+{
+	int limit = ACCESS_ONCE(sysctl_negative_dentry_limit);
+
+	return limit && atomic_read(&sb->s_nr_negative) >= limit;
+}
+
 /*
  * dentry_lru_(add|del|prune|move_tail) must be called with d_lock held.
  */
 static void dentry_lru_add(struct dentry *dentry)
 {
+	struct super_block *sb = dentry->d_sb;
+
 	if (list_empty(&dentry->d_lru)) {
 		spin_lock(&dcache_lru_lock);
-		list_add(&dentry->d_lru, &dentry->d_sb->s_dentry_lru);
-		dentry->d_sb->s_nr_dentry_unused++;
+		if (dentry->d_inode) {
+			list_add(&dentry->d_lru, &sb->s_dentry_lru);
+		} else {
+			list_add(&dentry->d_lru, &sb->s_negative_lru);
+			dentry_negative_add(dentry);
+		}
+		sb->s_nr_dentry_unused++;
 		dentry_stat.nr_unused++;
 		spin_unlock(&dcache_lru_lock);
+	} else if (!dentry->d_inode &&
+		   !(dentry->d_flags & (DCACHE_NEGATIVE_LRU |
+					DCACHE_SHRINK_LIST))) {
+		/* turned negative while on the LRU, as by d_delete() */
+		spin_lock(&dcache_lru_lock);
+		list_move(&dentry->d_lru, &sb->s_negative_lru);
+		dentry_negative_add(dentry);
+		spin_unlock(&dcache_lru_lock);
 	}
 }
 
@@ -321,6 +379,7 @@ static void __dentry_lru_del(struct dentry *dentry)
 {
 	list_del_init(&dentry->d_lru);
 	dentry->d_flags &= ~DCACHE_SHRINK_LIST;
+	dentry_negative_del(dentry);
 	dentry->d_sb->s_nr_dentry_unused--;
 	dentry_stat.nr_unused--;
 }
@@ -363,6 +422,7 @@ static void dentry_lru_move_list(struct dentry *dentry, struct list_head *list)
 		dentry_stat.nr_unused++;
 	} else {
 		list_move_tail(&dentry->d_lru, list);
+		dentry_negative_del(dentry);
 	}
 	spin_unlock(&dcache_lru_lock);
 }
@@ -514,6 +574,50 @@ relock:
 	return d_kill(dentry, parent);
 }
 
+static void shrink_dentry_list(struct list_head *list);
+
+/*
+ * Reclaim unused negative dentries from the cold end of the superblock's
+ * negative LRU.  Every dentry looked at changes state: busy ones leave
+ * the LRU as they would in the shrinker, recently referenced ones lose
+ * the flag and go round once more, the rest are freed.  So each call
+ * makes progress however the list is made up, and the scan is bounded
+ * to keep dput() cheap.
+ */
+static void prune_negative_dentries(struct super_block *sb)
+{
+	struct dentry *dentry, *next;
+	int scan = NEGATIVE_PRUNE_SCAN;
+	int nr = 0;
+	LIST_HEAD(tmp);
+
+	spin_lock(&dcache_lru_lock);
+	list_for_each_entry_safe_reverse(dentry, next, &sb->s_negative_lru,
+					 d_lru) {
+		if (!scan-- || nr == NEGATIVE_PRUNE_BATCH)
+			break;
+		if (!spin_trylock(&dentry->d_lock))
+			continue;
+
+		if (dentry->d_count) {
+			/* dput() puts it back */
+			__dentry_lru_del(dentry);
+		} else if (dentry->d_flags & DCACHE_REFERENCED) {
+			dentry->d_flags &= ~DCACHE_REFERENCED;
+			list_move(&dentry->d_lru, &sb->s_negative_lru);
+		} else {
+			list_move_tail(&dentry->d_lru, &tmp);
+			dentry->d_flags |= DCACHE_SHRINK_LIST;
+			dentry_negative_del(dentry);
+			nr++;
+		}
+		spin_unlock(&dentry->d_lock);
+	}
+	spin_unlock(&dcache_lru_lock);
+
+	shrink_dentry_list(&tmp);
+}
+
 /* 
  * This is dput
  *
@@ -542,6 +646,8 @@ relock:
  */
 void dput(struct dentry *dentry)
 {
+	bool pruned = false;
+
 	if (!dentry)
 		return;
 
@@ -570,6 +676,19 @@ repeat:
 	 * is more likely to be cleaned up by the dcache shrinker in case of
 	 * memory pressure.
 	 */
+	if (!dentry->d_inode) {
+		/*
+		 * Make room among this superblock's negative dentries.  We
+		 * still hold our reference, so the superblock stays around
+		 * and this dentry is not a candidate itself.
+		 */
+		if (!pruned && negative_dentries_over_limit(dentry->d_sb)) {
+			spin_unlock(&dentry->d_lock);
+			prune_negative_dentries(dentry->d_sb);
+			pruned = true;
+			goto repeat;
+		}
+	}
 	if (!d_need_lookup(dentry))
 		dentry->d_flags |= DCACHE_REFERENCED;
 	dentry_lru_add(dentry);
@@ -849,29 +968,21 @@ static void shrink_dentry_list(struct list_head *list)
 	rcu_read_unlock();
 }
 
-/**
- * prune_dcache_sb - shrink the dcache
- * @sb: superblock
- * @count: number of entries to try to free
- *
- * Attempt to shrink the superblock dcache LRU by @count entries. This is
- * done when we need more memory an called from the superblock shrinker
- * function.
- *
- * This function may fail to free any resources if all the dentries are in
- * use.
+/*
+ * Move up to @count unused dentries from the cold end of @lru to @dispose,
+ * giving referenced ones another round.  Returns how many of @count are
+ * left.
  */
-void prune_dcache_sb(struct super_block *sb, int count)
+static int __prune_dcache_lru(struct super_block *sb, struct list_head *lru,
+			      int count, struct list_head *dispose)
 {
 	struct dentry *dentry;
 	LIST_HEAD(referenced);
-	LIST_HEAD(tmp);
 
 relock:
 	spin_lock(&dcache_lru_lock);
-	while (!list_empty(&sb->s_dentry_lru)) {
-		dentry = list_entry(sb->s_dentry_lru.prev,
-				struct dentry, d_lru);
+	while (!list_empty(lru)) {
+		dentry = list_entry(lru->prev, struct dentry, d_lru);
 		BUG_ON(dentry->d_sb != sb);
 
 		if (!spin_trylock(&dentry->d_lock)) {
@@ -885,8 +996,9 @@ relock:
 			list_move(&dentry->d_lru, &referenced);
 			spin_unlock(&dentry->d_lock);
 		} else {
-			list_move_tail(&dentry->d_lru, &tmp);
+			list_move_tail(&dentry->d_lru, dispose);
 			dentry->d_flags |= DCACHE_SHRINK_LIST;
+			dentry_negative_del(dentry);
 			spin_unlock(&dentry->d_lock);
 			if (!--count)
 				break;
@@ -894,9 +1006,33 @@ relock:
 		cond_resched_lock(&dcache_lru_lock);
 	}
 	if (!list_empty(&referenced))
-		list_splice(&referenced, &sb->s_dentry_lru);
+		list_splice(&referenced, lru);
 	spin_unlock(&dcache_lru_lock);
 
+	return count;
+}
+
+/**
+ * prune_dcache_sb - shrink the dcache
+ * @sb: superblock
+ * @count: number of entries to try to free
+ *
+ * Attempt to shrink the superblock dcache LRU by @count entries. This is
+ * done when we need more memory an called from the superblock shrinker
+ * function.
+ *
+ * This function may fail to free any resources if all the dentries are in
+ * use.
+ */
+void prune_dcache_sb(struct super_block *sb, int count)
+{
+	LIST_HEAD(tmp);
+
+	/* negative dentries are the cheapest to lose, they go first */
+	count = __prune_dcache_lru(sb, &sb->s_negative_lru, count, &tmp);
+	if (count)
+		__prune_dcache_lru(sb, &sb->s_dentry_lru, count, &tmp);
+
 	shrink_dentry_list(&tmp);
 }
 
@@ -912,8 +1048,10 @@ void shrink_dcache_sb(struct super_block *sb)
 	LIST_HEAD(tmp);
 
 	spin_lock(&dcache_lru_lock);
-	while (!list_empty(&sb->s_dentry_lru)) {
+	while (!list_empty(&sb->s_dentry_lru) ||
+	       !list_empty(&sb->s_negative_lru)) {
 		list_splice_init(&sb->s_dentry_lru, &tmp);
+		list_splice_init(&sb->s_negative_lru, &tmp);
 		spin_unlock(&dcache_lru_lock);
 		shrink_dentry_list(&tmp);
 		spin_lock(&dcache_lru_lock);
@@ -1407,6 +1545,12 @@ static void __d_instantiate(struct dentry *dentry, struct inode *inode)
 		if (unlikely(IS_AUTOMOUNT(inode)))
 			dentry->d_flags |= DCACHE_NEED_AUTOMOUNT;
 		hlist_add_head(&dentry->d_alias, &inode->i_dentry);
+		if (dentry->d_flags & DCACHE_NEGATIVE_LRU) {
+			spin_lock(&dcache_lru_lock);
+			list_move(&dentry->d_lru, &dentry->d_sb->s_dentry_lru);
+			dentry_negative_del(dentry);
+			spin_unlock(&dcache_lru_lock);
+		}
 	}
 	dentry->d_inode = inode;
 	dentry_rcuwalk_barrier(dentry);
@@ -3163,6 +3307,11 @@ void __init vfs_caches_init(unsigned long mempages)
 	reserve = min((mempages - nr_free_pages()) * 3/2, mempages - 1);
 	mempages -= reserve;
 
+	/* up to 2% of the remaining memory in negative dentries per sb */
+	sysctl_negative_dentry_limit = max_t(unsigned long, 1024,
+		min_t(unsigned long, INT_MAX,
+		      mempages / 50 * (PAGE_SIZE / sizeof(struct dentry))));
+
 	names_cachep = kmem_cache_create("names_cache", PATH_MAX, 0,
 			SLAB_HWCACHE_ALIGN|SLAB_PANIC, NULL);
 
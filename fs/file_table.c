@@ -339,11 +339,25 @@ void __fput_sync(struct file *file)
 
 EXPORT_SYMBOL(fput);
 
+/*
+ * When the fd table isn't shared nobody else can close the fd under us,
+ * so the file is known to be live and its count can be bumped without
+ * rcu or the inc_not_zero loop.
+ */
 struct file *fget(unsigned int fd)
 {
 	struct file *file;
 	struct files_struct *files = current->files;
 
+	if (atomic_read(&files->count) == 1) {
+		file = fcheck_files(files, fd);
+		if (file && (file->f_mode & FMODE_PATH))
+			file = NULL;
+		if (file)
+			get_file(file);
+		return file;
+	}
+
 	rcu_read_lock();
 	file = fcheck_files(files, fd);
 	if (file) {
@@ -364,6 +378,13 @@ struct file *fget_raw(unsigned int fd)
 	struct file *file;
 	struct files_struct *files = current->files;
 
+	if (atomic_read(&files->count) == 1) {
+		file = fcheck_files(files, fd);
+		if (file)
+			get_file(file);
+		return file;
+	}
+
 	rcu_read_lock();
 	file = fcheck_files(files, fd);
 	if (file) {
@@ -348,6 +348,7 @@ int __inode_permission(struct inode *inode, int mask)
 
 	return security_inode_permission(inode, mask);
 }
+EXPORT_SYMBOL(__inode_permission);
 
 /**
  * sb_permission - Check superblock-level permissions
@@ -867,6 +868,22 @@ int follow_up(struct path *path)
  * - return -EISDIR to tell follow_managed() to stop and return the path we
  *   were called with.
  */
+/*
+ * Would follow_automount() do anything but return -EISDIR?  A stat() of
+ * an automount point that is not mounted yet, the last component of most
+ * lookups that don't open or create it, leaves it alone, so rcu-walk can
+ * step onto it without dropping out.
+ */
+static inline bool automount_would_trigger(struct dentry *dentry,
+					   struct inode *inode, unsigned flags)
+{
+	if (!dentry->d_op || !dentry->d_op->d_automount)
+		return true;
+	return (flags & (LOOKUP_PARENT | LOOKUP_DIRECTORY |
+			 LOOKUP_OPEN | LOOKUP_CREATE | LOOKUP_AUTOMOUNT)) ||
+		!inode;
+}
+
 static int follow_automount(struct path *path, unsigned flags,
 			    bool *need_mntput)
 {
@@ -887,9 +904,8 @@ static int follow_automount(struct path *path, unsigned flags,
 	 * as being automount points.  These will need the attentions
 	 * of the daemon to instantiate them before they can be used.
 	 */
-	if (!(flags & (LOOKUP_PARENT | LOOKUP_DIRECTORY |
-		     LOOKUP_OPEN | LOOKUP_CREATE | LOOKUP_AUTOMOUNT)) &&
-	    path->dentry->d_inode)
+	if (!automount_would_trigger(path->dentry, path->dentry->d_inode,
+				     flags))
 		return -EISDIR;
 
 	current->total_link_count++;
@@ -1342,7 +1358,8 @@ static int lookup_fast(struct nameidata *nd, struct qstr *name,
 		path->dentry = dentry;
 		if (unlikely(!__follow_mount_rcu(nd, path, inode)))
 			goto unlazy;
-		if (unlikely(path->dentry->d_flags & DCACHE_NEED_AUTOMOUNT))
+		if (unlikely(path->dentry->d_flags & DCACHE_NEED_AUTOMOUNT) &&
+		    automount_would_trigger(path->dentry, *inode, nd->flags))
 			goto unlazy;
 		return 0;
 unlazy:
@@ -2822,13 +2839,14 @@ finish_open_created:
 	error = may_open(&nd->path, acc_mode, open_flag);
 	if (error)
 		goto out;
-	file->f_path.mnt = nd->path.mnt;
-	error = finish_open(file, nd->path.dentry, NULL, opened);
+	BUG_ON(*opened & FILE_OPENED); /* once it's opened, it's opened */
+	error = vfs_open(&nd->path, file, current_cred());
 	if (error) {
 		if (error == -EOPENSTALE)
 			goto stale_open;
 		goto out;
 	}
+	*opened |= FILE_OPENED;
 opened:
 	error = open_check_o_direct(file);
 	if (error)
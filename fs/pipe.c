@@ -8,6 +8,7 @@
 #include <linux/file.h>
 #include <linux/poll.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <linux/module.h>
 #include <linux/init.h>
 #include <linux/fs.h>
@@ -921,13 +922,37 @@ const struct file_operations rdwr_pipefifo_fops = {
 	.fasync		= pipe_rdwr_fasync,
 };
 
+/*
+ * The buffer array of a pipe grown with F_SETPIPE_SZ can need a high order
+ * allocation, don't fail resizing a big pipe just because memory is
+ * fragmented.
+ */
+static struct pipe_buffer *pipe_alloc_bufs(unsigned long nr_pages)
+{
+	struct pipe_buffer *bufs;
+	size_t size = nr_pages * sizeof(*bufs);
+
+	bufs = kzalloc(size, GFP_KERNEL | __GFP_NOWARN);
+	if (!bufs && size > PAGE_SIZE)
+		bufs = vzalloc(size);
+	return bufs;
+}
+
+static void pipe_free_bufs(struct pipe_buffer *bufs)
+{
+	if (is_vmalloc_addr(bufs))
+		vfree(bufs);
+	else
+		kfree(bufs);
+}
+
 struct pipe_inode_info * alloc_pipe_info(struct inode *inode)
 {
 	struct pipe_inode_info *pipe;
 
 	pipe = kzalloc(sizeof(struct pipe_inode_info), GFP_KERNEL);
 	if (pipe) {
-		pipe->bufs = kzalloc(sizeof(struct pipe_buffer) * PIPE_DEF_BUFFERS, GFP_KERNEL);
+		pipe->bufs = pipe_alloc_bufs(PIPE_DEF_BUFFERS);
 		if (pipe->bufs) {
 			init_waitqueue_head(&pipe->wait);
 			pipe->r_counter = pipe->w_counter = 1;
@@ -952,7 +977,7 @@ void __free_pipe_info(struct pipe_inode_info *pipe)
 	}
 	if (pipe->tmp_page)
 		__free_page(pipe->tmp_page);
-	kfree(pipe->bufs);
+	pipe_free_bufs(pipe->bufs);
 	kfree(pipe);
 }
 
@@ -1132,7 +1157,7 @@ SYSCALL_DEFINE1(pipe, int __user *, fildes)
  * Allocate a new array of pipe buffers and copy the info over. Returns the
  * pipe size if successful, or return -ERROR on error.
  */
-static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long nr_pages)
+long pipe_set_size(struct pipe_inode_info *pipe, unsigned long nr_pages)
 {
 	struct pipe_buffer *bufs;
 
@@ -1145,7 +1170,7 @@ static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long nr_pages)
 	if (nr_pages < pipe->nrbufs)
 		return -EBUSY;
 
-	bufs = kcalloc(nr_pages, sizeof(*bufs), GFP_KERNEL | __GFP_NOWARN);
+	bufs = pipe_alloc_bufs(nr_pages);
 	if (unlikely(!bufs))
 		return -ENOMEM;
 
@@ -1171,7 +1196,7 @@ static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long nr_pages)
 	}
 
 	pipe->curbuf = 0;
-	kfree(pipe->bufs);
+	pipe_free_bufs(pipe->bufs);
 	pipe->bufs = bufs;
 	pipe->buffers = nr_pages;
 	return nr_pages * PAGE_SIZE;
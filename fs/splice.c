@@ -277,19 +277,33 @@ int splice_grow_spd(const struct pipe_inode_info *pipe, struct splice_pipe_desc
 {
 	unsigned int buffers = ACCESS_ONCE(pipe->buffers);
 
+	struct page **pages;
+	struct partial_page *partial;
+
 	spd->nr_pages_max = buffers;
 	if (buffers <= PIPE_DEF_BUFFERS)
 		return 0;
 
-	spd->pages = kmalloc(buffers * sizeof(struct page *), GFP_KERNEL);
-	spd->partial = kmalloc(buffers * sizeof(struct partial_page), GFP_KERNEL);
+	pages = kmalloc(buffers * sizeof(struct page *),
+			GFP_KERNEL | __GFP_NOWARN);
+	partial = kmalloc(buffers * sizeof(struct partial_page),
+			  GFP_KERNEL | __GFP_NOWARN);
 
-	if (spd->pages && spd->partial)
+	if (pages && partial) {
+		spd->pages = pages;
+		spd->partial = partial;
 		return 0;
+	}
 
-	kfree(spd->pages);
-	kfree(spd->partial);
-	return -ENOMEM;
+	/*
+	 * The arrays for a big pipe are high order allocations.  Rather than
+	 * failing the splice, move as much as the caller's on stack arrays
+	 * hold this time around.
+	 */
+	kfree(pages);
+	kfree(partial);
+	spd->nr_pages_max = PIPE_DEF_BUFFERS;
+	return 0;
 }
 
 void splice_shrink_spd(struct splice_pipe_desc *spd)
@@ -1144,6 +1158,12 @@ static long do_splice_to(struct file *in, loff_t *ppos,
 	return splice_read(in, ppos, pipe, len, flags);
 }
 
+/*
+ * Size of the pipe cached in the task for splice_direct_to_actor(), in
+ * pages.  Must be a power of 2.
+ */
+#define SPLICE_DIRECT_BUFFERS	64
+
 /**
  * splice_direct_to_actor - splices data directly between two non-pipes
  * @in:		file to splice from
@@ -1192,6 +1212,15 @@ ssize_t splice_direct_to_actor(struct file *in, struct splice_desc *sd,
 		 */
 		pipe->readers = 1;
 
+		/*
+		 * Move data in bigger batches than a default pipe holds, so
+		 * that sendfile() makes fewer trips through the in and out
+		 * splice paths.  Stay with the default if that fails.
+		 */
+		pipe_set_size(pipe, min_t(unsigned int,
+					  pipe_max_size >> PAGE_SHIFT,
+					  SPLICE_DIRECT_BUFFERS));
+
 		current->splice_pipe = pipe;
 	}
 
@@ -1271,7 +1300,7 @@ static int direct_splice_actor(struct pipe_inode_info *pipe,
 {
 	struct file *file = sd->u.file;
 
-	return do_splice_from(pipe, file, &file->f_pos, sd->total_len,
+	return do_splice_from(pipe, file, sd->opos, sd->total_len,
 			      sd->flags);
 }
 
@@ -1280,18 +1309,19 @@ static int direct_splice_actor(struct pipe_inode_info *pipe,
  * @in:		file to splice from
  * @ppos:	input file offset
  * @out:	file to splice to
+ * @opos:	output file offset
  * @len:	number of bytes to splice
  * @flags:	splice modifier flags
  *
  * Description:
- *    For use by do_sendfile(). splice can easily emulate sendfile, but
- *    doing it in the application would incur an extra system call
- *    (splice in + splice out, as compared to just sendfile()). So this helper
- *    can splice directly through a process-private pipe.
+ *    For use by do_sendfile() and vfs_copy_file_range(). splice can easily
+ *    emulate sendfile, but doing it in the application would incur an extra
+ *    system call (splice in + splice out, as compared to just sendfile()).
+ *    So this helper can splice directly through a process-private pipe.
  *
  */
 long do_splice_direct(struct file *in, loff_t *ppos, struct file *out,
-		      size_t len, unsigned int flags)
+		      loff_t *opos, size_t len, unsigned int flags)
 {
 	struct splice_desc sd = {
 		.len		= len,
@@ -1299,6 +1329,7 @@ long do_splice_direct(struct file *in, loff_t *ppos, struct file *out,
 		.flags		= flags,
 		.pos		= *ppos,
 		.u.file		= out,
+		.opos		= opos,
 	};
 	long ret;
 
@@ -1308,6 +1339,7 @@ long do_splice_direct(struct file *in, loff_t *ppos, struct file *out,
 
 	return ret;
 }
+EXPORT_SYMBOL(do_splice_direct);
 
 static int splice_pipe_to_pipe(struct pipe_inode_info *ipipe,
 			       struct pipe_inode_info *opipe,
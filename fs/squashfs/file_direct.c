@@ -0,0 +1,233 @@
+/*
+ * Squashfs - a compressed read only filesystem for Linux
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * file_direct.c
+ */
+
+#include <linux/fs.h>
+#include <linux/vfs.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/pagemap.h>
+#include <linux/workqueue.h>
+
+#include "squashfs_fs.h"
+#include "squashfs_fs_sb.h"
+#include "squashfs_fs_i.h"
+#include "squashfs.h"
+#include "page_actor.h"
+
+/*
+ * This file decompresses datablocks directly into the page cache.  All
+ * the pages covered by a datablock are filled in one go, rather than
+ * decompressing the block into the read_page cache and copying the page
+ * asked for (and any neighbours that could be grabbed) out of it.  Pages
+ * that are already uptodate, or are locked by somebody else, are skipped,
+ * their part of the block is decompressed into a scratch buffer.
+ */
+
+static struct workqueue_struct *squashfs_read_wq;
+
+struct squashfs_readahead_work {
+	struct work_struct	work;
+	struct super_block	*sb;
+	u64			block;
+	int			bsize;
+	int			pages;
+	struct page		*page[0];
+};
+
+/*
+ * Grab the page cache pages for the slots of page[] the caller hasn't
+ * filled in, without blocking.  Pages already uptodate are left alone.
+ */
+static void squashfs_grab_pages(struct address_space *mapping,
+	pgoff_t start_index, struct page **page, int pages)
+{
+	int i;
+
+	for (i = 0; i < pages; i++) {
+		if (page[i])
+			continue;
+
+		page[i] = grab_cache_page_nowait(mapping, start_index + i);
+		if (page[i] && PageUptodate(page[i])) {
+			unlock_page(page[i]);
+			page_cache_release(page[i]);
+			page[i] = NULL;
+		}
+	}
+}
+
+/*
+ * Decompress the datablock into page[], and zero whatever part of the
+ * pages the datablock doesn't cover (the end of the file).
+ */
+static int squashfs_read_direct(struct super_block *sb, u64 block, int bsize,
+	struct page **page, int pages)
+{
+	struct squashfs_page_actor *actor;
+	void *pageaddr;
+	int i, bytes, res;
+
+	actor = squashfs_page_actor_init_special(page, pages, 0);
+	if (actor == NULL)
+		return -ENOMEM;
+
+	res = squashfs_read_data(sb, block, bsize, NULL, actor);
+	squashfs_page_actor_free(actor);
+	if (res < 0) {
+		ERROR("Unable to read page, block %llx, size %x\n", block,
+			bsize);
+		return res;
+	}
+
+	for (i = res >> PAGE_CACHE_SHIFT, bytes = res & (PAGE_CACHE_SIZE - 1);
+						i < pages; i++, bytes = 0) {
+		if (page[i] == NULL)
+			continue;
+
+		pageaddr = kmap_atomic(page[i]);
+		memset(pageaddr + bytes, 0, PAGE_CACHE_SIZE - bytes);
+		kunmap_atomic(pageaddr);
+	}
+
+	return 0;
+}
+
+/*
+ * Fill the pages covering a datablock, then mark them uptodate (or
+ * errored), unlock and release them.  On error target_page is left locked
+ * for the caller to deal with.
+ */
+static int squashfs_fill_block(struct super_block *sb, u64 block, int bsize,
+	struct page **page, int pages, struct page *target_page)
+{
+	int i, res = squashfs_read_direct(sb, block, bsize, page, pages);
+
+	for (i = 0; i < pages; i++) {
+		if (page[i] == NULL || (res && page[i] == target_page))
+			continue;
+
+		flush_dcache_page(page[i]);
+		if (res)
+			SetPageError(page[i]);
+		else
+			SetPageUptodate(page[i]);
+		unlock_page(page[i]);
+		if (page[i] != target_page)
+			page_cache_release(page[i]);
+	}
+
+	return res;
+}
+
+/* Read separately compressed datablock directly into page cache */
+int squashfs_readpage_block(struct page *target_page, u64 block, int bsize)
+{
+	struct inode *inode = target_page->mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+
+	int file_end = (i_size_read(inode) - 1) >> PAGE_CACHE_SHIFT;
+	int mask = (1 << (msblk->block_log - PAGE_CACHE_SHIFT)) - 1;
+	int start_index = target_page->index & ~mask;
+	int end_index = start_index | mask;
+	int pages, res;
+	struct page **page;
+
+	if (end_index > file_end)
+		end_index = file_end;
+
+	pages = end_index - start_index + 1;
+
+	page = kcalloc(pages, sizeof(void *), GFP_KERNEL);
+	if (page == NULL)
+		return -ENOMEM;
+
+	page[target_page->index - start_index] = target_page;
+	squashfs_grab_pages(target_page->mapping, start_index, page, pages);
+
+	res = squashfs_fill_block(inode->i_sb, block, bsize, page, pages,
+		target_page);
+
+	kfree(page);
+	return res;
+}
+
+static void squashfs_readahead_work(struct work_struct *work)
+{
+	struct squashfs_readahead_work *rw = container_of(work,
+		struct squashfs_readahead_work, work);
+
+	squashfs_fill_block(rw->sb, rw->block, rw->bsize, rw->page, rw->pages,
+		NULL);
+	kfree(rw);
+}
+
+/*
+ * Read a datablock on behalf of readahead.  The caller has locked and
+ * added to the page cache the pages readahead asked for, the rest are
+ * grabbed here if possible.  If async is set, the datablock is queued
+ * on the readahead workqueue to be decompressed on another CPU while the
+ * caller gets on with the rest of the readahead window.  The pages stay
+ * locked until they have been filled, which keeps the inode and
+ * superblock around until then.
+ */
+void squashfs_readahead_block(struct address_space *mapping,
+	pgoff_t start_index, struct page **page, int pages, u64 block,
+	int bsize, int async)
+{
+	struct squashfs_readahead_work *rw;
+
+	squashfs_grab_pages(mapping, start_index, page, pages);
+
+	if (async) {
+		rw = kmalloc(sizeof(*rw) + pages * sizeof(struct page *),
+			GFP_KERNEL);
+		if (rw) {
+			INIT_WORK(&rw->work, squashfs_readahead_work);
+			rw->sb = mapping->host->i_sb;
+			rw->block = block;
+			rw->bsize = bsize;
+			rw->pages = pages;
+			memcpy(rw->page, page, pages * sizeof(struct page *));
+			queue_work(squashfs_read_wq, &rw->work);
+			return;
+		}
+	}
+
+	squashfs_fill_block(mapping->host->i_sb, block, bsize, page, pages,
+		NULL);
+}
+
+int __init squashfs_readahead_init(void)
+{
+	/*
+	 * Unbound so queued datablocks spread over the idle CPUs, and with
+	 * a rescuer as page faults may end up waiting on them.
+	 */
+	squashfs_read_wq = alloc_workqueue("squashfs_read",
+		WQ_UNBOUND | WQ_MEM_RECLAIM, 0);
+
+	return squashfs_read_wq ? 0 : -ENOMEM;
+}
+
+void squashfs_readahead_exit(void)
+{
+	destroy_workqueue(squashfs_read_wq);
+}
@@ -0,0 +1,160 @@
+/*
+ * Squashfs - a compressed read only filesystem for Linux
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * page_actor.c
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/pagemap.h>
+#include <linux/highmem.h>
+#include "page_actor.h"
+
+/*
+ * This file contains implementations of page actors for decompressing
+ * into an intermediate buffer, and for decompressing directly into the
+ * page cache.
+ *
+ * Calling code should avoid sleeping between calls to squashfs_first_page()
+ * and squashfs_finish_page().
+ */
+
+/* Implementation of page_actor for decompressing into intermediate buffer */
+static void *cache_first_page(struct squashfs_page_actor *actor)
+{
+	actor->next_page = 1;
+	return actor->buffer[0];
+}
+
+static void *cache_next_page(struct squashfs_page_actor *actor)
+{
+	if (actor->next_page == actor->pages)
+		return NULL;
+
+	return actor->buffer[actor->next_page++];
+}
+
+static void cache_finish_page(struct squashfs_page_actor *actor)
+{
+	/* empty */
+}
+
+struct squashfs_page_actor *squashfs_page_actor_init(void **buffer,
+	int pages, int length)
+{
+	struct squashfs_page_actor *actor = kmalloc(sizeof(*actor), GFP_KERNEL);
+
+	if (actor == NULL)
+		return NULL;
+
+	actor->length = length ? : pages * PAGE_CACHE_SIZE;
+	actor->buffer = buffer;
+	actor->pages = pages;
+	actor->next_page = 0;
+	actor->pageaddr = NULL;
+	actor->tmp_buffer = NULL;
+	actor->squashfs_first_page = cache_first_page;
+	actor->squashfs_next_page = cache_next_page;
+	actor->squashfs_finish_page = cache_finish_page;
+	return actor;
+}
+
+/*
+ * Implementation of page_actor for decompressing directly into page cache.
+ * Slots for pages the caller could not get hold of (already uptodate, or
+ * locked by somebody else) are NULL, their part of the block is
+ * decompressed into a scratch buffer and thrown away.
+ */
+static void *handle_next_page(struct squashfs_page_actor *actor)
+{
+	struct page *page;
+
+	if (actor->pageaddr) {
+		kunmap_atomic(actor->pageaddr);
+		actor->pageaddr = NULL;
+	}
+
+	if (actor->next_page == actor->pages)
+		return NULL;
+
+	page = actor->page[actor->next_page++];
+	if (page == NULL)
+		return actor->tmp_buffer;
+
+	actor->pageaddr = kmap_atomic(page);
+	return actor->pageaddr;
+}
+
+static void *direct_first_page(struct squashfs_page_actor *actor)
+{
+	actor->next_page = 0;
+	return handle_next_page(actor);
+}
+
+static void *direct_next_page(struct squashfs_page_actor *actor)
+{
+	return handle_next_page(actor);
+}
+
+static void direct_finish_page(struct squashfs_page_actor *actor)
+{
+	if (actor->pageaddr) {
+		kunmap_atomic(actor->pageaddr);
+		actor->pageaddr = NULL;
+	}
+}
+
+struct squashfs_page_actor *squashfs_page_actor_init_special(struct page **page,
+	int pages, int length)
+{
+	struct squashfs_page_actor *actor = kmalloc(sizeof(*actor), GFP_KERNEL);
+	int i;
+
+	if (actor == NULL)
+		return NULL;
+
+	actor->tmp_buffer = NULL;
+	for (i = 0; i < pages; i++) {
+		if (page[i] == NULL) {
+			actor->tmp_buffer = kmalloc(PAGE_CACHE_SIZE,
+								GFP_KERNEL);
+			if (actor->tmp_buffer == NULL) {
+				kfree(actor);
+				return NULL;
+			}
+			break;
+		}
+	}
+
+	actor->length = length ? : pages * PAGE_CACHE_SIZE;
+	actor->page = page;
+	actor->pages = pages;
+	actor->next_page = 0;
+	actor->pageaddr = NULL;
+	actor->squashfs_first_page = direct_first_page;
+	actor->squashfs_next_page = direct_next_page;
+	actor->squashfs_finish_page = direct_finish_page;
+	return actor;
+}
+
+void squashfs_page_actor_free(struct squashfs_page_actor *actor)
+{
+	if (actor) {
+		kfree(actor->tmp_buffer);
+		kfree(actor);
+	}
+}
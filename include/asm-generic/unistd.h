@@ -693,9 +693,15 @@ __SC_COMP(__NR_process_vm_writev, sys_process_vm_writev, \
           compat_sys_process_vm_writev)
 #define __NR_kcmp 272
 __SYSCALL(__NR_kcmp, sys_kcmp)
+/*
+ * 273 through 284 are left unused, they belong to finit_module through
+ * mlock2 in mainline and copy_file_range keeps its mainline number.
+ */
+#define __NR_copy_file_range 285
+__SYSCALL(__NR_copy_file_range, sys_copy_file_range)
 
 #undef __NR_syscalls
-#define __NR_syscalls 273
+#define __NR_syscalls 286
 
 /*
  * All syscalls below here should go away really,
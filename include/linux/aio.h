@@ -118,6 +118,7 @@ struct kiocb {
 	struct list_head	ki_list;	/* the aio core uses this
 						 * for cancellation */
 	struct list_head	ki_batch;	/* batch allocation */
+	struct work_struct	ki_work;	/* punted buffered reads */
 
 	/*
 	 * If the aio_resfd field of the userspace iocb is not zero,
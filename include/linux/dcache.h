@@ -61,6 +61,7 @@ struct dentry_stat_t {
 	int dummy[2];
 };
 extern struct dentry_stat_t dentry_stat;
+extern int sysctl_negative_dentry_limit;
 
 /* Name hashing routines. Initial hash value */
 /* Hash courtesy of the R5 hash in reiserfs modulo sign bits */
@@ -207,6 +208,7 @@ struct dentry_operations {
 	(DCACHE_MOUNTED|DCACHE_NEED_AUTOMOUNT|DCACHE_MANAGE_TRANSIT)
 
 #define DCACHE_DENTRY_KILLED	0x100000
+#define DCACHE_NEGATIVE_LRU	0x200000 /* on sb->s_negative_lru */
 
 extern seqlock_t rename_lock;
 
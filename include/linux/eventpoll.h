@@ -26,6 +26,14 @@
 #define EPOLL_CTL_DEL 2
 #define EPOLL_CTL_MOD 3
 
+/*
+ * Set exclusive wakeup mode for the target file descriptor: when an event
+ * occurs and multiple epoll file descriptors are attached to the same
+ * target file with this flag, only one or more of them is woken up rather
+ * than all of them.
+ */
+#define EPOLLEXCLUSIVE (1 << 28)
+
 /*
  * Request the handling of system wakeup events so as to prevent system suspends
  * from happening while those events are being processed.
@@ -147,6 +147,7 @@ typedef void (*ctor_fn_t)(void);
 
 /* Defined in init/main.c */
 extern int do_one_initcall(initcall_t fn);
+extern int async_initcall(initcall_t fn);
 extern char __initdata boot_command_line[];
 extern char *saved_command_line;
 extern unsigned int reset_devices;
@@ -213,6 +214,22 @@ extern bool initcall_debug;
 
 #define __initcall(fn) device_initcall(fn)
 
+/*
+ * Asynchronous initcalls are started in their level like any other, but
+ * run from the async thread pool, in parallel with the rest of the level.
+ * A level only completes once all of its asynchronous initcalls have
+ * returned, so they may rely on anything done by earlier levels while
+ * nothing in their own level may rely on them.  Use them for slow,
+ * self-contained initialisation such as scanning a flash device.
+ */
+#define __define_initcall_async(level,fn,id) \
+	static int __init __async_initcall_##fn(void) \
+	{ return async_initcall(fn); } \
+	__define_initcall(level,__async_initcall_##fn,id)
+
+#define device_initcall_async(fn)	__define_initcall_async("6",fn,6)
+#define late_initcall_async(fn)		__define_initcall_async("7",fn,7)
+
 #define __exitcall(fn) \
 	static exitcall_t __exitcall_##fn __exit_call = fn
 
@@ -290,6 +307,8 @@ void __init parse_early_options(char *cmdline);
 #define fs_initcall(fn)			module_init(fn)
 #define device_initcall(fn)		module_init(fn)
 #define late_initcall(fn)		module_init(fn)
+#define device_initcall_async(fn)	module_init(fn)
+#define late_initcall_async(fn)		module_init(fn)
 
 #define security_initcall(fn)		module_init(fn)
 
@@ -27,6 +27,7 @@ enum {
 };
 
 struct loop_func_table;
+struct loop_dio_map;
 
 struct loop_device {
 	int		lo_number;
@@ -64,6 +65,9 @@ struct loop_device {
 
 	struct request_queue	*lo_queue;
 	struct gendisk		*lo_disk;
+
+	struct loop_dio_map	*lo_dio;	/* block map in direct mode */
+	struct queue_limits	lo_limits;	/* saved while in direct mode */
 };
 
 #endif /* __KERNEL__ */
@@ -75,6 +79,7 @@ enum {
 	LO_FLAGS_READ_ONLY	= 1,
 	LO_FLAGS_AUTOCLEAR	= 4,
 	LO_FLAGS_PARTSCAN	= 8,
+	LO_FLAGS_DIRECT_IO	= 16,
 };
 
 #include <asm/posix_types.h>	/* for __kernel_old_dev_t */
@@ -159,6 +164,7 @@ int loop_unregister_transfer(int number);
 #define LOOP_GET_STATUS64	0x4C05
 #define LOOP_CHANGE_FD		0x4C06
 #define LOOP_SET_CAPACITY	0x4C07
+#define LOOP_SET_DIRECT_IO	0x4C08
 
 /* /dev/loop-control interface */
 #define LOOP_CTL_ADD		0x4C80
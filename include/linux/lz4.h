@@ -0,0 +1,55 @@
+#ifndef __LZ4_H__
+#define __LZ4_H__
+/*
+ *  LZ4 Kernel Interface
+ *
+ *  LZ4 is an LZ77 type compressor with a fixed, byte oriented encoding
+ *  and no entropy coding, which makes decompression very fast.  Data is
+ *  a sequence of literal runs and back references of at least 4 bytes
+ *  into the previous 64 KiB of output.  This is the plain block format,
+ *  without the LZ4 frame header or checksums; the data written by
+ *  lz4_compress() and lz4hc_compress() is the same format and both are
+ *  decompressed by lz4_decompress_unknownoutputsize().
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+#define LZ4_MEM_COMPRESS	(4096 * sizeof(unsigned int))
+#define LZ4HC_MEM_COMPRESS	(32768 * sizeof(unsigned int) + \
+				 65536 * sizeof(unsigned short) + \
+				 2 * sizeof(unsigned char *))
+
+/*
+ * Worst case size of the compressed form of isize bytes, a destination
+ * buffer this big never makes the compressors fail.
+ */
+static inline size_t lz4_compressbound(size_t isize)
+{
+	return isize + (isize / 255) + 16;
+}
+
+/*
+ * Compress src_len bytes from src into dst.  On entry *dst_len is the
+ * size of dst, on return the size of the compressed data.  wrkmem must
+ * be LZ4_MEM_COMPRESS (or LZ4HC_MEM_COMPRESS) bytes.  lz4hc_compress()
+ * searches much harder for matches, it compresses better but a lot more
+ * slowly.  Returns 0, or < 0 if the result did not fit in dst.
+ */
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem);
+int lz4hc_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem);
+
+/*
+ * Decompress src_len bytes of compressed data from src into dest.  On
+ * entry *dest_len is the size of dest, on return the size of the
+ * decompressed data.  Never reads or writes outside the buffers given,
+ * whatever the input.  Returns 0, or < 0 if the data is corrupt or does
+ * not fit in dest.
+ */
+int lz4_decompress_unknownoutputsize(const unsigned char *src, size_t src_len,
+		unsigned char *dest, size_t *dest_len);
+
+#endif
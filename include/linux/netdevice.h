@@ -603,13 +603,14 @@ struct rps_map {
 
 /*
  * The rps_dev_flow structure contains the mapping of a flow to a CPU, the
- * tail pointer for that CPU's input queue at the time of last enqueue, and
- * a hardware filter index.
+ * tail pointer for that CPU's input queue at the time of last enqueue, a
+ * hardware filter index and the time (jiffies) the flow last changed CPU.
  */
 struct rps_dev_flow {
 	u16 cpu;
 	u16 filter;
 	unsigned int last_qtail;
+	unsigned int last_migrate;
 };
 #define RPS_NO_FILTER 0xffff
 
@@ -660,6 +661,7 @@ static inline void rps_reset_sock_flow(struct rps_sock_flow_table *table,
 }
 
 extern struct rps_sock_flow_table __rcu *rps_sock_flow_table;
+extern int sysctl_rps_flow_migrate_delay;
 
 #ifdef CONFIG_RFS_ACCEL
 extern bool rps_may_expire_flow(struct net_device *dev, u16 rxq_index,
@@ -1751,6 +1753,8 @@ struct softnet_data {
 	unsigned int		time_squeeze;
 	unsigned int		cpu_collision;
 	unsigned int		received_rps;
+	unsigned int		flow_migrations;
+	unsigned int		flow_migrations_held;
 
 #ifdef CONFIG_RPS
 	struct softnet_data	*rps_ipi_list;
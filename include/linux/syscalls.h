@@ -794,6 +794,10 @@ asmlinkage long sys_vmsplice(int fd, const struct iovec __user *iov,
 
 asmlinkage long sys_tee(int fdin, int fdout, size_t len, unsigned int flags);
 
+asmlinkage long sys_copy_file_range(int fd_in, loff_t __user *off_in,
+				    int fd_out, loff_t __user *off_out,
+				    size_t len, unsigned int flags);
+
 asmlinkage long sys_sync_file_range(int fd, loff_t offset, loff_t nbytes,
 					unsigned int flags);
 asmlinkage long sys_sync_file_range2(int fd, unsigned int flags,
@@ -564,6 +564,41 @@ TRACE_EVENT(block_rq_remap,
 		  (unsigned long long)__entry->old_sector)
 );
 
+/**
+ * block_rq_lat_outlier - request completed slower than the queue's threshold
+ * @q: queue holding the request
+ * @rq: the completed request
+ * @lat: latency in nanoseconds
+ *
+ * Reported for requests whose completion latency exceeds the queue's
+ * io_lat_outlier_usec threshold.  The latency is measured from the time
+ * the request was accounted as started.
+ */
+TRACE_EVENT(block_rq_lat_outlier,
+
+	TP_PROTO(struct request_queue *q, struct request *rq, u64 lat),
+
+	TP_ARGS(q, rq, lat),
+
+	TP_STRUCT__entry(
+		__field( dev_t,		dev		)
+		__field( unsigned int,	cmd_flags	)
+		__field( u64,		lat		)
+	),
+
+	TP_fast_assign(
+		__entry->dev		= rq->rq_disk ? disk_devt(rq->rq_disk) : 0;
+		__entry->cmd_flags	= rq->cmd_flags;
+		__entry->lat		= lat;
+	),
+
+	TP_printk("%d,%d %s%s %llu usecs",
+		  MAJOR(__entry->dev), MINOR(__entry->dev),
+		  __entry->cmd_flags & REQ_WRITE ? "W" : "R",
+		  __entry->cmd_flags & REQ_SYNC ? "S" : "",
+		  (unsigned long long)div_u64(__entry->lat, NSEC_PER_USEC))
+);
+
 #endif /* _TRACE_BLOCK_H */
 
 /* This part must be outside protection */
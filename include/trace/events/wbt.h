@@ -0,0 +1,91 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM wbt
+
+#if !defined(_TRACE_WBT_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_WBT_H
+
+#include <linux/tracepoint.h>
+#include <linux/backing-dev.h>
+
+/**
+ * wbt_lat - read latency seen during a monitoring window
+ * @bdi:	backing device of the throttled queue
+ * @lat_min:	lowest read latency in the window, in nsecs
+ * @nr_reads:	number of reads completed in the window
+ * @target:	read latency target, in nsecs
+ */
+TRACE_EVENT(wbt_lat,
+
+	TP_PROTO(struct backing_dev_info *bdi, u64 lat_min,
+		 unsigned int nr_reads, u64 target),
+
+	TP_ARGS(bdi, lat_min, nr_reads, target),
+
+	TP_STRUCT__entry(
+		__array(char,		name, 32)
+		__field(u64,		lat_min)
+		__field(unsigned int,	nr_reads)
+		__field(u64,		target)
+	),
+
+	TP_fast_assign(
+		strncpy(__entry->name, bdi->dev ? dev_name(bdi->dev) : "",
+			32);
+		__entry->lat_min	= lat_min;
+		__entry->nr_reads	= nr_reads;
+		__entry->target		= target;
+	),
+
+	TP_printk("%s: lat_min=%llu nr_reads=%u target=%llu",
+		  __entry->name, (unsigned long long)__entry->lat_min,
+		  __entry->nr_reads, (unsigned long long)__entry->target)
+);
+
+/**
+ * wbt_step - writeback depth was rescaled
+ * @bdi:	backing device of the throttled queue
+ * @msg:	reason for the change
+ * @step:	new scale step
+ * @max:	depth allowed for reclaim
+ * @normal:	depth allowed for regular writeback
+ * @bg:		depth allowed while other I/O is active
+ * @inflight:	tracked writes in flight
+ */
+TRACE_EVENT(wbt_step,
+
+	TP_PROTO(struct backing_dev_info *bdi, const char *msg, int step,
+		 unsigned int max, unsigned int normal, unsigned int bg,
+		 unsigned int inflight),
+
+	TP_ARGS(bdi, msg, step, max, normal, bg, inflight),
+
+	TP_STRUCT__entry(
+		__array(char,		name, 32)
+		__field(const char *,	msg)
+		__field(int,		step)
+		__field(unsigned int,	max)
+		__field(unsigned int,	normal)
+		__field(unsigned int,	bg)
+		__field(unsigned int,	inflight)
+	),
+
+	TP_fast_assign(
+		strncpy(__entry->name, bdi->dev ? dev_name(bdi->dev) : "",
+			32);
+		__entry->msg		= msg;
+		__entry->step		= step;
+		__entry->max		= max;
+		__entry->normal		= normal;
+		__entry->bg		= bg;
+		__entry->inflight	= inflight;
+	),
+
+	TP_printk("%s: %s: step=%d max=%u normal=%u background=%u inflight=%u",
+		  __entry->name, __entry->msg, __entry->step, __entry->max,
+		  __entry->normal, __entry->bg, __entry->inflight)
+);
+
+#endif /* _TRACE_WBT_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
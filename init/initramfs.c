@@ -18,6 +18,7 @@
 #include <linux/dirent.h>
 #include <linux/syscalls.h>
 #include <linux/utime.h>
+#include <linux/ktime.h>
 
 static __initdata char *message;
 static void __init error(char *x)
@@ -394,6 +395,8 @@ static int __init write_buffer(char *buf, unsigned len)
 	return len - count;
 }
 
+static __initdata unsigned long unpacked_bytes;
+
 static int __init flush_buffer(void *bufv, unsigned len)
 {
 	char *buf = (char *) bufv;
@@ -401,6 +404,7 @@ static int __init flush_buffer(void *bufv, unsigned len)
 	int origLen = len;
 	if (message)
 		return -1;
+	unpacked_bytes += len;
 	while ((written = write_buffer(buf, len)) < len && !message) {
 		char c = buf[written];
 		if (c == '0') {
@@ -427,6 +431,9 @@ static char * __init unpack_to_rootfs(char *buf, unsigned len)
 	decompress_fn decompress;
 	const char *compress_name;
 	static __initdata char msg_buf[64];
+	const char *method = "cpio";
+	unsigned in_len = len;
+	ktime_t start = ktime_get();
 
 	header_buf = kmalloc(110, GFP_KERNEL);
 	symlink_buf = kmalloc(PATH_MAX + N_ALIGN(PATH_MAX) + 1, GFP_KERNEL);
@@ -438,11 +445,13 @@ static char * __init unpack_to_rootfs(char *buf, unsigned len)
 	state = Start;
 	this_header = 0;
 	message = NULL;
+	unpacked_bytes = 0;
 	while (!message && len) {
 		loff_t saved_offset = this_header;
 		if (*buf == '0' && !(this_header & 3)) {
 			state = Start;
 			written = write_buffer(buf, len);
+			unpacked_bytes += written;
 			buf += written;
 			len -= written;
 			continue;
@@ -456,6 +465,7 @@ static char * __init unpack_to_rootfs(char *buf, unsigned len)
 		this_header = 0;
 		decompress = decompress_method(buf, len, &compress_name);
 		if (decompress) {
+			method = compress_name;
 			res = decompress(buf, len, NULL, flush_buffer, NULL,
 				   &my_inptr, error);
 			if (res)
@@ -476,6 +486,11 @@ static char * __init unpack_to_rootfs(char *buf, unsigned len)
 		len -= my_inptr;
 	}
 	dir_utime();
+	/* compare the compression methods by size and time to unpack */
+	if (!message)
+		printk(KERN_INFO "initramfs: unpacked %u bytes (%s) to %lu bytes in %lld us\n",
+		       in_len, method, unpacked_bytes,
+		       ktime_us_delta(ktime_get(), start));
 	kfree(name_buf);
 	kfree(symlink_buf);
 	kfree(header_buf);
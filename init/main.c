@@ -737,6 +737,24 @@ static char *initcall_level_names[] __initdata = {
 	"late",
 };
 
+/*
+ * Asynchronous initcalls get a domain of their own so that the
+ * async_synchronize_full() done by module loading, which they may
+ * trigger, does not wait for them and thereby for itself.
+ */
+static ASYNC_DOMAIN_EXCLUSIVE(initcall_domain);
+
+static void __init do_async_initcall(void *data, async_cookie_t cookie)
+{
+	do_one_initcall((initcall_t)data);
+}
+
+int __init async_initcall(initcall_t fn)
+{
+	async_schedule_domain(do_async_initcall, (void *)fn, &initcall_domain);
+	return 0;
+}
+
 static void __init do_initcall_level(int level)
 {
 	extern const struct kernel_param __start___param[], __stop___param[];
@@ -751,6 +769,9 @@ static void __init do_initcall_level(int level)
 
 	for (fn = initcall_levels[level]; fn < initcall_levels[level+1]; fn++)
 		do_one_initcall(*fn);
+
+	/* the next level may depend on this one's asynchronous initcalls */
+	async_synchronize_full_domain(&initcall_domain);
 }
 
 static void __init do_initcalls(void)
@@ -885,6 +906,10 @@ static int __init kernel_init(void * unused)
 		prepare_namespace();
 	}
 
+	/* report the async part of the boot while __init text is still here */
+	async_synchronize_full();
+	async_boot_report();
+
 	/*
 	 * Ok, we have completed the initial bootup, and
 	 * we're essentially up and running. Get rid of the
@@ -50,6 +50,8 @@ asynchronous and synchronous parts of the kernel.
 
 #include <linux/async.h>
 #include <linux/atomic.h>
+#include <linux/init.h>
+#include <linux/math64.h>
 #include <linux/ktime.h>
 #include <linux/export.h>
 #include <linux/wait.h>
@@ -80,6 +82,14 @@ static DECLARE_WAIT_QUEUE_HEAD(async_done);
 
 static atomic_t entry_count;
 
+/*
+ * Boot time accounting for async_boot_report(): how long the calls made
+ * while booting ran, and how long init spent waiting for them.
+ */
+static unsigned int boot_calls;
+static u64 boot_run_ns;
+static u64 boot_wait_ns;
+
 
 /*
  * MUST be called with the lock held!
@@ -119,8 +129,9 @@ static void async_run_entry_fn(struct work_struct *work)
 	struct async_entry *entry =
 		container_of(work, struct async_entry, work);
 	unsigned long flags;
-	ktime_t uninitialized_var(calltime), delta, rettime;
+	ktime_t uninitialized_var(calltime), uninitialized_var(delta);
 	struct async_domain *running = entry->running;
+	bool booting = system_state == SYSTEM_BOOTING;
 
 	/* 1) move self to the running queue */
 	spin_lock_irqsave(&async_lock, flags);
@@ -128,25 +139,30 @@ static void async_run_entry_fn(struct work_struct *work)
 	spin_unlock_irqrestore(&async_lock, flags);
 
 	/* 2) run (and print duration) */
-	if (initcall_debug && system_state == SYSTEM_BOOTING) {
-		printk(KERN_DEBUG "calling  %lli_%pF @ %i\n",
-			(long long)entry->cookie,
-			entry->func, task_pid_nr(current));
+	if (booting) {
+		if (initcall_debug)
+			printk(KERN_DEBUG "calling  %lli_%pF @ %i\n",
+				(long long)entry->cookie,
+				entry->func, task_pid_nr(current));
 		calltime = ktime_get();
 	}
 	entry->func(entry->data, entry->cookie);
-	if (initcall_debug && system_state == SYSTEM_BOOTING) {
-		rettime = ktime_get();
-		delta = ktime_sub(rettime, calltime);
-		printk(KERN_DEBUG "initcall %lli_%pF returned 0 after %lld usecs\n",
-			(long long)entry->cookie,
-			entry->func,
-			(long long)ktime_to_ns(delta) >> 10);
+	if (booting) {
+		delta = ktime_sub(ktime_get(), calltime);
+		if (initcall_debug)
+			printk(KERN_DEBUG "initcall %lli_%pF returned 0 after %lld usecs\n",
+				(long long)entry->cookie,
+				entry->func,
+				(long long)ktime_to_ns(delta) >> 10);
 	}
 
 	/* 3) remove self from the running queue */
 	spin_lock_irqsave(&async_lock, flags);
 	list_del(&entry->list);
+	if (booting) {
+		boot_calls++;
+		boot_run_ns += ktime_to_ns(delta);
+	}
 	if (running->registered && --running->count == 0)
 		list_del_init(&running->node);
 
@@ -303,24 +319,32 @@ EXPORT_SYMBOL_GPL(async_synchronize_full_domain);
 void async_synchronize_cookie_domain(async_cookie_t cookie, struct async_domain *running)
 {
 	ktime_t uninitialized_var(starttime), delta, endtime;
+	bool booting = system_state == SYSTEM_BOOTING;
 
 	if (!running)
 		return;
 
-	if (initcall_debug && system_state == SYSTEM_BOOTING) {
-		printk(KERN_DEBUG "async_waiting @ %i\n", task_pid_nr(current));
+	if (booting) {
+		if (initcall_debug)
+			printk(KERN_DEBUG "async_waiting @ %i\n",
+				task_pid_nr(current));
 		starttime = ktime_get();
 	}
 
 	wait_event(async_done, lowest_in_progress(running) >= cookie);
 
-	if (initcall_debug && system_state == SYSTEM_BOOTING) {
+	if (booting) {
 		endtime = ktime_get();
 		delta = ktime_sub(endtime, starttime);
 
-		printk(KERN_DEBUG "async_continuing @ %i after %lli usec\n",
-			task_pid_nr(current),
-			(long long)ktime_to_ns(delta) >> 10);
+		/* only init's waits hold up the boot */
+		if (is_global_init(current))
+			boot_wait_ns += ktime_to_ns(delta);
+
+		if (initcall_debug)
+			printk(KERN_DEBUG "async_continuing @ %i after %lli usec\n",
+				task_pid_nr(current),
+				(long long)ktime_to_ns(delta) >> 10);
 	}
 }
 EXPORT_SYMBOL_GPL(async_synchronize_cookie_domain);
@@ -337,3 +361,27 @@ void async_synchronize_cookie(async_cookie_t cookie)
 	async_synchronize_cookie_domain(cookie, &async_running);
 }
 EXPORT_SYMBOL_GPL(async_synchronize_cookie);
+
+/**
+ * async_boot_report - report how much of the boot was spent asynchronously
+ *
+ * Called by init once all asynchronous work of the boot is done.  Prints
+ * the time the asynchronous calls made while booting took in total, the
+ * part of it that init spent waiting for them and so the time that ran
+ * in parallel with the rest of the boot instead of adding to it.  Boot
+ * with "initcall_debug" and feed the log to scripts/bootgraph.pl to see
+ * the individual calls.
+ */
+void __init async_boot_report(void)
+{
+	u64 run_ms = div_u64(boot_run_ns, NSEC_PER_MSEC);
+	u64 wait_ms = div_u64(boot_wait_ns, NSEC_PER_MSEC);
+
+	if (!boot_calls)
+		return;
+
+	pr_info("async: %u calls took %llu ms, init waited %llu ms for them, %llu ms overlapped the boot\n",
+		boot_calls, (unsigned long long)run_ms,
+		(unsigned long long)wait_ms,
+		(unsigned long long)(run_ms > wait_ms ? run_ms - wait_ms : 0));
+}
@@ -0,0 +1,180 @@
+/*
+ * LZ4 decompressor for the kernel image and initramfs, reading the
+ * "legacy" stream format written by "lz4 -l": a 4 byte magic number
+ * followed by blocks, each a 4 byte little endian compressed size and
+ * a compressed block of 8 MiB of data (less for the last one).  Streams
+ * may be concatenated, the magic number then reappears between blocks.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifdef STATIC
+#include "lz4/lz4_decompress.c"
+#else
+#include <linux/decompress/unlz4.h>
+#endif
+
+#include <linux/types.h>
+#include <linux/lz4.h>
+#include <linux/decompress/mm.h>
+#include <linux/compiler.h>
+
+#include <asm/unaligned.h>
+
+#define LZ4_LEGACY_MAGIC	0x184c2102
+#define LZ4_LEGACY_BLOCK_SIZE	(8 << 20)
+
+/*
+ * Without a fill function the input may carry more after the last block:
+ * the 4 byte uncompressed size that the build appends, and zero padding
+ * as in padded or concatenated initramfs images.  Neither can start a
+ * block: a block size of zero is padding, and a size word followed by
+ * nothing but zeroes is the appended size.
+ */
+static inline int INIT unlz4_tail(const u8 *inp, long size, size_t chunksize)
+{
+	long i;
+
+	if (!chunksize)
+		return 1;
+	for (i = 4; i < size; i++)
+		if (inp[i])
+			return 0;
+	return 1;
+}
+
+STATIC inline int INIT unlz4(u8 *input, int in_len,
+				int (*fill) (void *, unsigned int),
+				int (*flush) (void *, unsigned int),
+				u8 *output, int *posp,
+				void (*error) (char *x))
+{
+	int ret = -1;
+	size_t chunksize, dest_len;
+	long size = in_len;
+	u8 *inp, *inp_start, *outp;
+
+	if (output) {
+		outp = output;
+	} else if (!flush) {
+		error("NULL output pointer and no flush function provided");
+		goto exit_0;
+	} else {
+		outp = large_malloc(LZ4_LEGACY_BLOCK_SIZE);
+		if (!outp) {
+			error("Could not allocate output buffer");
+			goto exit_0;
+		}
+	}
+
+	if (input && fill) {
+		error("Both input pointer and fill function provided, don't know what to do");
+		goto exit_1;
+	} else if (input) {
+		inp = input;
+	} else if (!fill) {
+		error("NULL input pointer and missing fill function");
+		goto exit_1;
+	} else {
+		inp = large_malloc(lz4_compressbound(LZ4_LEGACY_BLOCK_SIZE));
+		if (!inp) {
+			error("Could not allocate input buffer");
+			goto exit_1;
+		}
+	}
+	inp_start = inp;
+
+	if (posp)
+		*posp = 0;
+
+	if (fill)
+		size = fill(inp, 4);
+	if (size < 4 || get_unaligned_le32(inp) != LZ4_LEGACY_MAGIC) {
+		error("invalid header");
+		goto exit_2;
+	}
+	if (posp)
+		*posp += 4;
+	if (!fill) {
+		inp += 4;
+		size -= 4;
+	}
+
+	for (;;) {
+		if (fill) {
+			size = fill(inp, 4);
+			if (size == 0)
+				break;
+		} else if (size < 4) {
+			/* too short to be another block */
+			break;
+		}
+		if (size < 4) {
+			error("data corrupted");
+			goto exit_2;
+		}
+		chunksize = get_unaligned_le32(inp);
+		if (!fill && unlz4_tail(inp, size, chunksize)) {
+			/*
+			 * The appended size belongs to the image and is
+			 * skipped, the caller skips the padding itself.
+			 */
+			if (chunksize && posp)
+				*posp += 4;
+			break;
+		}
+		if (posp)
+			*posp += 4;
+		if (!fill) {
+			inp += 4;
+			size -= 4;
+		}
+
+		/* the next of several concatenated streams */
+		if (chunksize == LZ4_LEGACY_MAGIC)
+			continue;
+
+		if (chunksize > lz4_compressbound(LZ4_LEGACY_BLOCK_SIZE)) {
+			error("chunk length is longer than allocated");
+			goto exit_2;
+		}
+		if (fill)
+			size = fill(inp, chunksize);
+		if (size < (long)chunksize) {
+			error("data corrupted");
+			goto exit_2;
+		}
+
+		dest_len = LZ4_LEGACY_BLOCK_SIZE;
+		if (lz4_decompress_unknownoutputsize(inp, chunksize,
+						     outp, &dest_len)) {
+			error("Decoding failed");
+			goto exit_2;
+		}
+
+		if (flush && flush(outp, dest_len) != dest_len)
+			goto exit_2;
+		if (output)
+			outp += dest_len;
+		if (posp)
+			*posp += chunksize;
+		if (!fill) {
+			inp += chunksize;
+			size -= chunksize;
+		}
+	}
+
+	ret = 0;
+exit_2:
+	if (!input)
+		large_free(inp_start);
+exit_1:
+	if (!output)
+		large_free(outp);
+exit_0:
+	return ret;
+}
+
+#define decompress unlz4
@@ -0,0 +1,103 @@
+/*
+ * LZ4 compressor
+ *
+ * A single pass compressor: every position looked at is hashed into a
+ * table of the last position seen with the same 4 byte prefix, and a
+ * match is taken as soon as the table points at an equal prefix less
+ * than 64 KiB back.  Runs without matches are skipped over with a
+ * growing stride, so incompressible data goes through quickly.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+#define HASH_LOG	12
+#define SKIP_STRENGTH	6
+
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	u32 *table = wrkmem;
+	const u8 *ip = src, *anchor = src, *ref;
+	const u8 * const iend = src + src_len;
+	const u8 * const mflimit = iend - MFLIMIT;
+	const u8 * const matchlimit = iend - LASTLITERALS;
+	u8 *op = dst;
+	u8 * const oend = dst + *dst_len;
+	unsigned int ml, h;
+
+	if (src_len < MINLENGTH)
+		goto last_literals;
+
+	memset(table, 0, LZ4_MEM_COMPRESS);
+	ip++;
+
+	for (;;) {
+		unsigned int attempts = 1U << SKIP_STRENGTH;
+		const u8 *next = ip;
+
+		/* find a match */
+		do {
+			ip = next;
+			if (unlikely(ip > mflimit))
+				goto last_literals;
+			next += attempts++ >> SKIP_STRENGTH;
+
+			h = LZ4_HASH(ip, HASH_LOG);
+			ref = src + table[h];
+			table[h] = ip - src;
+		} while (ip - ref > MAX_DISTANCE ||
+			 LZ4_READ32(ref) != LZ4_READ32(ip));
+
+		/* the match may start earlier */
+		while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+			ip--;
+			ref--;
+		}
+
+		for (;;) {
+			ml = MINMATCH + lz4_count(ip + MINMATCH,
+					ref + MINMATCH, matchlimit);
+			op = lz4_encode_sequence(op, oend, anchor, ip, ref, ml);
+			if (unlikely(!op))
+				return -1;
+
+			ip += ml;
+			anchor = ip;
+			if (ip > mflimit)
+				goto last_literals;
+
+			table[LZ4_HASH(ip - 2, HASH_LOG)] = ip - 2 - src;
+
+			/* is there a match right away? */
+			h = LZ4_HASH(ip, HASH_LOG);
+			ref = src + table[h];
+			table[h] = ip - src;
+			if (ip - ref > MAX_DISTANCE ||
+			    LZ4_READ32(ref) != LZ4_READ32(ip))
+				break;
+		}
+
+		ip++;
+	}
+
+last_literals:
+	op = lz4_encode_last_literals(op, oend, anchor, iend);
+	if (unlikely(!op))
+		return -1;
+
+	*dst_len = op - dst;
+	return 0;
+}
+EXPORT_SYMBOL(lz4_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 compressor");
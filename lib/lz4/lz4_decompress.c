@@ -0,0 +1,140 @@
+/*
+ * LZ4 decompressor
+ *
+ * Checks every length and offset against the buffers it was given, so it
+ * is safe to use on untrusted data.  Literal runs and non-overlapping
+ * matches are copied with memcpy(), overlapping matches (runs of a
+ * repeated short pattern) a word or a byte at a time.  On CPUs with fast
+ * unaligned access, copies with at least 8 bytes to spare in both
+ * buffers go 8 bytes at a time instead, which also keeps the pre-boot
+ * decompressor off its byte-by-byte memcpy().
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef STATIC
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#endif
+
+#include <asm/unaligned.h>
+#include <linux/lz4.h>
+#include "lz4defs.h"
+
+/* Read a length extension, false if it runs off the end of the input */
+static inline bool lz4_get_length(const u8 **ip, const u8 *iend,
+		size_t *len)
+{
+	unsigned int s;
+
+	do {
+		if (unlikely(*ip >= iend))
+			return false;
+		s = *(*ip)++;
+		*len += s;
+	} while (s == 255);
+
+	return true;
+}
+
+/*
+ * Copy len bytes 8 at a time, reading and writing up to 7 bytes past the
+ * end.  Overlapping copies are fine as long as dst is at least 8 bytes
+ * after src.
+ */
+static inline void lz4_wildcopy(u8 *dst, const u8 *src, size_t len)
+{
+	u8 * const end = dst + len;
+
+	do {
+		lz4_write32(dst, lz4_read32(src));
+		lz4_write32(dst + 4, lz4_read32(src + 4));
+		dst += 8;
+		src += 8;
+	} while (dst < end);
+}
+
+int lz4_decompress_unknownoutputsize(const unsigned char *src, size_t src_len,
+		unsigned char *dest, size_t *dest_len)
+{
+	const u8 *ip = src, *match;
+	const u8 * const iend = src + src_len;
+	u8 *op = dest;
+	u8 * const oend = dest + *dest_len;
+	size_t len, offset;
+	unsigned int token;
+
+	for (;;) {
+		if (unlikely(ip >= iend))
+			goto malformed;
+		token = *ip++;
+
+		/* literals */
+		len = token >> ML_BITS;
+		if (len == RUN_MASK && !lz4_get_length(&ip, iend, &len))
+			goto malformed;
+		if (LZ4_FAST_UNALIGNED && len + 8 <= (size_t)(iend - ip) &&
+		    len + 8 <= (size_t)(oend - op))
+			lz4_wildcopy(op, ip, len);
+		else if (unlikely(len > (size_t)(iend - ip) ||
+				  len > (size_t)(oend - op)))
+			goto malformed;
+		else
+			memcpy(op, ip, len);
+		op += len;
+		ip += len;
+
+		/* the last sequence ends with its literals */
+		if (ip == iend)
+			break;
+
+		/* match */
+		if (unlikely(iend - ip < 2))
+			goto malformed;
+		offset = get_unaligned_le16(ip);
+		ip += 2;
+		if (unlikely(offset == 0 || offset > (size_t)(op - dest)))
+			goto malformed;
+		match = op - offset;
+
+		len = token & ML_MASK;
+		if (len == ML_MASK && !lz4_get_length(&ip, iend, &len))
+			goto malformed;
+		len += MINMATCH;
+		if (unlikely(len > (size_t)(oend - op)))
+			goto malformed;
+
+		if (LZ4_FAST_UNALIGNED && offset >= 8 &&
+		    len + 8 <= (size_t)(oend - op)) {
+			lz4_wildcopy(op, match, len);
+			op += len;
+		} else if (offset >= len) {
+			memcpy(op, match, len);
+			op += len;
+		} else if (offset >= 4) {
+			/* each word copied is complete before it is read */
+			for (; len >= 4; len -= 4, op += 4, match += 4)
+				lz4_write32(op, lz4_read32(match));
+			while (len--)
+				*op++ = *match++;
+		} else {
+			while (len--)
+				*op++ = *match++;
+		}
+	}
+
+	*dest_len = op - dest;
+	return 0;
+
+malformed:
+	return -1;
+}
+#ifndef STATIC
+EXPORT_SYMBOL(lz4_decompress_unknownoutputsize);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Decompressor");
+#endif
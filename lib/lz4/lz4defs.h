@@ -0,0 +1,161 @@
+/*
+ * lz4defs.h -- LZ4 block format constants and helpers shared by the
+ * compressors and the decompressor
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/*
+ * A sequence is a token byte, the literal run length extension bytes, the
+ * literals, a little endian 16 bit match offset and the match length
+ * extension bytes.  The high nibble of the token is the literal run
+ * length and the low nibble the match length minus MINMATCH, a nibble of
+ * 15 is followed by bytes adding to it until one is below 255.  The last
+ * sequence has literals only.
+ */
+#define MINMATCH	4
+
+#define ML_BITS		4
+#define ML_MASK		((1U << ML_BITS) - 1)
+#define RUN_BITS	(8 - ML_BITS)
+#define RUN_MASK	((1U << RUN_BITS) - 1)
+
+#define MAX_DISTANCE	65535
+
+/*
+ * The last match starts at least MFLIMIT bytes before the end of the
+ * input and the last LASTLITERALS bytes are always literals, which is
+ * what allows decompressors to copy in word sized chunks.
+ */
+#define LASTLITERALS	5
+#define MFLIMIT		12
+#define MINLENGTH	(MFLIMIT + 1)
+
+/*
+ * Where the CPU handles unaligned words itself, access them directly:
+ * get_unaligned() on ARM assembles every word from single bytes, and the
+ * pre-boot memcpy() is a byte loop.  ARMv6 may still be running with the
+ * legacy unaligned behaviour in the boot wrapper, so only trust ARMv7.
+ */
+#if defined(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS) || \
+	(defined(__ARM_FEATURE_UNALIGNED) && __LINUX_ARM_ARCH__ >= 7)
+#define LZ4_FAST_UNALIGNED	1
+
+struct lz4_u32 {
+	u32 v;
+} __packed;
+
+static inline u32 lz4_read32(const void *p)
+{
+	return ((const struct lz4_u32 *)p)->v;
+}
+
+static inline void lz4_write32(void *p, u32 v)
+{
+	((struct lz4_u32 *)p)->v = v;
+}
+#else
+#define LZ4_FAST_UNALIGNED	0
+
+static inline u32 lz4_read32(const void *p)
+{
+	return get_unaligned((const u32 *)p);
+}
+
+static inline void lz4_write32(void *p, u32 v)
+{
+	put_unaligned(v, (u32 *)p);
+}
+#endif
+
+#define LZ4_READ32(p)	lz4_read32(p)
+
+/* Knuth's multiplicative hash of the 4 bytes at p */
+#define LZ4_HASH(p, bits) \
+	((LZ4_READ32(p) * 2654435761U) >> (32 - (bits)))
+
+/* Length of the common run of ip and ref, not going past limit */
+static inline unsigned int lz4_count(const u8 *ip, const u8 *ref,
+		const u8 *limit)
+{
+	const u8 *start = ip;
+
+	while (ip < limit - 3 && LZ4_READ32(ip) == LZ4_READ32(ref)) {
+		ip += 4;
+		ref += 4;
+	}
+	while (ip < limit && *ip == *ref) {
+		ip++;
+		ref++;
+	}
+
+	return ip - start;
+}
+
+static inline u8 *lz4_put_length(u8 *op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+
+	return op;
+}
+
+/*
+ * Emit the literals [anchor, ip) followed by a match of length ml at
+ * offset ip - ref.  Returns the new output position, or NULL if the
+ * sequence does not fit before oend with room for the last literals.
+ */
+static inline u8 *lz4_encode_sequence(u8 *op, u8 *oend, const u8 *anchor,
+		const u8 *ip, const u8 *ref, size_t ml)
+{
+	size_t lit = ip - anchor;
+	u8 *token;
+
+	if ((size_t)(oend - op) < 1 + lit + lit / 255 + 2 + ml / 255 + 1 +
+								LASTLITERALS)
+		return NULL;
+
+	token = op++;
+	if (lit >= RUN_MASK) {
+		*token = RUN_MASK << ML_BITS;
+		op = lz4_put_length(op, lit - RUN_MASK);
+	} else
+		*token = lit << ML_BITS;
+
+	memcpy(op, anchor, lit);
+	op += lit;
+
+	put_unaligned_le16(ip - ref, op);
+	op += 2;
+
+	ml -= MINMATCH;
+	if (ml >= ML_MASK) {
+		*token |= ML_MASK;
+		op = lz4_put_length(op, ml - ML_MASK);
+	} else
+		*token |= ml;
+
+	return op;
+}
+
+/* Emit the final literal-only sequence, NULL if it doesn't fit */
+static inline u8 *lz4_encode_last_literals(u8 *op, u8 *oend,
+		const u8 *anchor, const u8 *iend)
+{
+	size_t lit = iend - anchor;
+
+	if ((size_t)(oend - op) < 1 + lit + (lit + 255 - RUN_MASK) / 255)
+		return NULL;
+
+	if (lit >= RUN_MASK) {
+		*op++ = RUN_MASK << ML_BITS;
+		op = lz4_put_length(op, lit - RUN_MASK);
+	} else
+		*op++ = lit << ML_BITS;
+
+	memcpy(op, anchor, lit);
+	return op + lit;
+}
@@ -0,0 +1,148 @@
+/*
+ * LZ4HC compressor
+ *
+ * Produces the same format as lz4_compress(), but keeps every position
+ * of the last 64 KiB on hash chains and walks them for the longest match
+ * instead of taking the first one found, and defers a match by a byte
+ * when the next position has a longer one.  It is several times slower
+ * than lz4_compress() and compresses noticeably better, decompression
+ * speed is the same (or better, with fewer and longer sequences).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+#define HC_HASH_LOG	15
+#define HC_CHAIN_SIZE	65536
+#define HC_CHAIN_MASK	(HC_CHAIN_SIZE - 1)
+#define MAX_ATTEMPTS	256
+
+struct lz4hc_data {
+	const u8	*base;
+	const u8	*next_to_update;
+	u32		hash_table[1 << HC_HASH_LOG];
+	u16		chain_table[HC_CHAIN_SIZE];
+};
+
+/*
+ * hash_table holds the last position (plus one, so zero means none) with
+ * each hash, chain_table the distance from each position back to the
+ * previous one with the same hash, zero ending the chain.
+ */
+static inline void lz4hc_insert(struct lz4hc_data *hc, const u8 *ip)
+{
+	const u8 *p;
+
+	for (p = hc->next_to_update; p < ip; p++) {
+		u32 h = LZ4_HASH(p, HC_HASH_LOG);
+		size_t pos = p - hc->base;
+		size_t delta = hc->hash_table[h] ?
+				pos + 1 - hc->hash_table[h] : 0;
+
+		hc->chain_table[pos & HC_CHAIN_MASK] =
+			delta > MAX_DISTANCE ? 0 : delta;
+		hc->hash_table[h] = pos + 1;
+	}
+	hc->next_to_update = ip;
+}
+
+/* Longest match for ip, its length or 0 if none */
+static unsigned int lz4hc_find_match(struct lz4hc_data *hc, const u8 *ip,
+		const u8 *matchlimit, const u8 **match)
+{
+	const u8 *ref;
+	unsigned int ml = 0, len, attempts = MAX_ATTEMPTS;
+	u32 pos;
+
+	lz4hc_insert(hc, ip);
+
+	pos = hc->hash_table[LZ4_HASH(ip, HC_HASH_LOG)];
+	if (!pos)
+		return 0;
+	ref = hc->base + pos - 1;
+
+	while (ip - ref <= MAX_DISTANCE && attempts--) {
+		if (ref[ml] == ip[ml] && LZ4_READ32(ref) == LZ4_READ32(ip)) {
+			len = MINMATCH + lz4_count(ip + MINMATCH,
+					ref + MINMATCH, matchlimit);
+			if (len > ml) {
+				ml = len;
+				*match = ref;
+			}
+		}
+
+		len = hc->chain_table[(ref - hc->base) & HC_CHAIN_MASK];
+		if (!len)
+			break;
+		ref -= len;
+	}
+
+	return ml;
+}
+
+int lz4hc_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	struct lz4hc_data *hc = wrkmem;
+	const u8 *ip = src, *anchor = src, *ref = NULL, *ref2 = NULL;
+	const u8 * const iend = src + src_len;
+	const u8 * const mflimit = iend - MFLIMIT;
+	const u8 * const matchlimit = iend - LASTLITERALS;
+	u8 *op = dst;
+	u8 * const oend = dst + *dst_len;
+	unsigned int ml, ml2;
+
+	BUILD_BUG_ON(sizeof(struct lz4hc_data) > LZ4HC_MEM_COMPRESS);
+
+	if (src_len < MINLENGTH)
+		goto last_literals;
+
+	memset(hc->hash_table, 0, sizeof(hc->hash_table));
+	hc->base = src;
+	hc->next_to_update = src;
+
+	while (ip <= mflimit) {
+		ml = lz4hc_find_match(hc, ip, matchlimit, &ref);
+		if (!ml) {
+			ip++;
+			continue;
+		}
+
+		/* lazy matching: a longer match one byte on wins */
+		while (ip + 1 <= mflimit) {
+			ml2 = lz4hc_find_match(hc, ip + 1, matchlimit, &ref2);
+			if (ml2 <= ml)
+				break;
+			ip++;
+			ml = ml2;
+			ref = ref2;
+		}
+
+		op = lz4_encode_sequence(op, oend, anchor, ip, ref, ml);
+		if (unlikely(!op))
+			return -1;
+
+		ip += ml;
+		anchor = ip;
+	}
+
+last_literals:
+	op = lz4_encode_last_literals(op, oend, anchor, iend);
+	if (unlikely(!op))
+		return -1;
+
+	*dst_len = op - dst;
+	return 0;
+}
+EXPORT_SYMBOL(lz4hc_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4HC compressor");
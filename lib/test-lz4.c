@@ -0,0 +1,270 @@
+/*
+ * LZ4 / LZ4HC / LZO benchmark
+ *
+ * Compresses "size" bytes of input in independent "chunk" sized pieces,
+ * the way zram (one page), squashfs (one block) or UBIFS (one data node)
+ * use these compressors, then decompresses them again.  Each is repeated
+ * "iterations" times and the throughput of every algorithm is reported
+ * together with the compressed size, so the three can be compared on the
+ * machine at hand.  Throughput is in MB/s of uncompressed data for both
+ * directions.
+ *
+ * The input is the start of "file", or without one some generated text
+ * that compresses roughly as well as source code does, e.g.
+ *
+ *	modprobe test-lz4 file=/lib/modules/$(uname -r)/modules.dep chunk=4096
+ *
+ * The module does not stay loaded, so it can simply be run again.
+ */
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/ktime.h>
+#include <linux/fs.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/random.h>
+#include <linux/string.h>
+#include <linux/err.h>
+#include <linux/lzo.h>
+#include <linux/lz4.h>
+
+static char *file;
+module_param(file, charp, 0444);
+MODULE_PARM_DESC(file, "file to read the input from (default: generated text)");
+
+static unsigned int size = 1 << 20;
+module_param(size, uint, 0444);
+MODULE_PARM_DESC(size, "bytes of input");
+
+static unsigned int chunk = PAGE_SIZE;
+module_param(chunk, uint, 0444);
+MODULE_PARM_DESC(chunk, "bytes compressed at a time");
+
+static unsigned int iterations = 10;
+module_param(iterations, uint, 0444);
+MODULE_PARM_DESC(iterations, "passes over the input per algorithm");
+
+struct lz4_bench_alg {
+	const char	*name;
+	size_t		wrkmem_size;
+	int		(*compress)(const unsigned char *src, size_t src_len,
+				    unsigned char *dst, size_t *dst_len,
+				    void *wrkmem);
+	int		(*decompress)(const unsigned char *src, size_t src_len,
+				      unsigned char *dst, size_t *dst_len);
+};
+
+/* lzo1x_1_compress() ignores *dst_len, every slot fits its worst case */
+static const struct lz4_bench_alg lz4_bench_algs[] = {
+	{ "lzo", LZO1X_1_MEM_COMPRESS, lzo1x_1_compress,
+	  lzo1x_decompress_safe },
+	{ "lz4", LZ4_MEM_COMPRESS, lz4_compress,
+	  lz4_decompress_unknownoutputsize },
+	{ "lz4hc", LZ4HC_MEM_COMPRESS, lz4hc_compress,
+	  lz4_decompress_unknownoutputsize },
+};
+
+struct lz4_bench {
+	unsigned char	*in;
+	unsigned char	*out;
+	unsigned char	*cbuf;
+	size_t		*clen;
+	void		*wrkmem;
+	size_t		len;
+	size_t		slot;		/* room for each compressed chunk */
+	unsigned int	nr_chunks;
+};
+
+static const char * const lz4_bench_words[] = {
+	"static", "int", "struct", "return", "if", "else", "for", "while",
+	"unsigned", "long", "char", "void", "const", "page", "inode", "err",
+	"goto", "out", "NULL", "sizeof", "(", ")", "{", "}", ";", "->",
+	"=", "==", "0", "1", "\n", "\n\t", "\n\t\t", "*", "&", ",",
+};
+
+static void lz4_bench_generate(unsigned char *buf, size_t len)
+{
+	size_t pos = 0;
+
+	while (pos < len) {
+		const char *w = lz4_bench_words[random32() %
+					ARRAY_SIZE(lz4_bench_words)];
+		size_t n = min(strlen(w), len - pos);
+
+		memcpy(buf + pos, w, n);
+		pos += n;
+		if (pos < len && w[0] != '\n')
+			buf[pos++] = ' ';
+	}
+}
+
+static int lz4_bench_read(unsigned char *buf, size_t *len)
+{
+	struct file *f;
+	int ret;
+
+	f = filp_open(file, O_RDONLY | O_LARGEFILE, 0);
+	if (IS_ERR(f))
+		return PTR_ERR(f);
+	ret = kernel_read(f, 0, buf, *len);
+	filp_close(f, NULL);
+	if (ret < 0)
+		return ret;
+	if (ret == 0)
+		return -ENODATA;
+	*len = ret;
+	return 0;
+}
+
+static size_t lz4_bench_chunk_len(struct lz4_bench *b, unsigned int i)
+{
+	return min_t(size_t, chunk, b->len - (size_t)i * chunk);
+}
+
+static int bench_compress(struct lz4_bench *b, const struct lz4_bench_alg *a,
+			  u64 *total)
+{
+	unsigned int i;
+	int err;
+
+	*total = 0;
+	for (i = 0; i < b->nr_chunks; i++) {
+		b->clen[i] = b->slot;
+		err = a->compress(b->in + (size_t)i * chunk,
+				  lz4_bench_chunk_len(b, i),
+				  b->cbuf + i * b->slot, &b->clen[i],
+				  b->wrkmem);
+		if (err)
+			return -EIO;
+		*total += b->clen[i];
+		cond_resched();
+	}
+	return 0;
+}
+
+static int bench_decompress(struct lz4_bench *b,
+			    const struct lz4_bench_alg *a)
+{
+	unsigned int i;
+	size_t len;
+	int err;
+
+	for (i = 0; i < b->nr_chunks; i++) {
+		len = chunk;
+		err = a->decompress(b->cbuf + i * b->slot, b->clen[i],
+				    b->out + (size_t)i * chunk, &len);
+		if (err || len != lz4_bench_chunk_len(b, i))
+			return -EIO;
+		cond_resched();
+	}
+	return 0;
+}
+
+static u64 lz4_bench_rate(struct lz4_bench *b, u64 nsecs)
+{
+	u64 bytes = (u64)b->len * iterations;
+
+	if (!nsecs)
+		return 0;
+	/* MB/s, in bytes * 10^9 / ns / 10^6 */
+	return div64_u64(bytes * 1000, nsecs);
+}
+
+static int lz4_bench_run(struct lz4_bench *b, const struct lz4_bench_alg *a)
+{
+	u64 ctime, dtime, csize = 0;
+	ktime_t start;
+	unsigned int i;
+	int err = 0;
+
+	b->wrkmem = vmalloc(a->wrkmem_size);
+	if (!b->wrkmem)
+		return -ENOMEM;
+
+	start = ktime_get();
+	for (i = 0; i < iterations && !err; i++)
+		err = bench_compress(b, a, &csize);
+	ctime = ktime_to_ns(ktime_sub(ktime_get(), start));
+	if (err)
+		goto out;
+
+	start = ktime_get();
+	for (i = 0; i < iterations && !err; i++)
+		err = bench_decompress(b, a);
+	dtime = ktime_to_ns(ktime_sub(ktime_get(), start));
+	if (err)
+		goto out;
+
+	if (memcmp(b->in, b->out, b->len)) {
+		err = -EIO;
+		goto out;
+	}
+
+	pr_info("test-lz4: %-6s %zu -> %llu bytes (%llu.%02llu%%), compress %llu MB/s, decompress %llu MB/s\n",
+		a->name, b->len, (unsigned long long)csize,
+		(unsigned long long)div64_u64(csize * 100, b->len),
+		(unsigned long long)div64_u64(csize * 10000, b->len) % 100,
+		(unsigned long long)lz4_bench_rate(b, ctime),
+		(unsigned long long)lz4_bench_rate(b, dtime));
+out:
+	if (err)
+		pr_err("test-lz4: %s failed\n", a->name);
+	vfree(b->wrkmem);
+	return err;
+}
+
+static int __init test_lz4_init(void)
+{
+	struct lz4_bench b = { .len = size };
+	unsigned int i;
+	int err = -ENOMEM;
+
+	if (!size || !chunk || !iterations)
+		return -EINVAL;
+
+	b.in = vmalloc(size);
+	b.out = vmalloc(size);
+	if (!b.in || !b.out)
+		goto out;
+
+	if (file) {
+		err = lz4_bench_read(b.in, &b.len);
+		if (err) {
+			pr_err("test-lz4: cannot read %s: error %d\n",
+			       file, err);
+			goto out;
+		}
+	} else {
+		lz4_bench_generate(b.in, b.len);
+	}
+
+	err = -ENOMEM;
+	b.nr_chunks = DIV_ROUND_UP(b.len, chunk);
+	b.slot = max_t(size_t, lzo1x_worst_compress(chunk),
+		       lz4_compressbound(chunk));
+	b.cbuf = vmalloc(b.nr_chunks * b.slot);
+	b.clen = vmalloc(b.nr_chunks * sizeof(*b.clen));
+	if (!b.cbuf || !b.clen)
+		goto out;
+
+	pr_info("test-lz4: %s: %zu bytes in %u byte chunks, %u iterations\n",
+		file ? file : "generated text", b.len, chunk, iterations);
+
+	err = 0;
+	for (i = 0; i < ARRAY_SIZE(lz4_bench_algs) && !err; i++)
+		err = lz4_bench_run(&b, &lz4_bench_algs[i]);
+
+out:
+	vfree(b.clen);
+	vfree(b.cbuf);
+	vfree(b.out);
+	vfree(b.in);
+	return err ? err : -EAGAIN;
+}
+module_init(test_lz4_init);
+
+MODULE_DESCRIPTION("LZ4, LZ4HC and LZO compression benchmark");
+MODULE_LICENSE("GPL");
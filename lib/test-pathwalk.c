@@ -0,0 +1,182 @@
+/*
+ * Path lookup benchmark
+ *
+ * Starts one thread per online cpu (or "threads" of them), each looking up
+ * the same path "iterations" times, and reports how many lookups per second
+ * they managed together.  With open=1 every lookup opens and closes the
+ * file instead of just stat()ing it.  With negative=1 each lookup is for a
+ * new name that does not exist in the directory "path", which exercises
+ * negative dentry creation and fs.negative-dentry-limit.
+ *
+ * Point it at a deep path on the filesystem of interest, e.g.
+ *
+ *	modprobe test-pathwalk path=/usr/share/zoneinfo/America/Argentina/Salta
+ *
+ * The module does not stay loaded, so it can simply be run again.
+ */
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/ktime.h>
+#include <linux/namei.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/stat.h>
+#include <linux/slab.h>
+#include <linux/err.h>
+
+static char *path = "/";
+module_param(path, charp, 0444);
+MODULE_PARM_DESC(path, "path to look up");
+
+static unsigned int threads;
+module_param(threads, uint, 0444);
+MODULE_PARM_DESC(threads, "number of threads (default: online cpus)");
+
+static unsigned int iterations = 100000;
+module_param(iterations, uint, 0444);
+MODULE_PARM_DESC(iterations, "lookups per thread");
+
+static bool do_open;
+module_param_named(open, do_open, bool, 0444);
+MODULE_PARM_DESC(open, "open and close the file instead of stat()ing it");
+
+static bool negative;
+module_param(negative, bool, 0444);
+MODULE_PARM_DESC(negative, "look up new missing names in the directory path");
+
+struct pathwalk_thread {
+	struct task_struct	*task;
+	unsigned int		id;
+	int			err;
+	u64			nsecs;
+	char			name[PATH_MAX];
+};
+
+static atomic_t pathwalk_running;
+static DECLARE_COMPLETION(pathwalk_start);
+static DECLARE_COMPLETION(pathwalk_done);
+
+static int pathwalk_one(const char *name)
+{
+	struct file *file;
+	struct kstat stat;
+	struct path p;
+	int err;
+
+	if (do_open) {
+		file = filp_open(name, O_RDONLY | O_LARGEFILE, 0);
+		if (IS_ERR(file))
+			return PTR_ERR(file);
+		return filp_close(file, NULL);
+	}
+
+	err = kern_path(name, LOOKUP_FOLLOW, &p);
+	if (err)
+		return err;
+	err = vfs_getattr(p.mnt, p.dentry, &stat);
+	path_put(&p);
+	return err;
+}
+
+static int pathwalk_thread(void *data)
+{
+	struct pathwalk_thread *t = data;
+	ktime_t start;
+	unsigned int i;
+	int err;
+
+	wait_for_completion(&pathwalk_start);
+
+	start = ktime_get();
+	for (i = 0; i < iterations; i++) {
+		if (negative)
+			snprintf(t->name, PATH_MAX, "%s/.pathwalk-%u-%u",
+				 path, t->id, i);
+		err = pathwalk_one(t->name);
+		if (negative && err == -ENOENT)
+			err = 0;
+		if (err) {
+			t->err = err;
+			break;
+		}
+		cond_resched();
+	}
+	t->nsecs = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	if (atomic_dec_and_test(&pathwalk_running))
+		complete(&pathwalk_done);
+
+	/* our code goes away with the module, so wait for kthread_stop() */
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+static int __init test_pathwalk_init(void)
+{
+	struct pathwalk_thread *t;
+	unsigned int nr = threads ? threads : num_online_cpus();
+	unsigned int i, started = 0;
+	u64 slowest = 0, ops;
+	int err = 0;
+
+	t = kcalloc(nr, sizeof(*t), GFP_KERNEL);
+	if (!t)
+		return -ENOMEM;
+
+	atomic_set(&pathwalk_running, nr);
+	for (i = 0; i < nr; i++) {
+		t[i].id = i;
+		strlcpy(t[i].name, path, PATH_MAX);
+		t[i].task = kthread_create(pathwalk_thread, &t[i],
+					   "pathwalk/%u", i);
+		if (IS_ERR(t[i].task)) {
+			err = PTR_ERR(t[i].task);
+			break;
+		}
+		wake_up_process(t[i].task);
+		started++;
+	}
+
+	/* threads that never got created count as done */
+	if (started < nr &&
+	    atomic_sub_and_test(nr - started, &pathwalk_running))
+		complete(&pathwalk_done);
+
+	complete_all(&pathwalk_start);
+	if (started)
+		wait_for_completion(&pathwalk_done);
+
+	for (i = 0; i < started; i++) {
+		kthread_stop(t[i].task);
+		if (t[i].err && !err)
+			err = t[i].err;
+		slowest = max(slowest, t[i].nsecs);
+	}
+
+	if (!err && slowest) {
+		ops = div64_u64((u64)nr * iterations * NSEC_PER_SEC, slowest);
+		pr_info("test-pathwalk: %s%s: %u threads x %u %s, %llu ms, %llu ops/s\n",
+			path, negative ? "/<missing>" : "", nr, iterations,
+			do_open ? "opens" : "stats",
+			(unsigned long long)div_u64(slowest, NSEC_PER_MSEC),
+			(unsigned long long)ops);
+	} else if (err) {
+		pr_err("test-pathwalk: %s: error %d\n", path, err);
+	}
+
+	kfree(t);
+	return err ? err : -EAGAIN;
+}
+module_init(test_pathwalk_init);
+
+MODULE_DESCRIPTION("Parallel path lookup benchmark");
+MODULE_LICENSE("GPL");
@@ -2677,6 +2677,9 @@ EXPORT_SYMBOL(rps_sock_flow_table);
 
 struct static_key rps_needed __read_mostly;
 
+/* Minimum time (jiffies) a flow stays on a CPU before RFS moves it again */
+int sysctl_rps_flow_migrate_delay __read_mostly = HZ / 100;
+
 static struct rps_dev_flow *
 set_rps_cpu(struct net_device *dev, struct sk_buff *skb,
 	    struct rps_dev_flow *rflow, u16 next_cpu)
@@ -2716,6 +2719,7 @@ set_rps_cpu(struct net_device *dev, struct sk_buff *skb,
 #endif
 		rflow->last_qtail =
 			per_cpu(softnet_data, next_cpu).input_queue_head;
+		rflow->last_migrate = jiffies;
 	}
 
 	rflow->cpu = next_cpu;
@@ -2786,15 +2790,35 @@ static int get_rps_cpu(struct net_device *dev, struct sk_buff *skb,
 		 *   - Current CPU is unset (equal to RPS_NO_CPU).
 		 *   - Current CPU is offline.
 		 *   - The current CPU's queue tail has advanced beyond the
-		 *     last packet that was enqueued using this table entry.
-		 *     This guarantees that all previous packets for the flow
-		 *     have been dequeued, thus preserving in order delivery.
+		 *     last packet that was enqueued using this table entry,
+		 *     and the flow has stayed on the current CPU for at
+		 *     least sysctl_rps_flow_migrate_delay.
+		 *     The first part guarantees that all previous packets for
+		 *     the flow have been dequeued, thus preserving in order
+		 *     delivery. The second keeps a consumer that bounces
+		 *     between CPUs from dragging the softirq work (and its
+		 *     cache footprint) along on every hop.
 		 */
-		if (unlikely(tcpu != next_cpu) &&
-		    (tcpu == RPS_NO_CPU || !cpu_online(tcpu) ||
-		     ((int)(per_cpu(softnet_data, tcpu).input_queue_head -
-		      rflow->last_qtail)) >= 0))
-			rflow = set_rps_cpu(dev, skb, rflow, next_cpu);
+		if (unlikely(tcpu != next_cpu)) {
+			if (tcpu == RPS_NO_CPU || !cpu_online(tcpu)) {
+				/* a flow forced off an offline CPU moves too */
+				if (tcpu != RPS_NO_CPU && next_cpu != RPS_NO_CPU)
+					__this_cpu_inc(softnet_data.flow_migrations);
+				rflow = set_rps_cpu(dev, skb, rflow, next_cpu);
+			} else if ((int)(per_cpu(softnet_data, tcpu).input_queue_head -
+					 rflow->last_qtail) >= 0) {
+				if ((int)((unsigned int)jiffies - rflow->last_migrate) <
+				    sysctl_rps_flow_migrate_delay) {
+					/* only a move to a real CPU is held back */
+					if (next_cpu != RPS_NO_CPU)
+						__this_cpu_inc(softnet_data.flow_migrations_held);
+				} else {
+					if (next_cpu != RPS_NO_CPU)
+						__this_cpu_inc(softnet_data.flow_migrations);
+					rflow = set_rps_cpu(dev, skb, rflow, next_cpu);
+				}
+			}
+		}
 
 		if (tcpu != RPS_NO_CPU && cpu_online(tcpu)) {
 			*rflowp = rflow;
@@ -4241,10 +4265,11 @@ static int softnet_seq_show(struct seq_file *seq, void *v)
 {
 	struct softnet_data *sd = v;
 
-	seq_printf(seq, "%08x %08x %08x %08x %08x %08x %08x %08x %08x %08x\n",
+	seq_printf(seq, "%08x %08x %08x %08x %08x %08x %08x %08x %08x %08x %08x %08x\n",
 		   sd->processed, sd->dropped, sd->time_squeeze, 0,
 		   0, 0, 0, 0, /* was fastroute */
-		   sd->cpu_collision, sd->received_rps);
+		   sd->cpu_collision, sd->received_rps,
+		   sd->flow_migrations, sd->flow_migrations_held);
 	return 0;
 }
 
@@ -1,10 +1,147 @@
+#include <linux/crypto.h>
+#include <linux/err.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
+#include <linux/random.h>
+#include <linux/rcupdate.h>
+#include <linux/slab.h>
+#include <linux/tcp.h>
+#include <net/tcp.h>
 
-int sysctl_tcp_fastopen;
+int sysctl_tcp_fastopen __read_mostly;
+
+/* The key currently used to hand out cookies, and the one it replaced.
+ * Cookies made with the previous key are still honoured so that rotating
+ * the key does not turn every cached client cookie into a full handshake.
+ */
+static struct tcp_fastopen_context __rcu *tcp_fastopen_ctx;
+static struct tcp_fastopen_context __rcu *tcp_fastopen_ctx_prev;
+
+static DEFINE_SPINLOCK(tcp_fastopen_ctx_lock);
+
+static void tcp_fastopen_ctx_free(struct rcu_head *head)
+{
+	struct tcp_fastopen_context *ctx =
+	    container_of(head, struct tcp_fastopen_context, rcu);
+	crypto_free_cipher(ctx->tfm);
+	kfree(ctx);
+}
+
+int tcp_fastopen_reset_cipher(void *key, unsigned int len)
+{
+	int err;
+	struct tcp_fastopen_context *ctx, *octx;
+
+	ctx = kmalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+	ctx->tfm = crypto_alloc_cipher("aes", 0, 0);
+
+	if (IS_ERR(ctx->tfm)) {
+		err = PTR_ERR(ctx->tfm);
+error:		kfree(ctx);
+		pr_err("TCP: TFO aes cipher alloc error: %d\n", err);
+		return err;
+	}
+	err = crypto_cipher_setkey(ctx->tfm, key, len);
+	if (err) {
+		pr_err("TCP: TFO cipher key error: %d\n", err);
+		crypto_free_cipher(ctx->tfm);
+		goto error;
+	}
+	memcpy(ctx->key, key, len);
+
+	spin_lock(&tcp_fastopen_ctx_lock);
+
+	octx = rcu_dereference_protected(tcp_fastopen_ctx_prev,
+				lockdep_is_held(&tcp_fastopen_ctx_lock));
+	rcu_assign_pointer(tcp_fastopen_ctx_prev,
+			   rcu_dereference_protected(tcp_fastopen_ctx,
+				lockdep_is_held(&tcp_fastopen_ctx_lock)));
+	rcu_assign_pointer(tcp_fastopen_ctx, ctx);
+	spin_unlock(&tcp_fastopen_ctx_lock);
+
+	if (octx)
+		call_rcu(&octx->rcu, tcp_fastopen_ctx_free);
+	return err;
+}
+
+/* Copy the current key for the sysctl interface, zeroes if there is none. */
+void tcp_fastopen_get_key(void *key)
+{
+	struct tcp_fastopen_context *ctx;
+
+	rcu_read_lock();
+	ctx = rcu_dereference(tcp_fastopen_ctx);
+	if (ctx)
+		memcpy(key, ctx->key, TCP_FASTOPEN_KEY_LENGTH);
+	else
+		memset(key, 0, TCP_FASTOPEN_KEY_LENGTH);
+	rcu_read_unlock();
+}
+
+static void __tcp_fastopen_cookie_gen(struct tcp_fastopen_context *ctx,
+				      __be32 addr,
+				      struct tcp_fastopen_cookie *foc)
+{
+	__be32 peer_addr[4] = { addr, 0, 0, 0 };
+
+	crypto_cipher_encrypt_one(ctx->tfm, foc->val, (__u8 *)peer_addr);
+	foc->len = TCP_FASTOPEN_COOKIE_SIZE;
+}
+
+/* Computes the fastopen cookie for the peer.
+ * The peer address is a 128 bits long (pad with zeros for IPv4).
+ *
+ * The caller must check foc->len to determine if a valid cookie
+ * has been generated successfully.
+ */
+void tcp_fastopen_cookie_gen(__be32 addr, struct tcp_fastopen_cookie *foc)
+{
+	struct tcp_fastopen_context *ctx;
+
+	rcu_read_lock();
+	ctx = rcu_dereference(tcp_fastopen_ctx);
+	if (ctx)
+		__tcp_fastopen_cookie_gen(ctx, addr, foc);
+	rcu_read_unlock();
+}
+
+/* Check a cookie presented in a SYN against the current and the previous
+ * key.
+ */
+bool tcp_fastopen_cookie_valid(__be32 addr,
+			       const struct tcp_fastopen_cookie *foc)
+{
+	struct tcp_fastopen_context *ctx;
+	struct tcp_fastopen_cookie tmp;
+	bool valid = false;
+
+	if (foc->len != TCP_FASTOPEN_COOKIE_SIZE)
+		return false;
+
+	rcu_read_lock();
+	ctx = rcu_dereference(tcp_fastopen_ctx);
+	if (ctx) {
+		__tcp_fastopen_cookie_gen(ctx, addr, &tmp);
+		valid = !memcmp(tmp.val, foc->val, TCP_FASTOPEN_COOKIE_SIZE);
+	}
+	ctx = rcu_dereference(tcp_fastopen_ctx_prev);
+	if (!valid && ctx) {
+		__tcp_fastopen_cookie_gen(ctx, addr, &tmp);
+		valid = !memcmp(tmp.val, foc->val, TCP_FASTOPEN_COOKIE_SIZE);
+	}
+	rcu_read_unlock();
+
+	return valid;
+}
 
 static int __init tcp_fastopen_init(void)
 {
+	__u8 key[TCP_FASTOPEN_KEY_LENGTH];
+
+	get_random_bytes(key, sizeof(key));
+	tcp_fastopen_reset_cipher(key, sizeof(key));
 	return 0;
 }
 
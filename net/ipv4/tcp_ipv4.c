@@ -348,6 +348,7 @@ void tcp_v4_err(struct sk_buff *icmp_skb, u32 info)
 	struct inet_connection_sock *icsk;
 	struct tcp_sock *tp;
 	struct inet_sock *inet;
+	struct request_sock *fastopen;
 	const int type = icmp_hdr(icmp_skb)->type;
 	const int code = icmp_hdr(icmp_skb)->code;
 	struct sock *sk;
@@ -394,9 +395,12 @@ void tcp_v4_err(struct sk_buff *icmp_skb, u32 info)
 
 	icsk = inet_csk(sk);
 	tp = tcp_sk(sk);
+	fastopen = tp->fastopen_rsk;
 	seq = ntohl(th->seq);
+	/* A Fast Open child in SYN_RECV may get an error for its SYN-ACK */
 	if (sk->sk_state != TCP_LISTEN &&
-	    !between(seq, tp->snd_una, tp->snd_nxt)) {
+	    !between(seq, tp->snd_una, tp->snd_nxt) &&
+	    (!fastopen || seq != tcp_rsk(fastopen)->snt_isn)) {
 		NET_INC_STATS_BH(net, LINUX_MIB_OUTOFWINDOWICMPS);
 		goto out;
 	}
@@ -498,7 +502,8 @@ void tcp_v4_err(struct sk_buff *icmp_skb, u32 info)
 
 	case TCP_SYN_SENT:
 	case TCP_SYN_RECV:  /* Cannot happen.
-			       It can f.e. if SYNs crossed.
+			       It can f.e. if SYNs crossed,
+			       or Fast Open.
 			     */
 		if (!sock_owned_by_user(sk)) {
 			sk->sk_err = err;
@@ -809,8 +814,12 @@ static void tcp_v4_timewait_ack(struct sock *sk, struct sk_buff *skb)
 static void tcp_v4_reqsk_send_ack(struct sock *sk, struct sk_buff *skb,
 				  struct request_sock *req)
 {
-	tcp_v4_send_ack(skb, tcp_rsk(req)->snt_isn + 1,
-			tcp_rsk(req)->rcv_isn + 1, req->rcv_wnd,
+	/* sk->sk_state == TCP_LISTEN -> for regular TCP_SYN_RECV
+	 * sk->sk_state == TCP_SYN_RECV -> for Fast Open.
+	 */
+	tcp_v4_send_ack(skb, (sk->sk_state == TCP_LISTEN) ?
+			tcp_rsk(req)->snt_isn + 1 : tcp_sk(sk)->snd_nxt,
+			tcp_rsk(req)->rcv_nxt, req->rcv_wnd,
 			req->ts_recent,
 			0,
 			tcp_md5_do_lookup(sk, (union tcp_md5_addr *)&ip_hdr(skb)->daddr,
@@ -828,7 +837,8 @@ static int tcp_v4_send_synack(struct sock *sk, struct dst_entry *dst,
 			      struct request_sock *req,
 			      struct request_values *rvp,
 			      u16 queue_mapping,
-			      bool nocache)
+			      bool nocache,
+			      struct tcp_fastopen_cookie *foc)
 {
 	const struct inet_request_sock *ireq = inet_rsk(req);
 	struct flowi4 fl4;
@@ -839,7 +849,7 @@ static int tcp_v4_send_synack(struct sock *sk, struct dst_entry *dst,
 	if (!dst && (dst = inet_csk_route_req(sk, &fl4, req)) == NULL)
 		return -1;
 
-	skb = tcp_make_synack(sk, dst, req, rvp);
+	skb = tcp_make_synack(sk, dst, req, rvp, foc);
 
 	if (skb) {
 		__tcp_v4_send_check(skb, ireq->loc_addr, ireq->rmt_addr);
@@ -858,7 +868,7 @@ static int tcp_v4_rtx_synack(struct sock *sk, struct request_sock *req,
 			      struct request_values *rvp)
 {
 	TCP_INC_STATS_BH(sock_net(sk), TCP_MIB_RETRANSSEGS);
-	return tcp_v4_send_synack(sk, NULL, req, rvp, 0, false);
+	return tcp_v4_send_synack(sk, NULL, req, rvp, 0, false, NULL);
 }
 
 /*
@@ -1272,7 +1282,169 @@ static const struct tcp_request_sock_ops tcp_request_sock_ipv4_ops = {
 };
 #endif
 
-int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
+/* Decide whether the data in this SYN can be accepted right away.  When
+ * it cannot but the client asked for a cookie, or sent one we no longer
+ * like, @valid_foc is filled in to be echoed in the SYNACK.
+ */
+static bool tcp_fastopen_check(struct sock *sk, struct sk_buff *skb,
+			       struct request_sock *req,
+			       struct tcp_fastopen_cookie *foc,
+			       struct tcp_fastopen_cookie *valid_foc)
+{
+	struct fastopen_queue *fastopenq =
+	    &inet_csk(sk)->icsk_accept_queue.fastopenq;
+	__be32 saddr = ip_hdr(skb)->saddr;
+	bool skip_cookie = false;
+
+	if (likely(!fastopen_cookie_present(foc))) {
+		if ((sysctl_tcp_fastopen & TFO_SERVER_COOKIE_NOT_REQD) &&
+		    TCP_SKB_CB(skb)->end_seq != TCP_SKB_CB(skb)->seq + 1)
+			skip_cookie = true; /* no cookie to validate */
+		else
+			return false;
+	}
+	/* A FO option is present; bump the counter. */
+	NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPFASTOPENPASSIVE);
+
+	/* Make sure the listener has enabled fastopen, and we don't
+	 * exceed the max # of pending TFO requests allowed before trying
+	 * to validate the cookie in order to avoid burning CPU cycles
+	 * unnecessarily.
+	 */
+	if (!(sysctl_tcp_fastopen & TFO_SERVER_ENABLE) ||
+	    fastopenq->max_qlen == 0)
+		return false;
+
+	if (fastopenq->qlen >= fastopenq->max_qlen) {
+		NET_INC_STATS_BH(sock_net(sk),
+				 LINUX_MIB_TCPFASTOPENLISTENOVERFLOW);
+		return false;
+	}
+
+	if (!skip_cookie) {
+		if (foc->len == 0) {
+			/* Client requesting a cookie */
+			tcp_fastopen_cookie_gen(saddr, valid_foc);
+			NET_INC_STATS_BH(sock_net(sk),
+					 LINUX_MIB_TCPFASTOPENCOOKIEREQD);
+			return false;
+		}
+		if (!tcp_fastopen_cookie_valid(saddr, foc)) {
+			/* Treat a cookie of the wrong size or made with an
+			 * unknown key as a request for a new one.
+			 */
+			tcp_fastopen_cookie_gen(saddr, valid_foc);
+			NET_INC_STATS_BH(sock_net(sk),
+					 LINUX_MIB_TCPFASTOPENPASSIVEFAIL);
+			return false;
+		}
+		/* Refresh cookies made with the previous key. */
+		tcp_fastopen_cookie_gen(saddr, valid_foc);
+		if (fastopen_cookie_present(valid_foc) &&
+		    !memcmp(valid_foc->val, foc->val, TCP_FASTOPEN_COOKIE_SIZE))
+			valid_foc->len = -1;
+	}
+
+	/* Acknowledge the data received from the peer. */
+	tcp_rsk(req)->rcv_nxt = TCP_SKB_CB(skb)->end_seq;
+	return true;
+}
+
+/* Create the child socket for a Fast Open request straight away and queue
+ * the data carried in the SYN on it, so that accept() and read() can return
+ * before the three way handshake completes.  The request sock is not put in
+ * the SYN table: the child owns it and retransmits the SYNACK from its own
+ * retransmit timer until the final ACK arrives.
+ */
+static int tcp_v4_conn_req_fastopen(struct sock *sk, struct sk_buff *skb,
+				    struct dst_entry *dst,
+				    struct request_sock *req,
+				    struct request_values *rvp,
+				    struct tcp_fastopen_cookie *foc)
+{
+	struct fastopen_queue *fastopenq =
+	    &inet_csk(sk)->icsk_accept_queue.fastopenq;
+	struct tcp_sock *tp;
+	struct sock *child;
+
+	req->retrans = 0;
+	req->sk = NULL;
+
+	child = inet_csk(sk)->icsk_af_ops->syn_recv_sock(sk, skb, req, dst);
+	if (child == NULL) {
+		NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPFASTOPENPASSIVEFAIL);
+		return -1;
+	}
+
+	/* A lost SYNACK is recovered by the child's retransmit timer. */
+	tcp_v4_send_synack(sk, NULL, req, rvp, skb_get_queue_mapping(skb),
+			   false, fastopen_cookie_present(foc) ? foc : NULL);
+
+	spin_lock(&fastopenq->lock);
+	fastopenq->qlen++;
+	spin_unlock(&fastopenq->lock);
+
+	/* Initialize the child socket. Have to fix some values to take
+	 * into account the child is a Fast Open socket and is created
+	 * only out of the bits carried in the SYN packet.
+	 */
+	tp = tcp_sk(child);
+
+	tp->fastopen_rsk = req;
+	/* Do a hold on the listener sk so that if the listener is being
+	 * closed, the child that has been accepted can live on and still
+	 * access the fastopen queue lock.
+	 */
+	sock_hold(sk);
+	tcp_rsk(req)->listener = sk;
+
+	/* RFC1323: The window in SYN & SYN/ACK segments is never
+	 * scaled. So correct it appropriately.
+	 */
+	tp->snd_wnd = ntohs(tcp_hdr(skb)->window);
+
+	/* Activate the retrans timer so that SYNACK can be retransmitted.
+	 * The request socket is not added to the SYN table of the parent
+	 * because it's been added to the accept queue directly.
+	 */
+	inet_csk_reset_xmit_timer(child, ICSK_TIME_RETRANS,
+				  TCP_TIMEOUT_INIT, TCP_RTO_MAX);
+
+	/* Add the child socket directly into the accept queue */
+	inet_csk_reqsk_queue_add(sk, req, child);
+
+	/* Now finish processing the fastopen child socket. */
+	inet_csk(child)->icsk_af_ops->rebuild_header(child);
+	tcp_init_congestion_control(child);
+	tcp_mtup_init(child);
+	tcp_init_buffer_space(child);
+	tp->lsndtime = tcp_time_stamp;
+
+	/* Queue the data carried in the SYN packet. We need to first
+	 * bump skb's refcnt because the caller will attempt to free it.
+	 */
+	if (TCP_SKB_CB(skb)->end_seq != TCP_SKB_CB(skb)->seq + 1) {
+		skb = skb_get(skb);
+		skb_dst_drop(skb);
+		__skb_pull(skb, tcp_hdr(skb)->doff * 4);
+		skb_set_owner_r(skb, child);
+		__skb_queue_tail(&child->sk_receive_queue, skb);
+	}
+	tp->rcv_nxt = tp->rcv_wup = TCP_SKB_CB(skb)->end_seq;
+
+	sk->sk_data_ready(sk, 0);
+	bh_unlock_sock(child);
+	sock_put(child);
+	WARN_ON(req->sk == NULL);
+	return 0;
+}
+
+/* When @locked is false the caller does not own the listener lock and only
+ * holds the read side of its syn_wait_lock: the request is always answered
+ * with a syncookie and nothing is added to the SYN queue.
+ */
+static int __tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb,
+				 bool locked)
 {
 	struct tcp_extend_values tmp_ext;
 	struct tcp_options_received tmp_opt;
@@ -1285,6 +1457,8 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	__be32 daddr = ip_hdr(skb)->daddr;
 	__u32 isn = TCP_SKB_CB(skb)->when;
 	bool want_cookie = false;
+	struct tcp_fastopen_cookie foc = { .len = -1 };
+	struct tcp_fastopen_cookie valid_foc = { .len = -1 };
 
 	/* Never answer to SYNs send to broadcast or multicast */
 	if (skb_rtable(skb)->rt_flags & (RTCF_BROADCAST | RTCF_MULTICAST))
@@ -1294,7 +1468,7 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	 * limitations, they conserve resources and peer is
 	 * evidently real one.
 	 */
-	if (inet_csk_reqsk_queue_is_full(sk) && !isn) {
+	if (!locked || (inet_csk_reqsk_queue_is_full(sk) && !isn)) {
 		want_cookie = tcp_syn_flood_action(sk, skb, "TCP");
 		if (!want_cookie)
 			goto drop;
@@ -1319,9 +1493,11 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	tcp_clear_options(&tmp_opt);
 	tmp_opt.mss_clamp = TCP_MSS_DEFAULT;
 	tmp_opt.user_mss  = tp->rx_opt.user_mss;
-	tcp_parse_options(skb, &tmp_opt, &hash_location, 0, NULL);
+	tcp_parse_options(skb, &tmp_opt, &hash_location, 0,
+			  want_cookie ? NULL : &foc);
 
-	if (tmp_opt.cookie_plus > 0 &&
+	if (locked &&
+	    tmp_opt.cookie_plus > 0 &&
 	    tmp_opt.saw_tstamp &&
 	    !tp->rx_opt.cookie_out_never &&
 	    (sysctl_tcp_cookie_size > 0 ||
@@ -1419,10 +1595,21 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	tcp_rsk(req)->snt_isn = isn;
 	tcp_rsk(req)->snt_synack = tcp_time_stamp;
 
+	if (!want_cookie &&
+	    tcp_fastopen_check(sk, skb, req, &foc, &valid_foc)) {
+		if (tcp_v4_conn_req_fastopen(sk, skb, dst, req,
+					     (struct request_values *)&tmp_ext,
+					     &valid_foc))
+			goto drop_and_free;
+		return 0;
+	}
+
 	if (tcp_v4_send_synack(sk, dst, req,
 			       (struct request_values *)&tmp_ext,
 			       skb_get_queue_mapping(skb),
-			       want_cookie) ||
+			       want_cookie,
+			       fastopen_cookie_present(&valid_foc) ?
+			       &valid_foc : NULL) ||
 	    want_cookie)
 		goto drop_and_free;
 
@@ -1436,8 +1623,66 @@ drop_and_free:
 drop:
 	return 0;
 }
+
+int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
+{
+	return __tcp_v4_conn_request(sk, skb, true);
+}
 EXPORT_SYMBOL(tcp_v4_conn_request);
 
+/*
+ * Answer a SYN to an overflowing listener with a syncookie without taking
+ * the listener lock.  Cookies are stateless, so the only thing we need to
+ * be protected against is the listener going away under us, which the read
+ * side of syn_wait_lock does.  Anything that may need state (a retransmitted
+ * SYN for a pending request, MD5 or a non IPv4 listener) takes the usual
+ * locked path.
+ *
+ * Returns true if the skb was consumed.
+ */
+static bool tcp_v4_syn_cookie_rcv(struct sock *sk, struct sk_buff *skb)
+{
+#ifdef CONFIG_SYN_COOKIES
+	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
+	const struct tcphdr *th = tcp_hdr(skb);
+	const struct iphdr *iph = ip_hdr(skb);
+	struct request_sock **prev;
+	bool consumed = false;
+
+	if (!sysctl_tcp_syncookies || sk->sk_family != AF_INET ||
+	    !th->syn || th->ack || th->rst || th->fin)
+		return false;
+#ifdef CONFIG_TCP_MD5SIG
+	if (rcu_access_pointer(tcp_sk(sk)->md5sig_info))
+		return false;
+#endif
+	if (sysctl_tcp_cookie_size > 0 || tcp_sk(sk)->cookie_values)
+		return false;
+
+	read_lock(&queue->syn_wait_lock);
+	if (sk->sk_state != TCP_LISTEN || !queue->listen_opt ||
+	    !reqsk_queue_is_full(queue) ||
+	    inet_csk_search_req(sk, &prev, th->source, iph->saddr, iph->daddr))
+		goto out;
+
+	consumed = true;
+	if (skb->len < tcp_hdrlen(skb) || tcp_checksum_complete(skb)) {
+		TCP_INC_STATS_BH(sock_net(sk), TCP_MIB_INERRS);
+		goto out;
+	}
+
+	NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPLOCKLESSSYNCOOKIES);
+	__tcp_v4_conn_request(sk, skb, false);
+out:
+	read_unlock(&queue->syn_wait_lock);
+	if (consumed)
+		kfree_skb(skb);
+	return consumed;
+#else
+	return false;
+#endif
+}
+
 
 /*
  * The three way handshake has completed - we got a valid synack -
@@ -1554,7 +1799,7 @@ static struct sock *tcp_v4_hnd_req(struct sock *sk, struct sk_buff *skb)
 	struct request_sock *req = inet_csk_search_req(sk, &prev, th->source,
 						       iph->saddr, iph->daddr);
 	if (req)
-		return tcp_check_req(sk, skb, req, prev);
+		return tcp_check_req(sk, skb, req, prev, false);
 
 	nsk = inet_lookup_established(sock_net(sk), &tcp_hashinfo, iph->saddr,
 			th->source, iph->daddr, th->dest, inet_iif(skb));
@@ -1784,6 +2029,11 @@ process:
 
 	skb->dev = NULL;
 
+	if (sk->sk_state == TCP_LISTEN && tcp_v4_syn_cookie_rcv(sk, skb)) {
+		sock_put(sk);
+		return 0;
+	}
+
 	bh_lock_sock_nested(sk);
 	ret = 0;
 	if (!sock_owned_by_user(sk)) {
@@ -1942,6 +2192,10 @@ void tcp_v4_destroy_sock(struct sock *sk)
 	/* Cleans up our, hopefully empty, out_of_order_queue. */
 	__skb_queue_purge(&tp->out_of_order_queue);
 
+	/* A Fast Open child torn down before its handshake completed. */
+	if (tp->fastopen_rsk)
+		reqsk_fastopen_remove(sk, tp->fastopen_rsk);
+
 #ifdef CONFIG_TCP_MD5SIG
 	/* Clean up the MD5 key list, if any */
 	if (tp->md5sig_info) {
@@ -749,9 +749,17 @@ static int smack_inode_permission(struct inode *inode, int mask)
 	if (mask == 0)
 		return 0;
 
-	/* May be droppable after audit */
-	if (no_block)
+	/*
+	 * The audit record wants the inode's dentry, which is not safe to
+	 * look at during rcu-walk.  Only granted accesses that are not
+	 * logged can be decided here, everything else is redone in ref-walk.
+	 */
+	if (no_block) {
+		if (!(log_policy & SMACK_AUDIT_ACCEPT) &&
+		    !smk_curacc(smk_of_inode(inode), mask, NULL))
+			return 0;
 		return -ECHILD;
+	}
 	smk_ad_init(&ad, __func__, LSM_AUDIT_DATA_INODE);
 	smk_ad_setfield_u_fs_inode(&ad, inode);
 	return smk_curacc(smk_of_inode(inode), mask, &ad);
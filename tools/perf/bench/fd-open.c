@@ -0,0 +1,167 @@
+/*
+ *
+ * fd-open.c
+ *
+ * open: Benchmark for open() and close() from many threads
+ *
+ * Every thread opens and closes the same file in a loop, so the time goes
+ * into allocating the lowest free descriptor, installing and removing it
+ * from the shared descriptor table and allocating the struct file.
+ * --prefill keeps that many descriptors open beforehand, the way a proxy
+ * with many connections would, so the search for a free slot has to get
+ * past them.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+static int nr_threads = 1;
+static int loops = 100000;
+static int prefill;
+static const char *path = "/dev/null";
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Specify number of threads"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of open/close pairs per thread"),
+	OPT_INTEGER('n', "prefill", &prefill,
+		    "Specify number of descriptors to keep open"),
+	OPT_STRING('p', "path", &path, "path",
+		   "Specify file to open"),
+	OPT_END()
+};
+
+static const char * const bench_fd_open_usage[] = {
+	"perf bench fd open <options>",
+	NULL
+};
+
+static pthread_mutex_t start_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t start_cond = PTHREAD_COND_INITIALIZER;
+static int started;
+
+static void *worker(void *arg __used)
+{
+	int i, fd;
+
+	pthread_mutex_lock(&start_mutex);
+	while (!started)
+		pthread_cond_wait(&start_cond, &start_mutex);
+	pthread_mutex_unlock(&start_mutex);
+
+	for (i = 0; i < loops; i++) {
+		fd = open(path, O_RDONLY);
+		if (fd < 0)
+			die("open %s: %s", path, strerror(errno));
+		close(fd);
+	}
+	return NULL;
+}
+
+int bench_fd_open(int argc, const char **argv,
+		  const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long result_usec = 0;
+	unsigned long long ops;
+	struct rlimit rlim;
+	pthread_t *threads;
+	int i, fd;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fd_open_usage, 0);
+
+	if (nr_threads < 1 || loops < 1 || prefill < 0)
+		usage_with_options(bench_fd_open_usage, options);
+
+	/* room for the prefill plus one descriptor per thread */
+	if (!getrlimit(RLIMIT_NOFILE, &rlim) &&
+	    rlim.rlim_cur < (rlim_t)prefill + nr_threads + 16) {
+		rlim.rlim_cur = (rlim_t)prefill + nr_threads + 16;
+		if (rlim.rlim_max < rlim.rlim_cur)
+			rlim.rlim_max = rlim.rlim_cur;
+		if (setrlimit(RLIMIT_NOFILE, &rlim))
+			die("setrlimit %d descriptors: %s",
+			    (int)rlim.rlim_cur, strerror(errno));
+	}
+
+	for (i = 0; i < prefill; i++) {
+		fd = open(path, O_RDONLY);
+		if (fd < 0)
+			die("open %s: %s", path, strerror(errno));
+	}
+
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (!threads)
+		die("calloc");
+
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&threads[i], NULL, worker, NULL))
+			die("pthread_create");
+
+	gettimeofday(&start, NULL);
+
+	pthread_mutex_lock(&start_mutex);
+	started = 1;
+	pthread_cond_broadcast(&start_cond);
+	pthread_mutex_unlock(&start_mutex);
+
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	free(threads);
+
+	ops = (unsigned long long)nr_threads * loops;
+	result_usec = diff.tv_sec * 1000000;
+	result_usec += diff.tv_usec;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d threads each did %d open/close pairs of %s\n",
+		       nr_threads, loops, path);
+		printf("# with %d other descriptors open\n\n", prefill);
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lf usecs/op\n",
+		       (double)result_usec / (double)ops);
+		printf(" %14llu ops/sec\n",
+		       (unsigned long long)((double)ops /
+			     ((double)result_usec / (double)1000000)));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -13,6 +13,7 @@
  * Available subsystem list:
  *  sched ... scheduler and IPC mechanism
  *  mem   ... memory access performance
+ *  fd    ... file descriptor table
  *
  */
 
@@ -61,6 +62,16 @@ static struct bench_suite mem_suites[] = {
 	  NULL             }
 };
 
+static struct bench_suite fd_suites[] = {
+	{ "open",
+	  "open() and close() from many threads at once",
+	  bench_fd_open },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL          }
+};
+
 struct bench_subsys {
 	const char *name;
 	const char *summary;
@@ -74,6 +85,9 @@ static struct bench_subsys subsystems[] = {
 	{ "mem",
 	  "memory access performance",
 	  mem_suites },
+	{ "fd",
+	  "file descriptor table",
+	  fd_suites },
 	{ "all",		/* sentinel: easy for help */
 	  "all benchmark subsystem",
 	  NULL },
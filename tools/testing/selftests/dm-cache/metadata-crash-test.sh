@@ -0,0 +1,143 @@
+#!/bin/bash
+#
+# Checks that the cache target survives a crash in the middle of a
+# metadata commit.  A commit writes the mapping copy the superblock does
+# not point at, so a torn commit is simulated by corrupting that copy
+# while the cache is down.  The cache must still load with its data
+# intact.  Corrupting the copy in use must still be detected.
+
+BLOCK_SIZE=128			# sectors per cache block
+ENTRIES_PER_BLOCK=510		# mapping entries per 4KB metadata block
+NAME=dm-cache-selftest
+DIR=
+META=
+CDATA=
+ORIGIN=
+
+prerequisite()
+{
+	msg="skip all tests:"
+
+	if [ $UID != 0 ]; then
+		echo $msg must be run as root >&2
+		exit 0
+	fi
+
+	for tool in dmsetup losetup blockdev md5sum od; do
+		if ! which $tool > /dev/null 2>&1; then
+			echo $msg $tool is not installed >&2
+			exit 0
+		fi
+	done
+
+	modprobe dm-cache > /dev/null 2>&1
+	modprobe dm-cache-mq > /dev/null 2>&1
+	if ! dmsetup targets | grep -q '^cache'; then
+		echo $msg the cache target is not available >&2
+		exit 0
+	fi
+}
+
+cleanup()
+{
+	dmsetup remove $NAME > /dev/null 2>&1
+	for dev in $META $CDATA $ORIGIN; do
+		losetup -d $dev
+	done
+	rm -rf $DIR
+}
+
+setup()
+{
+	DIR=`mktemp -d`
+	dd if=/dev/zero of=$DIR/meta bs=1M count=1 2> /dev/null
+	dd if=/dev/zero of=$DIR/cdata bs=1M count=16 2> /dev/null
+	dd if=/dev/zero of=$DIR/origin bs=1M count=64 2> /dev/null
+
+	META=`losetup -f --show $DIR/meta`
+	CDATA=`losetup -f --show $DIR/cdata`
+	ORIGIN=`losetup -f --show $DIR/origin`
+	trap cleanup EXIT
+}
+
+create_cache()
+{
+	echo "0 `blockdev --getsize $ORIGIN` cache $META $CDATA $ORIGIN" \
+	     "$BLOCK_SIZE 1 writeback mq" \
+	     "4 sequential_threshold 0 promote_threshold 1" | \
+		dmsetup create $NAME 2> /dev/null
+}
+
+# first block of mapping copy $1 on the metadata device
+mapping_block()
+{
+	local cache_blocks=$((`blockdev --getsize $CDATA` / BLOCK_SIZE))
+	local nr=$(((cache_blocks + ENTRIES_PER_BLOCK - 1) / ENTRIES_PER_BLOCK))
+
+	echo $((1 + $1 * nr))
+}
+
+# the superblock field naming the mapping copy in use
+active_copy()
+{
+	echo `dd if=$META bs=4096 count=1 iflag=direct 2> /dev/null | \
+	      od -An -tu4 -j36 -N4`
+}
+
+# corrupt_block <block> <bytes>
+corrupt_block()
+{
+	dd if=/dev/urandom of=$META bs=$2 count=1 seek=$(($1 * 4096 / $2)) \
+	   oflag=direct conv=notrunc 2> /dev/null
+}
+
+prerequisite
+setup
+
+if ! create_cache; then
+	echo "FAIL: cannot create the cache" >&2
+	exit 1
+fi
+
+# promote the first 8MB and dirty it in the cache
+dev=/dev/mapper/$NAME
+dd if=/dev/urandom of=$dev bs=1M count=8 oflag=direct 2> /dev/null
+for i in 1 2; do
+	dd if=$dev of=/dev/null bs=1M count=8 iflag=direct 2> /dev/null
+done
+dd if=/dev/urandom of=$dev bs=1M count=8 oflag=direct 2> /dev/null
+sum=`dd if=$dev bs=1M count=8 iflag=direct 2> /dev/null | md5sum`
+echo "status: `dmsetup status $NAME`"
+
+# commit twice so that both copies have been written
+dmsetup suspend $NAME && dmsetup resume $NAME
+dmsetup suspend $NAME && dmsetup resume $NAME
+dmsetup remove $NAME
+
+# a commit torn after its first sector, then one that wrote garbage
+for bytes in 512 4096; do
+	inactive=$((1 - `active_copy`))
+	corrupt_block `mapping_block $inactive` $bytes
+	if ! create_cache; then
+		echo "FAIL: torn commit ($bytes bytes) made the cache unloadable" >&2
+		exit 1
+	fi
+	if [ "`dd if=$dev bs=1M count=8 iflag=direct 2> /dev/null | md5sum`" \
+	     != "$sum" ]; then
+		echo "FAIL: data changed after a torn commit ($bytes bytes)" >&2
+		exit 1
+	fi
+	dmsetup remove $NAME
+	echo "PASS: torn commit of $bytes bytes"
+done
+
+# the copy in use is still checked
+active=`active_copy`
+corrupt_block `mapping_block $active` 4096
+if create_cache; then
+	echo "FAIL: corrupt active mapping copy was not detected" >&2
+	exit 1
+fi
+echo "PASS: corrupt active copy detected"
+
+exit 0